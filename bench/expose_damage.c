@@ -0,0 +1,500 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Damage of the windows thumbnails displayed by expose
+ *
+ *  Create four  red windows, one in each  corner of the  screen, and
+ *  publish  them  in  _NET_CLIENT_LIST  as  a  window manager  would.
+ *  Expose is then  enabled with a synthetic  key press sent by XTest
+ *  and a  green square is painted in  the middle of the window at the
+ *  bottom-right corner, thus at a non-zero offset from the root.
+ *
+ *  The root window,  which holds the contents painted  by the compositor,
+ *  is  read back until the  green square shows up  in the thumbnail,
+ *  scaled down,  thus smaller than the  square itself.
+ *
+ *  Expose is then  disabled, a blue square painted in  the same window
+ *  and expose enabled again, to check that the damage recorded while
+ *  disabled is applied  to the cached thumbnail.  The result is reported
+ *  as a JSON object and the program fails if any of the thumbnails has
+ *  not been updated before the timeout.
+ *
+ *  unagi should  be run with the  expose plugin, and preferably with
+ *  expose_server_scaling  disabled  as the windows  Images are then
+ *  fetched and updated on the damaged areas only.
+ */
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <xcb/xcb.h>
+#include <xcb/xtest.h>
+
+/** Number of windows, one in each corner of the screen */
+#define EXPOSE_DAMAGE_WINDOWS_NB 4
+
+/** Size of the square painted in the damaged window */
+#define EXPOSE_DAMAGE_SQUARE_SIZE 200
+
+/** Keysym enabling expose (XK_F12) */
+#define EXPOSE_DAMAGE_KEYSYM 0xffc9
+
+/** Time given to expose to display the thumbnails (in seconds) */
+#define EXPOSE_DAMAGE_SETTLE_TIME 1.0
+
+/** Colours of the windows and of the damaged square */
+#define EXPOSE_DAMAGE_RED 0xff0000
+#define EXPOSE_DAMAGE_GREEN 0x00ff00
+#define EXPOSE_DAMAGE_BLUE 0x0000ff
+
+/** Windows and their connection */
+typedef struct
+{
+  /** The XCB connection */
+  xcb_connection_t *connection;
+  /** The screen the windows are created on */
+  xcb_screen_t *screen;
+  /** The windows, the last one being damaged */
+  xcb_window_t windows[EXPOSE_DAMAGE_WINDOWS_NB];
+  /** Width and height of the windows */
+  uint16_t width, height;
+  /** Graphical context used to fill the windows */
+  xcb_gcontext_t gc;
+  /** Keycode enabling expose */
+  xcb_keycode_t keycode;
+} _expose_damage_t;
+
+/** Get the current monotonic time
+ *
+ * \return The time in seconds
+ */
+static double
+_expose_damage_now(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+/** Sleep for the given time
+ *
+ * \param seconds The time in seconds
+ */
+static void
+_expose_damage_sleep(const double seconds)
+{
+  const struct timespec duration = {
+    (time_t) seconds, (long) ((seconds - (double) (time_t) seconds) * 1e9)
+  };
+
+  nanosleep(&duration, NULL);
+}
+
+/** Fill a rectangle of a window with the given colour
+ *
+ * \param bench The windows
+ * \param window The window to fill
+ * \param color The colour
+ * \param rectangle The rectangle relative to the window
+ */
+static void
+_expose_damage_fill(_expose_damage_t *bench, const xcb_window_t window,
+                    const uint32_t color, const xcb_rectangle_t *rectangle)
+{
+  xcb_change_gc(bench->connection, bench->gc, XCB_GC_FOREGROUND, &color);
+  xcb_poly_fill_rectangle(bench->connection, window, bench->gc, 1, rectangle);
+  xcb_flush(bench->connection);
+}
+
+/** Get an Atom, interned if it does not exist yet
+ *
+ * \param bench The windows
+ * \param name The Atom name
+ * \return The Atom or XCB_NONE on error
+ */
+static xcb_atom_t
+_expose_damage_get_atom(_expose_damage_t *bench, const char *name)
+{
+  xcb_intern_atom_reply_t *reply =
+    xcb_intern_atom_reply(bench->connection,
+                          xcb_intern_atom(bench->connection, false,
+                                          (uint16_t) strlen(name), name),
+                          NULL);
+
+  if(!reply)
+    return XCB_NONE;
+
+  const xcb_atom_t atom = reply->atom;
+  free(reply);
+  return atom;
+}
+
+/** Set  the  properties  of  the root  window  required  by  expose,
+ *  _NET_SUPPORTED being set last as expose checks its requirements on
+ *  its change
+ *
+ * \param bench The windows
+ * \return true on success
+ */
+static bool
+_expose_damage_set_root_properties(_expose_damage_t *bench)
+{
+  const xcb_atom_t supported = _expose_damage_get_atom(bench, "_NET_SUPPORTED");
+  const xcb_atom_t atoms[] = {
+    _expose_damage_get_atom(bench, "_NET_CLIENT_LIST"),
+    _expose_damage_get_atom(bench, "_NET_ACTIVE_WINDOW")
+  };
+
+  if(supported == XCB_NONE || atoms[0] == XCB_NONE || atoms[1] == XCB_NONE)
+    return false;
+
+  xcb_change_property(bench->connection, XCB_PROP_MODE_REPLACE,
+                      bench->screen->root, atoms[0], XCB_ATOM_WINDOW, 32,
+                      EXPOSE_DAMAGE_WINDOWS_NB, bench->windows);
+
+  xcb_change_property(bench->connection, XCB_PROP_MODE_REPLACE,
+                      bench->screen->root, atoms[1], XCB_ATOM_WINDOW, 32, 1,
+                      &bench->windows[0]);
+
+  xcb_change_property(bench->connection, XCB_PROP_MODE_REPLACE,
+                      bench->screen->root, supported, XCB_ATOM_ATOM, 32, 2,
+                      atoms);
+
+  xcb_flush(bench->connection);
+  return true;
+}
+
+/** Create and map  the windows, one in each corner  of the screen and
+ *  overlapping each other, then fill them in red
+ *
+ * \param bench The windows
+ * \return true on success
+ */
+static bool
+_expose_damage_create_windows(_expose_damage_t *bench)
+{
+  bench->width = (uint16_t) (bench->screen->width_in_pixels * 5 / 8);
+  bench->height = (uint16_t) (bench->screen->height_in_pixels * 5 / 8);
+
+  const uint32_t values[] = {
+    bench->screen->black_pixel, XCB_EVENT_MASK_EXPOSURE
+  };
+
+  for(int window_n = 0; window_n < EXPOSE_DAMAGE_WINDOWS_NB; window_n++)
+    {
+      const int16_t x = (int16_t) (window_n % 2 ?
+                                   bench->screen->width_in_pixels - bench->width : 0);
+
+      const int16_t y = (int16_t) (window_n / 2 ?
+                                   bench->screen->height_in_pixels - bench->height : 0);
+
+      bench->windows[window_n] = xcb_generate_id(bench->connection);
+      xcb_create_window(bench->connection, XCB_COPY_FROM_PARENT,
+                        bench->windows[window_n], bench->screen->root, x, y,
+                        bench->width, bench->height, 0,
+                        XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                        bench->screen->root_visual,
+                        XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK, values);
+
+      xcb_map_window(bench->connection, bench->windows[window_n]);
+    }
+
+  bench->gc = xcb_generate_id(bench->connection);
+  xcb_create_gc(bench->connection, bench->gc, bench->windows[0], 0, NULL);
+
+  /* Wait for all the windows to be viewable before filling them */
+  xcb_flush(bench->connection);
+  int exposed_nb = 0;
+  xcb_generic_event_t *event;
+  while(exposed_nb < EXPOSE_DAMAGE_WINDOWS_NB &&
+        (event = xcb_wait_for_event(bench->connection)))
+    {
+      if((event->response_type & ~0x80) == XCB_EXPOSE &&
+         ((xcb_expose_event_t *) event)->count == 0)
+        exposed_nb++;
+
+      free(event);
+    }
+
+  if(exposed_nb < EXPOSE_DAMAGE_WINDOWS_NB)
+    return false;
+
+  const xcb_rectangle_t rectangle = { 0, 0, bench->width, bench->height };
+  for(int window_n = 0; window_n < EXPOSE_DAMAGE_WINDOWS_NB; window_n++)
+    _expose_damage_fill(bench, bench->windows[window_n], EXPOSE_DAMAGE_RED,
+                        &rectangle);
+
+  return _expose_damage_set_root_properties(bench);
+}
+
+/** Get the keycode of the key enabling expose
+ *
+ * \param bench The windows
+ * \return true if a keycode has been found
+ */
+static bool
+_expose_damage_get_keycode(_expose_damage_t *bench)
+{
+  const xcb_setup_t *setup = xcb_get_setup(bench->connection);
+  const uint8_t keycodes_nb = (uint8_t) (setup->max_keycode - setup->min_keycode + 1);
+
+  xcb_get_keyboard_mapping_reply_t *reply =
+    xcb_get_keyboard_mapping_reply(bench->connection,
+                                   xcb_get_keyboard_mapping(bench->connection,
+                                                            setup->min_keycode,
+                                                            keycodes_nb),
+                                   NULL);
+
+  if(!reply)
+    return false;
+
+  const xcb_keysym_t *keysyms = xcb_get_keyboard_mapping_keysyms(reply);
+  const int keysyms_len = xcb_get_keyboard_mapping_keysyms_length(reply);
+
+  bench->keycode = 0;
+  for(int keysym_n = 0; keysym_n < keysyms_len && reply->keysyms_per_keycode; keysym_n++)
+    if(keysyms[keysym_n] == EXPOSE_DAMAGE_KEYSYM)
+      {
+        bench->keycode = (xcb_keycode_t) (setup->min_keycode +
+                                          keysym_n / reply->keysyms_per_keycode);
+        break;
+      }
+
+  free(reply);
+  return bench->keycode != 0;
+}
+
+/** Press and release the key toggling expose, then leave it time to
+ *  display the thumbnails
+ *
+ * \param bench The windows
+ */
+static void
+_expose_damage_toggle(_expose_damage_t *bench)
+{
+  xcb_test_fake_input(bench->connection, XCB_KEY_PRESS, bench->keycode,
+                      XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+  xcb_test_fake_input(bench->connection, XCB_KEY_RELEASE, bench->keycode,
+                      XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+  xcb_flush(bench->connection);
+
+  _expose_damage_sleep(EXPOSE_DAMAGE_SETTLE_TIME);
+}
+
+/** Count the pixels of the given colour on the root window
+ *
+ * \param bench The windows
+ * \param color The colour
+ * \return The number of pixels, negative on error
+ */
+static long
+_expose_damage_count_pixels(_expose_damage_t *bench, const uint32_t color)
+{
+  xcb_get_image_reply_t *reply =
+    xcb_get_image_reply(bench->connection,
+                        xcb_get_image(bench->connection,
+                                      XCB_IMAGE_FORMAT_Z_PIXMAP,
+                                      bench->screen->root, 0, 0,
+                                      bench->screen->width_in_pixels,
+                                      bench->screen->height_in_pixels,
+                                      UINT32_MAX),
+                        NULL);
+
+  if(!reply)
+    return -1;
+
+  /* Depth 24 stored on 32 bits, only compare the colour bits */
+  const uint32_t *pixels = (const uint32_t *) xcb_get_image_data(reply);
+  const int pixels_len = xcb_get_image_data_length(reply) / (int) sizeof(uint32_t);
+
+  long count = 0;
+  for(int pixel_n = 0; pixel_n < pixels_len; pixel_n++)
+    if(((pixels[pixel_n] ^ color) & 0xffffff) == 0)
+      count++;
+
+  free(reply);
+  return count;
+}
+
+/** Read  the root window until the  given colour shows  up scaled down
+ *  in a thumbnail, thus on less pixels than painted in the window
+ *
+ * \param bench The windows
+ * \param color The colour
+ * \param timeout The time after which the thumbnail is considered stale
+ * \return The number of pixels of the colour on the root window
+ */
+static long
+_expose_damage_wait_thumbnail(_expose_damage_t *bench, const uint32_t color,
+                              const double timeout)
+{
+  const double begin = _expose_damage_now();
+  const long painted = EXPOSE_DAMAGE_SQUARE_SIZE * EXPOSE_DAMAGE_SQUARE_SIZE;
+
+  long count;
+  while((count = _expose_damage_count_pixels(bench, color)) >= 0)
+    {
+      if(count > 0 && count < painted * 9 / 10)
+        break;
+
+      if(_expose_damage_now() - begin > timeout)
+        break;
+
+      _expose_damage_sleep(0.05);
+    }
+
+  return count;
+}
+
+/** Display the command line usage */
+static void
+_expose_damage_display_help(void)
+{
+  printf("Usage: expose_damage [options]\n\
+  -t, --timeout MS      time for the thumbnail to be updated (default: 2000)\n");
+}
+
+int
+main(int argc, char **argv)
+{
+  const struct option long_options[] = {
+    { "timeout", 1, NULL, 't' },
+    { "help", 0, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  double timeout = 2.0;
+
+  int opt;
+  while((opt = getopt_long(argc, argv, "t:h", long_options, NULL)) != -1)
+    switch(opt)
+      {
+      case 't':
+        timeout = strtod(optarg, NULL) / 1e3;
+        break;
+      case 'h':
+        _expose_damage_display_help();
+        return EXIT_SUCCESS;
+      default:
+        _expose_damage_display_help();
+        return EXIT_FAILURE;
+      }
+
+  _expose_damage_t bench;
+  memset(&bench, 0, sizeof(_expose_damage_t));
+
+  int screen_nbr;
+  bench.connection = xcb_connect(NULL, &screen_nbr);
+  if(xcb_connection_has_error(bench.connection))
+    {
+      fprintf(stderr, "Can't open display\n");
+      return EXIT_FAILURE;
+    }
+
+  xcb_screen_iterator_t screen_iter =
+    xcb_setup_roots_iterator(xcb_get_setup(bench.connection));
+
+  for(; screen_iter.rem && screen_nbr; screen_nbr--)
+    xcb_screen_next(&screen_iter);
+
+  bench.screen = screen_iter.data;
+
+  const xcb_query_extension_reply_t *xtest =
+    xcb_get_extension_data(bench.connection, &xcb_test_id);
+
+  if(!xtest || !xtest->present)
+    {
+      fprintf(stderr, "XTest extension not available\n");
+      xcb_disconnect(bench.connection);
+      return EXIT_FAILURE;
+    }
+
+  if(!_expose_damage_get_keycode(&bench))
+    {
+      fprintf(stderr, "No keycode for F12\n");
+      xcb_disconnect(bench.connection);
+      return EXIT_FAILURE;
+    }
+
+  if(!_expose_damage_create_windows(&bench))
+    {
+      fprintf(stderr, "Can't create the windows\n");
+      xcb_disconnect(bench.connection);
+      return EXIT_FAILURE;
+    }
+
+  _expose_damage_sleep(EXPOSE_DAMAGE_SETTLE_TIME);
+  _expose_damage_toggle(&bench);
+
+  /* Damage  the middle of  the window at  the bottom-right corner  while
+     its thumbnail is displayed */
+  const xcb_rectangle_t square = {
+    (int16_t) ((bench.width - EXPOSE_DAMAGE_SQUARE_SIZE) / 2),
+    (int16_t) ((bench.height - EXPOSE_DAMAGE_SQUARE_SIZE) / 2),
+    EXPOSE_DAMAGE_SQUARE_SIZE, EXPOSE_DAMAGE_SQUARE_SIZE
+  };
+
+  _expose_damage_fill(&bench, bench.windows[EXPOSE_DAMAGE_WINDOWS_NB - 1],
+                      EXPOSE_DAMAGE_GREEN, &square);
+
+  const long live_pixels = _expose_damage_wait_thumbnail(&bench,
+                                                         EXPOSE_DAMAGE_GREEN,
+                                                         timeout);
+
+  const long painted = EXPOSE_DAMAGE_SQUARE_SIZE * EXPOSE_DAMAGE_SQUARE_SIZE;
+  const bool live_updated = live_pixels > 0 && live_pixels < painted * 9 / 10;
+
+  _expose_damage_toggle(&bench);
+
+  /* Damage the top-left corner of the same window while expose is
+     disabled, thus only recorded on its cached thumbnail */
+  const xcb_rectangle_t corner = {
+    0, 0, EXPOSE_DAMAGE_SQUARE_SIZE, EXPOSE_DAMAGE_SQUARE_SIZE
+  };
+
+  _expose_damage_fill(&bench, bench.windows[EXPOSE_DAMAGE_WINDOWS_NB - 1],
+                      EXPOSE_DAMAGE_BLUE, &corner);
+
+  _expose_damage_sleep(EXPOSE_DAMAGE_SETTLE_TIME);
+  _expose_damage_toggle(&bench);
+
+  const long cached_pixels = _expose_damage_wait_thumbnail(&bench,
+                                                           EXPOSE_DAMAGE_BLUE,
+                                                           timeout);
+
+  const bool cached_updated = cached_pixels > 0 &&
+    cached_pixels < painted * 9 / 10;
+
+  _expose_damage_toggle(&bench);
+
+  printf("{\"square_pixels\": %ld, \"live_pixels\": %ld, \"live_updated\": %s, "
+         "\"cached_pixels\": %ld, \"cached_updated\": %s}\n",
+         painted, live_pixels, live_updated ? "true" : "false",
+         cached_pixels, cached_updated ? "true" : "false");
+
+  xcb_disconnect(bench.connection);
+
+  return live_updated && cached_updated ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,432 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Input-to-photon latency of the compositor
+ *
+ *  Create a small probe window at the top-left corner of the screen,
+ *  then repeatedly send a synthetic key press with XTest and, as soon
+ *  as  the probe receives it, switch  its colour between black and
+ *  white.  The pixel at the centre of the probe is then read back from
+ *  the  root window, which  holds the contents  painted by  the
+ *  compositor, until the new colour shows up.
+ *
+ *  The time from sending the key press to the colour being visible is
+ *  the input-to-photon latency, reported  as a JSON object with  its
+ *  distribution (in seconds), along with the time for the key press to
+ *  reach the probe.  Run without a compositor, the same measure gives
+ *  the baseline of the X server alone.
+ *
+ *  A 1x1 GetImage is cheaper  than attaching a SHM segment for such a
+ *  small area, and the root  window is polled every 'poll' interval to
+ *  avoid competing with the compositor for the CPU.
+ */
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <xcb/xcb.h>
+#include <xcb/xtest.h>
+
+/** Size of the probe window */
+#define INPUT_LATENCY_PROBE_SIZE 32
+
+/** Time after which a colour change is considered lost (in seconds) */
+#define INPUT_LATENCY_TIMEOUT 1.0
+
+/** Probe window and its connection */
+typedef struct
+{
+  /** The XCB connection */
+  xcb_connection_t *connection;
+  /** The screen the probe is created on */
+  xcb_screen_t *screen;
+  /** The probe window */
+  xcb_window_t window;
+  /** Graphical context used to fill the probe */
+  xcb_gcontext_t gc;
+  /** Keycode sent with XTest */
+  xcb_keycode_t keycode;
+  /** Current colour of the probe */
+  uint32_t color;
+} _input_latency_t;
+
+/** Get the current monotonic time
+ *
+ * \return The time in seconds
+ */
+static double
+_input_latency_now(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+/** Sleep for the given time
+ *
+ * \param seconds The time in seconds
+ */
+static void
+_input_latency_sleep(const double seconds)
+{
+  const struct timespec duration = {
+    (time_t) seconds, (long) ((seconds - (double) (time_t) seconds) * 1e9)
+  };
+
+  nanosleep(&duration, NULL);
+}
+
+/** Fill the probe window with its current colour
+ *
+ * \param probe The probe
+ */
+static void
+_input_latency_fill(_input_latency_t *probe)
+{
+  const xcb_rectangle_t rectangle = {
+    0, 0, INPUT_LATENCY_PROBE_SIZE, INPUT_LATENCY_PROBE_SIZE
+  };
+
+  xcb_change_gc(probe->connection, probe->gc, XCB_GC_FOREGROUND, &probe->color);
+  xcb_poly_fill_rectangle(probe->connection, probe->window, probe->gc, 1,
+                          &rectangle);
+}
+
+/** Create and map the probe window, above all the others, and give it
+ *  the input focus
+ *
+ * \param probe The probe
+ * \return true on success
+ */
+static bool
+_input_latency_create_probe(_input_latency_t *probe)
+{
+  probe->window = xcb_generate_id(probe->connection);
+
+  /* Override-redirect, so no window manager is involved */
+  const uint32_t values[] = {
+    probe->screen->black_pixel, true,
+    XCB_EVENT_MASK_KEY_PRESS | XCB_EVENT_MASK_EXPOSURE
+  };
+
+  xcb_create_window(probe->connection, XCB_COPY_FROM_PARENT, probe->window,
+                    probe->screen->root, 0, 0, INPUT_LATENCY_PROBE_SIZE,
+                    INPUT_LATENCY_PROBE_SIZE, 0,
+                    XCB_WINDOW_CLASS_INPUT_OUTPUT, probe->screen->root_visual,
+                    XCB_CW_BACK_PIXEL | XCB_CW_OVERRIDE_REDIRECT |
+                    XCB_CW_EVENT_MASK, values);
+
+  probe->gc = xcb_generate_id(probe->connection);
+  xcb_create_gc(probe->connection, probe->gc, probe->window, 0, NULL);
+
+  xcb_map_window(probe->connection, probe->window);
+
+  /* Wait for the probe to be viewable before giving it the focus */
+  xcb_flush(probe->connection);
+  xcb_generic_event_t *event;
+  while((event = xcb_wait_for_event(probe->connection)))
+    {
+      const bool is_exposed = (event->response_type & ~0x80) == XCB_EXPOSE;
+      free(event);
+      if(is_exposed)
+        break;
+    }
+
+  if(!event)
+    return false;
+
+  xcb_set_input_focus(probe->connection, XCB_INPUT_FOCUS_POINTER_ROOT,
+                      probe->window, XCB_CURRENT_TIME);
+
+  probe->color = probe->screen->black_pixel;
+  _input_latency_fill(probe);
+
+  probe->keycode = xcb_get_setup(probe->connection)->min_keycode;
+  return true;
+}
+
+/** Read the pixel at the centre of the probe from the root window
+ *
+ * \param probe The probe
+ * \param pixel The pixel value to fill
+ * \return true on success
+ */
+static bool
+_input_latency_get_root_pixel(_input_latency_t *probe, uint32_t *pixel)
+{
+  xcb_get_image_reply_t *reply =
+    xcb_get_image_reply(probe->connection,
+                        xcb_get_image(probe->connection,
+                                      XCB_IMAGE_FORMAT_Z_PIXMAP,
+                                      probe->screen->root,
+                                      INPUT_LATENCY_PROBE_SIZE / 2,
+                                      INPUT_LATENCY_PROBE_SIZE / 2, 1, 1,
+                                      UINT32_MAX),
+                        NULL);
+
+  if(!reply)
+    return false;
+
+  *pixel = 0;
+  const int len = xcb_get_image_data_length(reply);
+  memcpy(pixel, xcb_get_image_data(reply),
+         len < (int) sizeof(uint32_t) ? (size_t) len : sizeof(uint32_t));
+
+  free(reply);
+  return true;
+}
+
+/** Measure the latency of a single key press
+ *
+ * \param probe The probe
+ * \param poll_interval The interval between two reads of the root window
+ * \param input_latency The time for the key press to reach the probe
+ * \return The input-to-photon latency in seconds, negative on timeout
+ */
+static double
+_input_latency_measure(_input_latency_t *probe, const double poll_interval,
+                       double *input_latency)
+{
+  const double begin = _input_latency_now();
+
+  xcb_test_fake_input(probe->connection, XCB_KEY_PRESS, probe->keycode,
+                      XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+  xcb_test_fake_input(probe->connection, XCB_KEY_RELEASE, probe->keycode,
+                      XCB_CURRENT_TIME, XCB_NONE, 0, 0, 0);
+  xcb_flush(probe->connection);
+
+  /* Wait for the key press as the application would */
+  xcb_generic_event_t *event;
+  while((event = xcb_wait_for_event(probe->connection)))
+    {
+      const bool is_key_press = (event->response_type & ~0x80) == XCB_KEY_PRESS;
+      free(event);
+      if(is_key_press)
+        break;
+    }
+
+  if(!event)
+    return -1;
+
+  *input_latency = _input_latency_now() - begin;
+
+  probe->color = probe->color == probe->screen->black_pixel ?
+    probe->screen->white_pixel : probe->screen->black_pixel;
+
+  _input_latency_fill(probe);
+  xcb_flush(probe->connection);
+
+  /* Only compare the colour bits (depth 24 at most) */
+  uint32_t pixel;
+  while(_input_latency_get_root_pixel(probe, &pixel))
+    {
+      const double now = _input_latency_now();
+      if(((pixel ^ probe->color) & 0xffffff) == 0)
+        return now - begin;
+
+      if(now - begin > INPUT_LATENCY_TIMEOUT)
+        break;
+
+      _input_latency_sleep(poll_interval);
+    }
+
+  return -1;
+}
+
+/** Compare latencies
+ *
+ * \param a The first latency
+ * \param b The second latency
+ * \return The comparison result as expected by qsort()
+ */
+static int
+_input_latency_cmp(const void *a, const void *b)
+{
+  const double latency_a = *((const double *) a);
+  const double latency_b = *((const double *) b);
+
+  if(latency_a == latency_b)
+    return 0;
+
+  return latency_a < latency_b ? -1 : 1;
+}
+
+/** Get a percentile of sorted latencies
+ *
+ * \param latencies The sorted latencies
+ * \param latencies_len The number of latencies (at least one)
+ * \param percentile The percentile, from 0 to 100
+ * \return The latency in seconds
+ */
+static double
+_input_latency_get_percentile(const double *latencies,
+                              const unsigned int latencies_len,
+                              const unsigned int percentile)
+{
+  unsigned int index = (latencies_len * percentile + 99) / 100;
+  if(index)
+    index--;
+
+  return latencies[index];
+}
+
+/** Display the command line usage */
+static void
+_input_latency_display_help(void)
+{
+  printf("Usage: input_latency [options]\n\
+  -n, --samples N       number of key presses (default: 200)\n\
+  -i, --interval MS     interval between key presses (default: 50)\n\
+  -p, --poll MS         interval between reads of the screen (default: 0.25)\n");
+}
+
+int
+main(int argc, char **argv)
+{
+  const struct option long_options[] = {
+    { "samples", 1, NULL, 'n' },
+    { "interval", 1, NULL, 'i' },
+    { "poll", 1, NULL, 'p' },
+    { "help", 0, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  unsigned int samples = 200;
+  double interval = 0.05, poll_interval = 0.00025;
+
+  int opt;
+  while((opt = getopt_long(argc, argv, "n:i:p:h", long_options, NULL)) != -1)
+    switch(opt)
+      {
+      case 'n':
+        samples = (unsigned int) strtoul(optarg, NULL, 10);
+        break;
+      case 'i':
+        interval = strtod(optarg, NULL) / 1e3;
+        break;
+      case 'p':
+        poll_interval = strtod(optarg, NULL) / 1e3;
+        break;
+      default:
+        _input_latency_display_help();
+        return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+      }
+
+  if(!samples || interval < 0 || poll_interval < 0)
+    {
+      _input_latency_display_help();
+      return EXIT_FAILURE;
+    }
+
+  _input_latency_t probe;
+  memset(&probe, 0, sizeof(_input_latency_t));
+
+  int screen_nbr;
+  probe.connection = xcb_connect(NULL, &screen_nbr);
+  if(xcb_connection_has_error(probe.connection))
+    {
+      fprintf(stderr, "Cannot open display\n");
+      return EXIT_FAILURE;
+    }
+
+  xcb_screen_iterator_t screen_iter = xcb_setup_roots_iterator(xcb_get_setup(probe.connection));
+  for(; screen_nbr; screen_nbr--)
+    xcb_screen_next(&screen_iter);
+
+  probe.screen = screen_iter.data;
+
+  const xcb_query_extension_reply_t *xtest =
+    xcb_get_extension_data(probe.connection, &xcb_test_id);
+
+  if(!xtest || !xtest->present)
+    {
+      fprintf(stderr, "No XTest extension\n");
+      xcb_disconnect(probe.connection);
+      return EXIT_FAILURE;
+    }
+
+  if(!_input_latency_create_probe(&probe))
+    {
+      fprintf(stderr, "Cannot create the probe window\n");
+      xcb_disconnect(probe.connection);
+      return EXIT_FAILURE;
+    }
+
+  /* Leave time to the compositor to paint the probe */
+  _input_latency_sleep(0.5);
+
+  double *latencies = malloc(samples * sizeof(double));
+  double *input_latencies = malloc(samples * sizeof(double));
+  unsigned int latencies_len = 0, timeouts = 0;
+  double latency_sum = 0;
+
+  /* Pseudo-random intervals, so the key presses are not synchronised
+     with the compositor repaint timer */
+  srand(0);
+
+  for(unsigned int sample = 0; sample < samples; sample++)
+    {
+      double input_latency = 0;
+      const double latency = _input_latency_measure(&probe, poll_interval,
+                                                    &input_latency);
+      if(latency < 0)
+        timeouts++;
+      else
+        {
+          input_latencies[latencies_len] = input_latency;
+          latencies[latencies_len++] = latency;
+          latency_sum += latency;
+        }
+
+      _input_latency_sleep(interval * (0.5 + (double) rand() / RAND_MAX));
+    }
+
+  printf("{\"samples\": %u, \"timeouts\": %u", latencies_len, timeouts);
+
+  if(latencies_len)
+    {
+      qsort(latencies, latencies_len, sizeof(double), _input_latency_cmp);
+      qsort(input_latencies, latencies_len, sizeof(double), _input_latency_cmp);
+
+      printf(", \"latency_mean\": %.6f, \"latency_p50\": %.6f, "
+             "\"latency_p90\": %.6f, \"latency_p99\": %.6f, "
+             "\"latency_max\": %.6f, \"input_p50\": %.6f, \"input_p99\": %.6f",
+             latency_sum / latencies_len,
+             _input_latency_get_percentile(latencies, latencies_len, 50),
+             _input_latency_get_percentile(latencies, latencies_len, 90),
+             _input_latency_get_percentile(latencies, latencies_len, 99),
+             latencies[latencies_len - 1],
+             _input_latency_get_percentile(input_latencies, latencies_len, 50),
+             _input_latency_get_percentile(input_latencies, latencies_len, 99));
+    }
+
+  printf("}\n");
+
+  free(input_latencies);
+  free(latencies);
+  xcb_disconnect(probe.connection);
+
+  return latencies_len ? EXIT_SUCCESS : EXIT_FAILURE;
+}
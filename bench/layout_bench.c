@@ -0,0 +1,205 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Benchmark of the expose plugin slots layout
+ *
+ *  Lay out  randomly placed windows  on a 1920x1080 screen  for an
+ *  increasing number of clients, with the spatial sort used by the
+ *  plugin  ('expose_layout.c') and  with the former  nearest window
+ *  search,  quadratic  in  the number  of windows, reporting  the time
+ *  of each in microseconds.  Both lay out all the windows in a single
+ *  page, as the plugin does not display more than a page at once.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "expose_layout.h"
+
+/** Minimum time in seconds spent on each measurement */
+#define LAYOUT_BENCH_MIN_TIME 0.2
+
+#define LAYOUT_BENCH_SCREEN_WIDTH 1920
+#define LAYOUT_BENCH_SCREEN_HEIGHT 1080
+#define LAYOUT_BENCH_SPACING 10
+#define LAYOUT_BENCH_SLOT_MIN_SIZE 96
+
+static const uint32_t _layout_bench_nwindows[] = {
+  10, 50, 100, 300, 1000, 3000
+};
+
+/** Get the current monotonic time
+ *
+ * \return The time in seconds
+ */
+static double
+_layout_bench_now(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+/** Lay out the windows with the spatial sort of the plugin
+ *
+ * \param nwindows The number of windows
+ * \param windows The windows geometry
+ * \param slots The slots to fill
+ * \param assignment The window index of each slot to fill
+ */
+static void
+_layout_bench_sort(const uint32_t nwindows,
+                   const expose_layout_rectangle_t *windows,
+                   expose_layout_rectangle_t *slots,
+                   uint32_t *assignment)
+{
+  const uint32_t nslots_per_strip =
+    expose_layout_create_slots(nwindows, LAYOUT_BENCH_SCREEN_WIDTH,
+                               LAYOUT_BENCH_SCREEN_HEIGHT,
+                               LAYOUT_BENCH_SPACING, slots);
+
+  expose_layout_assign(nwindows, nslots_per_strip, LAYOUT_BENCH_SPACING,
+                       windows, slots, assignment);
+}
+
+/** Lay out  the windows by  assigning to each  slot the nearest window
+ *  not assigned yet, as the plugin formerly did
+ *
+ * \param nwindows The number of windows
+ * \param windows The windows geometry
+ * \param slots The slots to fill
+ * \param assignment The window index of each slot to fill
+ */
+static void
+_layout_bench_nearest(const uint32_t nwindows,
+                      const expose_layout_rectangle_t *windows,
+                      expose_layout_rectangle_t *slots,
+                      uint32_t *assignment)
+{
+  expose_layout_create_slots(nwindows, LAYOUT_BENCH_SCREEN_WIDTH,
+                             LAYOUT_BENCH_SCREEN_HEIGHT,
+                             LAYOUT_BENCH_SPACING, slots);
+
+  char *is_assigned = calloc(nwindows, 1);
+
+  for(uint32_t slot_n = 0; slot_n < nwindows; slot_n++)
+    {
+      const int32_t slot_x = slots[slot_n].x + slots[slot_n].width / 2;
+      const int32_t slot_y = slots[slot_n].y + slots[slot_n].height / 2;
+
+      double nearest_distance = INFINITY;
+
+      for(uint32_t window_n = 0; window_n < nwindows; window_n++)
+        {
+          if(is_assigned[window_n])
+            continue;
+
+          const int32_t x = windows[window_n].x + windows[window_n].width / 2 - slot_x;
+          const int32_t y = windows[window_n].y + windows[window_n].height / 2 - slot_y;
+          const double distance = sqrt((double) (x * x + y * y));
+
+          if(distance < nearest_distance)
+            {
+              assignment[slot_n] = window_n;
+              nearest_distance = distance;
+            }
+        }
+
+      is_assigned[assignment[slot_n]] = 1;
+    }
+
+  free(is_assigned);
+}
+
+/** Measure the time taken by a layout function
+ *
+ * \param layout The layout function
+ * \param nwindows The number of windows
+ * \param windows The windows geometry
+ * \return The time of a layout in microseconds
+ */
+static double
+_layout_bench_measure(void (*layout)(const uint32_t,
+                                     const expose_layout_rectangle_t *,
+                                     expose_layout_rectangle_t *,
+                                     uint32_t *),
+                      const uint32_t nwindows,
+                      const expose_layout_rectangle_t *windows)
+{
+  expose_layout_rectangle_t *slots = malloc(nwindows * sizeof(expose_layout_rectangle_t));
+  uint32_t *assignment = malloc(nwindows * sizeof(uint32_t));
+
+  unsigned int iterations = 0;
+  const double begin = _layout_bench_now();
+  double elapsed;
+
+  do
+    {
+      (*layout)(nwindows, windows, slots, assignment);
+      iterations++;
+    }
+  while((elapsed = _layout_bench_now() - begin) < LAYOUT_BENCH_MIN_TIME);
+
+  free(assignment);
+  free(slots);
+
+  return elapsed * 1e6 / iterations;
+}
+
+int
+main(void)
+{
+  srand(0);
+
+  printf("%-10s %10s %14s %16s\n", "windows", "page size", "sort (us)",
+         "nearest (us)");
+
+  for(size_t nwindows_n = 0;
+      nwindows_n < sizeof(_layout_bench_nwindows) / sizeof(_layout_bench_nwindows[0]);
+      nwindows_n++)
+    {
+      const uint32_t nwindows = _layout_bench_nwindows[nwindows_n];
+
+      expose_layout_rectangle_t *windows = malloc(nwindows * sizeof(expose_layout_rectangle_t));
+      for(uint32_t window_n = 0; window_n < nwindows; window_n++)
+        {
+          windows[window_n].width = (uint16_t) (200 + rand() % 1200);
+          windows[window_n].height = (uint16_t) (150 + rand() % 800);
+          windows[window_n].x = (int16_t) (rand() % (LAYOUT_BENCH_SCREEN_WIDTH -
+                                                     windows[window_n].width / 2));
+          windows[window_n].y = (int16_t) (rand() % (LAYOUT_BENCH_SCREEN_HEIGHT -
+                                                     windows[window_n].height / 2));
+        }
+
+      printf("%-10u %10u %14.1f %16.1f\n", nwindows,
+             expose_layout_get_page_size(nwindows, LAYOUT_BENCH_SCREEN_WIDTH,
+                                         LAYOUT_BENCH_SCREEN_HEIGHT,
+                                         LAYOUT_BENCH_SPACING,
+                                         LAYOUT_BENCH_SLOT_MIN_SIZE),
+             _layout_bench_measure(_layout_bench_sort, nwindows, windows),
+             _layout_bench_measure(_layout_bench_nearest, nwindows, windows));
+
+      free(windows);
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,389 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Load generator of the compositor benchmark
+ *
+ *  Create  windows tiled  on the  screen  and  update them  at a fixed
+ *  rate according  to a  scenario  reproducing a  common  damage
+ *  pattern, until the given duration has elapsed:
+ *
+ *   - typing: a small rectangle is drawn in each window as a character
+ *     would be typed.
+ *   - video: each window is entirely redrawn.
+ *   - drag: a single window is moved, another one every 60 updates.
+ *   - resize: all the windows are resized.
+ *   - opacity: the opacity of all the windows is changed.
+ *
+ *  A round-trip is performed at each update, so the X server is not
+ *  flooded if it cannot keep up with the rate.
+ */
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <xcb/xcb.h>
+
+/** Width of a character drawn by the typing scenario */
+#define LOAD_CHAR_WIDTH 8
+/** Height of a character drawn by the typing scenario */
+#define LOAD_CHAR_HEIGHT 16
+
+/** Windows created by the load generator */
+typedef struct
+{
+  /** The XCB connection */
+  xcb_connection_t *connection;
+  /** The screen the windows are created on */
+  xcb_screen_t *screen;
+  /** _NET_WM_WINDOW_OPACITY atom */
+  xcb_atom_t opacity_atom;
+  /** Graphical context used to draw in the windows */
+  xcb_gcontext_t gc;
+  /** Windows identifiers */
+  xcb_window_t *windows;
+  /** Windows geometry when created */
+  xcb_rectangle_t *geometries;
+  /** Number of windows */
+  unsigned int windows_len;
+} _load_t;
+
+/** Scenario updating the windows at each tick */
+typedef struct
+{
+  /** Name given on the command line */
+  const char *name;
+  /** Update the windows for the given tick */
+  void (*update)(_load_t *, const unsigned int);
+} _load_scenario_t;
+
+/** Set the foreground color of the graphical context
+ *
+ * \param load The windows
+ * \param color The color
+ */
+static void
+_load_set_color(_load_t *load, const uint32_t color)
+{
+  xcb_change_gc(load->connection, load->gc, XCB_GC_FOREGROUND, &color);
+}
+
+/** Draw a character-sized rectangle in each window, from left to right
+ *  and top to bottom
+ *
+ * \param load The windows
+ * \param tick The current tick
+ */
+static void
+_load_update_typing(_load_t *load, const unsigned int tick)
+{
+  _load_set_color(load, tick & 1 ? 0x000000 : 0xffffff);
+
+  for(unsigned int window_n = 0; window_n < load->windows_len; window_n++)
+    {
+      const unsigned int columns = load->geometries[window_n].width / LOAD_CHAR_WIDTH;
+      const unsigned int rows = load->geometries[window_n].height / LOAD_CHAR_HEIGHT;
+      if(!columns || !rows)
+        continue;
+
+      const unsigned int char_n = (tick / 2) % (columns * rows);
+      const xcb_rectangle_t rectangle = {
+        (int16_t) ((char_n % columns) * LOAD_CHAR_WIDTH),
+        (int16_t) ((char_n / columns) * LOAD_CHAR_HEIGHT),
+        LOAD_CHAR_WIDTH, LOAD_CHAR_HEIGHT
+      };
+
+      xcb_poly_fill_rectangle(load->connection, load->windows[window_n],
+                              load->gc, 1, &rectangle);
+    }
+}
+
+/** Redraw each window entirely, as a video player would
+ *
+ * \param load The windows
+ * \param tick The current tick
+ */
+static void
+_load_update_video(_load_t *load, const unsigned int tick)
+{
+  _load_set_color(load, (tick * 0x050301) & 0xffffff);
+
+  for(unsigned int window_n = 0; window_n < load->windows_len; window_n++)
+    {
+      const xcb_rectangle_t rectangle = {
+        0, 0, load->geometries[window_n].width, load->geometries[window_n].height
+      };
+
+      xcb_poly_fill_rectangle(load->connection, load->windows[window_n],
+                              load->gc, 1, &rectangle);
+    }
+}
+
+/** Move a single window away from its initial position, another window
+ *  being moved every 60 ticks
+ *
+ * \param load The windows
+ * \param tick The current tick
+ */
+static void
+_load_update_drag(_load_t *load, const unsigned int tick)
+{
+  const unsigned int window_n = (tick / 60) % load->windows_len;
+  const int32_t offset = (int32_t) (tick % 60) * 4;
+
+  const uint32_t values[] = {
+    (uint32_t) (load->geometries[window_n].x + offset),
+    (uint32_t) (load->geometries[window_n].y + offset / 2)
+  };
+
+  xcb_configure_window(load->connection, load->windows[window_n],
+                       XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, values);
+}
+
+/** Resize all the windows between half and their whole initial size
+ *
+ * \param load The windows
+ * \param tick The current tick
+ */
+static void
+_load_update_resize(_load_t *load, const unsigned int tick)
+{
+  const unsigned int step = tick % 32;
+  const unsigned int percent = 50 + (step < 16 ? step : 32 - step) * 50 / 16;
+
+  for(unsigned int window_n = 0; window_n < load->windows_len; window_n++)
+    {
+      const uint32_t values[] = {
+        load->geometries[window_n].width * percent / 100,
+        load->geometries[window_n].height * percent / 100
+      };
+
+      xcb_configure_window(load->connection, load->windows[window_n],
+                           XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT,
+                           values);
+    }
+}
+
+/** Change the opacity of all the windows, fading them in and out
+ *
+ * \param load The windows
+ * \param tick The current tick
+ */
+static void
+_load_update_opacity(_load_t *load, const unsigned int tick)
+{
+  const unsigned int step = tick % 64;
+  const uint32_t opacity = (uint32_t)
+    (0xffffffffULL * (32 + (step < 32 ? step : 64 - step)) / 64);
+
+  for(unsigned int window_n = 0; window_n < load->windows_len; window_n++)
+    xcb_change_property(load->connection, XCB_PROP_MODE_REPLACE,
+                        load->windows[window_n], load->opacity_atom,
+                        XCB_ATOM_CARDINAL, 32, 1, &opacity);
+}
+
+static const _load_scenario_t _load_scenarios[] = {
+  { "typing", _load_update_typing },
+  { "video", _load_update_video },
+  { "drag", _load_update_drag },
+  { "resize", _load_update_resize },
+  { "opacity", _load_update_opacity },
+  { NULL, NULL }
+};
+
+/** Create the windows tiled on the screen and map them
+ *
+ * \param load The windows to fill
+ * \param windows_len The number of windows
+ */
+static void
+_load_create_windows(_load_t *load, const unsigned int windows_len)
+{
+  xcb_intern_atom_cookie_t opacity_cookie =
+    xcb_intern_atom(load->connection, false, sizeof("_NET_WM_WINDOW_OPACITY") - 1,
+                    "_NET_WM_WINDOW_OPACITY");
+
+  load->windows_len = windows_len;
+  load->windows = calloc(windows_len, sizeof(xcb_window_t));
+  load->geometries = calloc(windows_len, sizeof(xcb_rectangle_t));
+
+  /* Tile the windows in a grid filling the screen */
+  unsigned int columns = 1;
+  while(columns * columns < windows_len)
+    columns++;
+
+  const unsigned int rows = (windows_len + columns - 1) / columns;
+  const uint16_t width = (uint16_t) (load->screen->width_in_pixels / columns);
+  const uint16_t height = (uint16_t) (load->screen->height_in_pixels / rows);
+
+  const uint32_t values[] = { load->screen->white_pixel };
+
+  for(unsigned int window_n = 0; window_n < windows_len; window_n++)
+    {
+      xcb_rectangle_t *geometry = &load->geometries[window_n];
+      geometry->x = (int16_t) ((window_n % columns) * width);
+      geometry->y = (int16_t) ((window_n / columns) * height);
+      geometry->width = width;
+      geometry->height = height;
+
+      load->windows[window_n] = xcb_generate_id(load->connection);
+      xcb_create_window(load->connection, XCB_COPY_FROM_PARENT,
+                        load->windows[window_n], load->screen->root,
+                        geometry->x, geometry->y, geometry->width,
+                        geometry->height, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                        load->screen->root_visual, XCB_CW_BACK_PIXEL, values);
+
+      xcb_map_window(load->connection, load->windows[window_n]);
+    }
+
+  load->gc = xcb_generate_id(load->connection);
+  xcb_create_gc(load->connection, load->gc, load->windows[0], 0, NULL);
+
+  xcb_intern_atom_reply_t *opacity_reply =
+    xcb_intern_atom_reply(load->connection, opacity_cookie, NULL);
+
+  if(opacity_reply)
+    {
+      load->opacity_atom = opacity_reply->atom;
+      free(opacity_reply);
+    }
+}
+
+/** Display help information */
+static void
+_load_display_help(void)
+{
+  printf("Usage: load_client [options]\n\
+  -s, --scenario NAME   typing, video, drag, resize or opacity (default: typing)\n\
+  -n, --windows N       number of windows (default: 16)\n\
+  -d, --duration SECS   duration of the updates (default: 10)\n\
+  -r, --rate HZ         updates per second (default: 60)\n");
+}
+
+int
+main(int argc, char **argv)
+{
+  const struct option long_options[] = {
+    { "scenario", 1, NULL, 's' },
+    { "windows", 1, NULL, 'n' },
+    { "duration", 1, NULL, 'd' },
+    { "rate", 1, NULL, 'r' },
+    { "help", 0, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  const _load_scenario_t *scenario = _load_scenarios;
+  unsigned int windows_len = 16;
+  double duration = 10, rate = 60;
+
+  int opt;
+  while((opt = getopt_long(argc, argv, "s:n:d:r:h", long_options, NULL)) != -1)
+    switch(opt)
+      {
+      case 's':
+        for(scenario = _load_scenarios; scenario->name; scenario++)
+          if(!strcmp(scenario->name, optarg))
+            break;
+
+        if(!scenario->name)
+          {
+            _load_display_help();
+            return EXIT_FAILURE;
+          }
+        break;
+      case 'n':
+        windows_len = (unsigned int) strtoul(optarg, NULL, 10);
+        break;
+      case 'd':
+        duration = strtod(optarg, NULL);
+        break;
+      case 'r':
+        rate = strtod(optarg, NULL);
+        break;
+      default:
+        _load_display_help();
+        return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+      }
+
+  if(!windows_len || rate <= 0)
+    {
+      _load_display_help();
+      return EXIT_FAILURE;
+    }
+
+  _load_t load;
+  memset(&load, 0, sizeof(_load_t));
+
+  int screen_nbr;
+  load.connection = xcb_connect(NULL, &screen_nbr);
+  if(xcb_connection_has_error(load.connection))
+    {
+      fprintf(stderr, "Cannot open display\n");
+      return EXIT_FAILURE;
+    }
+
+  xcb_screen_iterator_t screen_iter = xcb_setup_roots_iterator(xcb_get_setup(load.connection));
+  for(; screen_nbr; screen_nbr--)
+    xcb_screen_next(&screen_iter);
+
+  load.screen = screen_iter.data;
+
+  _load_create_windows(&load, windows_len);
+
+  const unsigned int ticks = (unsigned int) (duration * rate);
+  struct timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+
+  for(unsigned int tick = 0; tick < ticks; tick++)
+    {
+      (*scenario->update)(&load, tick);
+
+      /* Wait for the X server to process the requests */
+      free(xcb_get_input_focus_reply(load.connection,
+                                     xcb_get_input_focus(load.connection),
+                                     NULL));
+
+      if(xcb_connection_has_error(load.connection))
+        {
+          fprintf(stderr, "X connection error\n");
+          return EXIT_FAILURE;
+        }
+
+      /* Sleep until the next tick, which is run at once if late */
+      next.tv_nsec += (long) (1e9 / rate);
+      while(next.tv_nsec >= 1000000000L)
+        {
+          next.tv_nsec -= 1000000000L;
+          next.tv_sec++;
+        }
+
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+  free(load.geometries);
+  free(load.windows);
+  xcb_disconnect(load.connection);
+
+  return EXIT_SUCCESS;
+}
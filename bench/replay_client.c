@@ -0,0 +1,505 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Replay of an events stream recorded by unagi
+ *
+ *  Reproduce  on the X  server (e.g. Xvfb) the  windows tree and the
+ *  events recorded by 'unagi --record'  ('src/record.c'),  at their
+ *  original pace or as fast as possible,  so unagi  (with any rendering
+ *  backend, including  the  null one) processes the same  events mix
+ *  as in the recorded session.
+ *
+ *  The core sends requests on the windows it receives events for, thus
+ *  the events are not injected in unagi but generated again by the X
+ *  server  from the  requests performed  by this  client: windows are
+ *  created,  configured,  mapped,  unmapped and destroyed as recorded
+ *  and the area of each DamageNotify is drawn.  The recorded windows
+ *  identifiers are mapped to the windows created.
+ *
+ *  Other events (e.g.  PropertyNotify, whose  value is not recorded, or
+ *  input events) are skipped.  A JSON object is written on exit with
+ *  the number of events replayed and skipped, and the replay duration.
+ */
+
+#include <getopt.h>
+#include <search.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <xcb/xcb.h>
+#include <xcb/damage.h>
+
+#include "record.h"
+
+/** Number of requests sent as fast as possible before a round-trip, so
+ *  the X server is not flooded */
+#define REPLAY_MAX_SPEED_BATCH 256
+
+/** Recorded window identifier and the window created for it */
+typedef struct
+{
+  uint32_t recorded_id;
+  xcb_window_t id;
+} _replay_window_t;
+
+/** Replay state */
+typedef struct
+{
+  /** The XCB connection */
+  xcb_connection_t *connection;
+  /** The screen the windows are created on */
+  xcb_screen_t *screen;
+  /** Graphical context used to draw the damaged areas */
+  xcb_gcontext_t gc;
+  /** Header of the record file */
+  record_header_t header;
+  /** Windows created, searched by recorded identifier */
+  void *windows;
+  /** Number of events replayed */
+  uint64_t events_replayed;
+  /** Number of events skipped */
+  uint64_t events_skipped;
+} _replay_t;
+
+/** Compare windows by recorded identifier
+ *
+ * \param a The first window
+ * \param b The second window
+ * \return The comparison result as expected by tsearch()
+ */
+static int
+_replay_cmp_window(const void *a, const void *b)
+{
+  const uint32_t id_a = ((const _replay_window_t *) a)->recorded_id;
+  const uint32_t id_b = ((const _replay_window_t *) b)->recorded_id;
+
+  if(id_a == id_b)
+    return 0;
+
+  return id_a < id_b ? -1 : 1;
+}
+
+/** Get the window created for a recorded window
+ *
+ * \param replay The replay state
+ * \param recorded_id The recorded window identifier
+ * \return The window created or XCB_NONE if unknown
+ */
+static xcb_window_t
+_replay_get_window(_replay_t *replay, const uint32_t recorded_id)
+{
+  const _replay_window_t key = { recorded_id, XCB_NONE };
+  _replay_window_t **window = tfind(&key, &replay->windows, _replay_cmp_window);
+
+  return window ? (*window)->id : XCB_NONE;
+}
+
+/** Create a window for a recorded one, unmapped
+ *
+ * \param replay The replay state
+ * \param recorded_id The recorded window identifier
+ * \param x The window x coordinate
+ * \param y The window y coordinate
+ * \param width The window width
+ * \param height The window height
+ * \param border_width The window border width
+ * \param override_redirect The window override-redirect attribute
+ */
+static void
+_replay_create_window(_replay_t *replay, const uint32_t recorded_id,
+                      const int16_t x, const int16_t y,
+                      const uint16_t width, const uint16_t height,
+                      const uint16_t border_width,
+                      const uint8_t override_redirect)
+{
+  if(_replay_get_window(replay, recorded_id) != XCB_NONE)
+    return;
+
+  _replay_window_t *window = malloc(sizeof(_replay_window_t));
+  window->recorded_id = recorded_id;
+  window->id = xcb_generate_id(replay->connection);
+
+  const uint32_t values[] = { replay->screen->white_pixel, override_redirect };
+
+  xcb_create_window(replay->connection, XCB_COPY_FROM_PARENT, window->id,
+                    replay->screen->root, x, y, width ? width : 1,
+                    height ? height : 1, border_width,
+                    XCB_WINDOW_CLASS_INPUT_OUTPUT, replay->screen->root_visual,
+                    XCB_CW_BACK_PIXEL | XCB_CW_OVERRIDE_REDIRECT, values);
+
+  tsearch(window, &replay->windows, _replay_cmp_window);
+}
+
+/** Destroy the window created for a recorded one
+ *
+ * \param replay The replay state
+ * \param recorded_id The recorded window identifier
+ */
+static void
+_replay_destroy_window(_replay_t *replay, const uint32_t recorded_id)
+{
+  const _replay_window_t key = { recorded_id, XCB_NONE };
+  _replay_window_t **window = tfind(&key, &replay->windows, _replay_cmp_window);
+  if(!window)
+    return;
+
+  _replay_window_t *replay_window = *window;
+  xcb_destroy_window(replay->connection, replay_window->id);
+
+  tdelete(&key, &replay->windows, _replay_cmp_window);
+  free(replay_window);
+}
+
+/** Restack a window  above the given sibling,  or at the bottom of the
+ *  stack if there is none
+ *
+ * \param replay The replay state
+ * \param window The window to restack
+ * \param recorded_sibling The recorded sibling identifier
+ */
+static void
+_replay_restack_window(_replay_t *replay, const xcb_window_t window,
+                       const uint32_t recorded_sibling)
+{
+  const xcb_window_t sibling = _replay_get_window(replay, recorded_sibling);
+
+  if(sibling != XCB_NONE)
+    {
+      const uint32_t values[] = { sibling, XCB_STACK_MODE_ABOVE };
+      xcb_configure_window(replay->connection, window,
+                           XCB_CONFIG_WINDOW_SIBLING | XCB_CONFIG_WINDOW_STACK_MODE,
+                           values);
+    }
+  else
+    {
+      const uint32_t values[] = { XCB_STACK_MODE_BELOW };
+      xcb_configure_window(replay->connection, window,
+                           XCB_CONFIG_WINDOW_STACK_MODE, values);
+    }
+}
+
+/** Perform the requests generating the given recorded event
+ *
+ * \param replay The replay state
+ * \param event The recorded event
+ * \return false if the event has been skipped
+ */
+static bool
+_replay_event(_replay_t *replay, const xcb_generic_event_t *event)
+{
+  const uint8_t response_type = event->response_type & 0x7f;
+
+  if(response_type == replay->header.damage_first_event + XCB_DAMAGE_NOTIFY)
+    {
+      const xcb_damage_notify_event_t *damage_event = (const void *) event;
+      const xcb_window_t window = _replay_get_window(replay, damage_event->drawable);
+      if(window == XCB_NONE)
+        return false;
+
+      /* Change the color each time so the contents actually change */
+      const uint32_t color = (uint32_t) (replay->events_replayed * 0x050301) & 0xffffff;
+      xcb_change_gc(replay->connection, replay->gc, XCB_GC_FOREGROUND, &color);
+
+      xcb_poly_fill_rectangle(replay->connection, window, replay->gc, 1,
+                              &damage_event->area);
+      return true;
+    }
+
+  switch(response_type)
+    {
+    case XCB_CREATE_NOTIFY:
+      {
+        const xcb_create_notify_event_t *create_event = (const void *) event;
+        if(create_event->parent != replay->header.root)
+          return false;
+
+        _replay_create_window(replay, create_event->window, create_event->x,
+                              create_event->y, create_event->width,
+                              create_event->height, create_event->border_width,
+                              create_event->override_redirect);
+      }
+      return true;
+
+    case XCB_DESTROY_NOTIFY:
+      _replay_destroy_window(replay, ((const xcb_destroy_notify_event_t *) event)->window);
+      return true;
+
+    case XCB_REPARENT_NOTIFY:
+      {
+        const xcb_reparent_notify_event_t *reparent_event = (const void *) event;
+
+        /* The window  leaves or  joins the root window  children, its
+           size being given by the next ConfigureNotify */
+        if(reparent_event->parent != replay->header.root)
+          _replay_destroy_window(replay, reparent_event->window);
+        else
+          _replay_create_window(replay, reparent_event->window,
+                                reparent_event->x, reparent_event->y, 1, 1, 0,
+                                reparent_event->override_redirect);
+      }
+      return true;
+
+    case XCB_MAP_NOTIFY:
+    case XCB_UNMAP_NOTIFY:
+      {
+        /* Both events have the window at the same offset */
+        const xcb_map_notify_event_t *map_event = (const void *) event;
+        const xcb_window_t window = _replay_get_window(replay, map_event->window);
+        if(window == XCB_NONE)
+          return false;
+
+        if(response_type == XCB_MAP_NOTIFY)
+          xcb_map_window(replay->connection, window);
+        else
+          xcb_unmap_window(replay->connection, window);
+      }
+      return true;
+
+    case XCB_CONFIGURE_NOTIFY:
+      {
+        const xcb_configure_notify_event_t *configure_event = (const void *) event;
+        const xcb_window_t window = _replay_get_window(replay, configure_event->window);
+        if(window == XCB_NONE)
+          return false;
+
+        const uint32_t values[] = {
+          (uint32_t) configure_event->x, (uint32_t) configure_event->y,
+          configure_event->width ? configure_event->width : 1,
+          configure_event->height ? configure_event->height : 1,
+          configure_event->border_width
+        };
+
+        xcb_configure_window(replay->connection, window,
+                             XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y |
+                             XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT |
+                             XCB_CONFIG_WINDOW_BORDER_WIDTH, values);
+
+        _replay_restack_window(replay, window, configure_event->above_sibling);
+      }
+      return true;
+
+    case XCB_CIRCULATE_NOTIFY:
+      {
+        const xcb_circulate_notify_event_t *circulate_event = (const void *) event;
+        const xcb_window_t window = _replay_get_window(replay, circulate_event->window);
+        if(window == XCB_NONE)
+          return false;
+
+        const uint32_t values[] = {
+          circulate_event->place == XCB_PLACE_ON_TOP ?
+          XCB_STACK_MODE_ABOVE : XCB_STACK_MODE_BELOW
+        };
+
+        xcb_configure_window(replay->connection, window,
+                             XCB_CONFIG_WINDOW_STACK_MODE, values);
+      }
+      return true;
+    }
+
+  return false;
+}
+
+/** Create the initial windows tree, from the bottom to the top of the
+ *  stack
+ *
+ * \param replay The replay state
+ * \param fp The record file, after the header
+ * \return false on error
+ */
+static bool
+_replay_create_tree(_replay_t *replay, FILE *fp)
+{
+  for(uint32_t window_n = 0; window_n < replay->header.windows_len; window_n++)
+    {
+      record_window_t record_window;
+      if(fread(&record_window, sizeof(record_window_t), 1, fp) != 1)
+        return false;
+
+      _replay_create_window(replay, record_window.id, record_window.x,
+                            record_window.y, record_window.width,
+                            record_window.height, record_window.border_width,
+                            record_window.override_redirect);
+
+      if(record_window.map_state == XCB_MAP_STATE_VIEWABLE)
+        xcb_map_window(replay->connection,
+                       _replay_get_window(replay, record_window.id));
+    }
+
+  return true;
+}
+
+/** Wait for the X server to process the requests sent so far
+ *
+ * \param replay The replay state
+ */
+static void
+_replay_sync(_replay_t *replay)
+{
+  free(xcb_get_input_focus_reply(replay->connection,
+                                 xcb_get_input_focus(replay->connection),
+                                 NULL));
+}
+
+/** Get the current monotonic time
+ *
+ * \return The time in seconds
+ */
+static double
+_replay_now(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+/** Display help information */
+static void
+_replay_display_help(void)
+{
+  printf("Usage: replay_client [options] FILE\n\
+  -m, --max-speed       replay the events as fast as possible\n\
+  -h, --help            show help\n");
+}
+
+int
+main(int argc, char **argv)
+{
+  const struct option long_options[] = {
+    { "max-speed", 0, NULL, 'm' },
+    { "help", 0, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  bool is_max_speed = false;
+
+  int opt;
+  while((opt = getopt_long(argc, argv, "mh", long_options, NULL)) != -1)
+    switch(opt)
+      {
+      case 'm':
+        is_max_speed = true;
+        break;
+      default:
+        _replay_display_help();
+        return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+      }
+
+  if(optind != argc - 1)
+    {
+      _replay_display_help();
+      return EXIT_FAILURE;
+    }
+
+  FILE *fp = fopen(argv[optind], "rb");
+  if(!fp)
+    {
+      fprintf(stderr, "Can't open %s\n", argv[optind]);
+      return EXIT_FAILURE;
+    }
+
+  _replay_t replay;
+  memset(&replay, 0, sizeof(_replay_t));
+
+  if(fread(&replay.header, sizeof(record_header_t), 1, fp) != 1 ||
+     memcmp(replay.header.magic, RECORD_MAGIC, sizeof(replay.header.magic)) ||
+     replay.header.version != RECORD_VERSION)
+    {
+      fprintf(stderr, "Invalid record file %s\n", argv[optind]);
+      return EXIT_FAILURE;
+    }
+
+  int screen_nbr;
+  replay.connection = xcb_connect(NULL, &screen_nbr);
+  if(xcb_connection_has_error(replay.connection))
+    {
+      fprintf(stderr, "Cannot open display\n");
+      return EXIT_FAILURE;
+    }
+
+  xcb_screen_iterator_t screen_iter = xcb_setup_roots_iterator(xcb_get_setup(replay.connection));
+  for(; screen_nbr; screen_nbr--)
+    xcb_screen_next(&screen_iter);
+
+  replay.screen = screen_iter.data;
+
+  replay.gc = xcb_generate_id(replay.connection);
+  xcb_create_gc(replay.connection, replay.gc, replay.screen->root, 0, NULL);
+
+  if(!_replay_create_tree(&replay, fp))
+    {
+      fprintf(stderr, "Truncated record file %s\n", argv[optind]);
+      return EXIT_FAILURE;
+    }
+
+  _replay_sync(&replay);
+
+  const double begin = _replay_now();
+  double next = begin;
+
+  record_event_t record_event;
+  while(fread(&record_event, sizeof(record_event_t), 1, fp) == 1)
+    {
+      if(!is_max_speed)
+        {
+          next += record_event.delay / 1e6;
+
+          const double delay = next - _replay_now();
+          if(delay > 0)
+            {
+              /* Send the pending requests before sleeping */
+              xcb_flush(replay.connection);
+
+              const struct timespec delay_ts = {
+                (time_t) delay, (long) ((delay - (double) (time_t) delay) * 1e9)
+              };
+
+              nanosleep(&delay_ts, NULL);
+            }
+        }
+
+      if(_replay_event(&replay, (const xcb_generic_event_t *) record_event.event))
+        replay.events_replayed++;
+      else
+        replay.events_skipped++;
+
+      if(is_max_speed &&
+         !((replay.events_replayed + replay.events_skipped) % REPLAY_MAX_SPEED_BATCH))
+        _replay_sync(&replay);
+
+      if(xcb_connection_has_error(replay.connection))
+        {
+          fprintf(stderr, "X connection error\n");
+          return EXIT_FAILURE;
+        }
+    }
+
+  _replay_sync(&replay);
+
+  printf("{\"events_replayed\": %ju, \"events_skipped\": %ju, \"duration\": %.6f}\n",
+         (uintmax_t) replay.events_replayed, (uintmax_t) replay.events_skipped,
+         _replay_now() - begin);
+
+  fclose(fp);
+  xcb_disconnect(replay.connection);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,136 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Benchmark of the expose plugin CPU downscaler
+ *
+ *  Scale windows of common sizes to a quarter of their size with each
+ *  implementation supported by the CPU, check that all of them give
+ *  the same result and report the throughput in source megapixels per
+ *  second.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "expose_scale.h"
+
+/** Minimum time in seconds spent on each measurement */
+#define SCALE_BENCH_MIN_TIME 0.5
+
+static const struct
+{
+  uint32_t width;
+  uint32_t height;
+} _scale_bench_sizes[] = {
+  { 640, 480 },
+  { 1280, 720 },
+  { 1920, 1080 },
+  { 2560, 1440 },
+  { 3840, 2160 }
+};
+
+/** Get the current monotonic time
+ *
+ * \return The time in seconds
+ */
+static double
+_scale_bench_now(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+int
+main(void)
+{
+  int ret = EXIT_SUCCESS;
+
+  printf("%-12s %-8s %10s %12s\n", "size", "impl", "ms/scale", "Mpixels/s");
+
+  for(size_t size_n = 0;
+      size_n < sizeof(_scale_bench_sizes) / sizeof(_scale_bench_sizes[0]);
+      size_n++)
+    {
+      const uint32_t width = _scale_bench_sizes[size_n].width;
+      const uint32_t height = _scale_bench_sizes[size_n].height;
+      const uint32_t scale_width = width / 4;
+      const uint32_t scale_height = height / 4;
+
+      uint32_t *src = malloc((size_t) width * height * sizeof(uint32_t));
+      uint32_t *reference = calloc((size_t) scale_width * scale_height,
+                                   sizeof(uint32_t));
+      uint32_t *dst = calloc((size_t) scale_width * scale_height,
+                             sizeof(uint32_t));
+
+      srand(42);
+      for(size_t pixel_n = 0; pixel_n < (size_t) width * height; pixel_n++)
+        src[pixel_n] = (uint32_t) rand();
+
+      for(int impl = 0; impl < EXPOSE_SCALE_IMPL_NUMBER; impl++)
+        {
+          if(!expose_scale_impl_is_supported((expose_scale_impl_t) impl))
+            continue;
+
+          expose_scale_set_impl((expose_scale_impl_t) impl);
+
+          unsigned int iterations = 0;
+          const double begin = _scale_bench_now();
+          double elapsed;
+
+          do
+            {
+              expose_scale_pixels(src, width, height, width, dst, scale_width,
+                                  scale_height, scale_width, NULL);
+
+              iterations++;
+              elapsed = _scale_bench_now() - begin;
+            }
+          while(elapsed < SCALE_BENCH_MIN_TIME);
+
+          if(impl == EXPOSE_SCALE_IMPL_SCALAR)
+            memcpy(reference, dst,
+                   (size_t) scale_width * scale_height * sizeof(uint32_t));
+          else if(memcmp(reference, dst,
+                         (size_t) scale_width * scale_height * sizeof(uint32_t)))
+            {
+              fprintf(stderr, "%s: result differs from scalar\n",
+                      expose_scale_impl_get_name((expose_scale_impl_t) impl));
+              ret = EXIT_FAILURE;
+            }
+
+          char size[16];
+          snprintf(size, sizeof(size), "%ux%u", width, height);
+
+          printf("%-12s %-8s %10.3f %12.1f\n", size,
+                 expose_scale_impl_get_name((expose_scale_impl_t) impl),
+                 elapsed * 1000 / iterations,
+                 (double) width * height * iterations / elapsed / 1e6);
+        }
+
+      free(src);
+      free(reference);
+      free(dst);
+    }
+
+  return ret;
+}
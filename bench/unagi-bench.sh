@@ -0,0 +1,162 @@
+#!/bin/sh
+#
+# End-to-end benchmark of unagi: for each load scenario, start unagi on
+# a virtual X server (Xvfb), run the load generator and output the
+# painting statistics written by unagi on exit as one JSON object per
+# line (see 'src/stats.c').
+#
+# Usage: unagi-bench.sh [-b BACKEND] [-n WINDOWS] [-d DURATION] [-o OUTPUT]
+#                       [-t RECORD] [SCENARIO...]
+#
+# With -t, the events recorded by 'unagi --record' are replayed as fast
+# as possible instead (scenario "replay").
+#
+# The "input" scenario measures the input-to-photon latency instead of
+# loading the windows, its distribution being added as "input_latency"
+# (see 'input_latency.c'). It is skipped if INPUT_CLIENT is set to an
+# empty string, e.g. when built without xcb-xtest.
+#
+# The "expose" scenario runs unagi with the expose plugin and checks
+# that the thumbnail of a window damaged at a non-zero offset is
+# updated, its result being added as "expose_damage" (see
+# 'expose_damage.c'). It is skipped if EXPOSE_CLIENT is set to an empty
+# string or with the null rendering backend, which paints nothing.
+#
+# With the null rendering backend (-b null), nothing is painted, thus
+# only the core is measured, its counters being added as "backend_stats".
+#
+# The programs and paths may be overridden with the UNAGI, LOAD_CLIENT,
+# REPLAY_CLIENT, INPUT_CLIENT, EXPOSE_CLIENT, RENDERING_PATH,
+# PLUGINS_PATH and XVFB environment variables.
+
+UNAGI=${UNAGI:-../src/unagi}
+LOAD_CLIENT=${LOAD_CLIENT:-./load_client}
+REPLAY_CLIENT=${REPLAY_CLIENT:-./replay_client}
+INPUT_CLIENT=${INPUT_CLIENT-./input_latency}
+EXPOSE_CLIENT=${EXPOSE_CLIENT-./expose_damage}
+RENDERING_PATH=${RENDERING_PATH:-../rendering/.libs}
+PLUGINS_PATH=${PLUGINS_PATH:-../plugins/.libs}
+XVFB=${XVFB:-Xvfb}
+
+BACKEND=render
+WINDOWS=16
+DURATION=10
+OUTPUT=/dev/stdout
+RECORD=
+
+while getopts "b:n:d:o:t:" opt; do
+    case $opt in
+	b) BACKEND=$OPTARG ;;
+	n) WINDOWS=$OPTARG ;;
+	d) DURATION=$OPTARG ;;
+	o) OUTPUT=$OPTARG ;;
+	t) RECORD=$OPTARG ;;
+	*) echo "Usage: $0 [-b BACKEND] [-n WINDOWS] [-d DURATION] [-o OUTPUT] [-t RECORD] [SCENARIO...]" >&2
+	   exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+SCENARIOS=${*:-typing video drag resize opacity${INPUT_CLIENT:+ input}${EXPOSE_CLIENT:+ expose}}
+[ -n "$RECORD" ] && SCENARIOS=replay
+
+TMPDIR=$(mktemp -d) || exit 1
+XVFB_PID=
+
+cleanup() {
+    [ -n "$XVFB_PID" ] && kill "$XVFB_PID" 2>/dev/null
+    rm -rf "$TMPDIR"
+}
+trap cleanup EXIT INT TERM
+
+# Let Xvfb choose a free display, written to the given file descriptor
+# once ready to accept connections
+"$XVFB" -displayfd 3 -screen 0 1920x1080x24 -nolisten tcp +extension Composite \
+    +extension XTEST \
+    3>"$TMPDIR/display" 2>"$TMPDIR/xvfb.log" &
+XVFB_PID=$!
+
+while [ ! -s "$TMPDIR/display" ]; do
+    if ! kill -0 "$XVFB_PID" 2>/dev/null; then
+	cat "$TMPDIR/xvfb.log" >&2
+	exit 1
+    fi
+    sleep 0.1
+done
+
+DISPLAY=:$(cat "$TMPDIR/display")
+export DISPLAY
+
+cat > "$TMPDIR/unagi.conf" <<CONF
+rendering = "$BACKEND"
+plugins = { "opacity" }
+CONF
+
+# The thumbnails are scaled on the CPU, thus only updated on the
+# damaged areas of the windows
+cat > "$TMPDIR/expose.conf" <<CONF
+rendering = "$BACKEND"
+plugins = { "opacity", "expose" }
+expose_server_scaling = false
+CONF
+
+: > "$OUTPUT"
+
+for scenario in $SCENARIOS; do
+    if [ "$scenario" = input ] && [ -z "$RECORD" ] && [ -z "$INPUT_CLIENT" ]; then
+	echo "Scenario input skipped, built without xcb-xtest" >&2
+	continue
+    fi
+    if [ "$scenario" = expose ] && [ -z "$RECORD" ] && [ -z "$EXPOSE_CLIENT" ]; then
+	echo "Scenario expose skipped, built without xcb-xtest" >&2
+	continue
+    fi
+    if [ "$scenario" = expose ] && [ -z "$RECORD" ] && [ "$BACKEND" = null ]; then
+	echo "Scenario expose skipped, nothing painted by the null backend" >&2
+	continue
+    fi
+
+    config="$TMPDIR/unagi.conf"
+    [ "$scenario" = expose ] && [ -z "$RECORD" ] && config="$TMPDIR/expose.conf"
+
+    rm -f "$TMPDIR/stats.json" "$TMPDIR/input.json" "$TMPDIR/expose.json"
+
+    "$UNAGI" -c "$config" -r "$RENDERING_PATH" -p "$PLUGINS_PATH" \
+	-s "$TMPDIR/stats.json" 2>"$TMPDIR/unagi.log" &
+    UNAGI_PID=$!
+
+    # Leave time to unagi to redirect the windows
+    sleep 1
+
+    if [ -n "$RECORD" ]; then
+	"$REPLAY_CLIENT" -m "$RECORD" >&2
+    elif [ "$scenario" = input ]; then
+	"$INPUT_CLIENT" > "$TMPDIR/input.json"
+    elif [ "$scenario" = expose ]; then
+	"$EXPOSE_CLIENT" > "$TMPDIR/expose.json"
+    else
+	"$LOAD_CLIENT" -s "$scenario" -n "$WINDOWS" -d "$DURATION"
+    fi
+    status=$?
+
+    # The statistics are written on exit
+    kill -TERM "$UNAGI_PID"
+    wait "$UNAGI_PID"
+
+    if [ $status -ne 0 ] || [ ! -s "$TMPDIR/stats.json" ]; then
+	echo "Scenario $scenario failed" >&2
+	cat "$TMPDIR/unagi.log" >&2
+	exit 1
+    fi
+
+    # The null backend writes its counters to the standard error on exit
+    backend_stats=$(grep '^{' "$TMPDIR/unagi.log" | tail -n 1)
+    input_latency=$(cat "$TMPDIR/input.json" 2>/dev/null)
+    expose_damage=$(cat "$TMPDIR/expose.json" 2>/dev/null)
+
+    sed -e "s/^{/{\"scenario\": \"$scenario\", \"backend\": \"$BACKEND\", \"windows\": $WINDOWS, /" \
+	${backend_stats:+-e "s/}\$/, \"backend_stats\": $backend_stats}/"} \
+	${input_latency:+-e "s/}\$/, \"input_latency\": $input_latency}/"} \
+	${expose_damage:+-e "s/}\$/, \"expose_damage\": $expose_damage}/"} \
+	"$TMPDIR/stats.json" >> "$OUTPUT"
+done
@@ -31,6 +31,7 @@
 #include <xcb/xcb_ewmh.h>
 
 extern xcb_atom_t _NET_WM_WINDOW_OPACITY;
+extern xcb_atom_t _NET_WM_OPAQUE_REGION;
 extern xcb_atom_t _XROOTPMAP_ID;
 extern xcb_atom_t _XSETROOT_ID;
 
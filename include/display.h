@@ -46,7 +46,12 @@ void display_init_redirect(void);
 void display_init_redirect_finalise(void);
 
 void display_add_damaged_region(xcb_xfixes_region_t *, bool);
+void display_damage_screen(void);
 void display_reset_damaged(void);
+void display_clear_damage_overlay(void);
+
+void display_add_underlay_damaged_region(const xcb_xfixes_region_t);
+void display_reset_underlay_damaged(void);
 
 void display_set_screen_refresh_rate(xcb_randr_get_screen_info_cookie_t);
 
@@ -0,0 +1,61 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Last contents of unmapped or destroyed windows
+ */
+
+#ifndef GHOST_H
+#define GHOST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <xcb/xcb.h>
+
+#include <ev.h>
+
+#include "window.h"
+
+/** Last contents of a window which has been unmapped or destroyed,
+    kept for a limited time for plugins (e.g. fade-out effects) */
+typedef struct _ghost_t
+{
+  /** The XID of the Window this ghost belongs to */
+  xcb_window_t id;
+  /** Detached window object holding  a copy of the geometry  and the
+      attributes, the  last Pixmap and  the rendering backend  data, so
+      it can be painted as any other window */
+  window_t *window;
+  /** Time after which the ghost is removed from the cache */
+  ev_tstamp expiry;
+  /** References held by the cache itself and by plugins */
+  unsigned int reference_counter;
+  struct _ghost_t *next;
+} ghost_t;
+
+void ghost_add(window_t *);
+ghost_t *ghost_get(const xcb_window_t);
+void ghost_unref(ghost_t *);
+void ghost_remove(const xcb_window_t);
+bool ghost_restore(window_t *);
+void ghost_expire(void);
+void ghost_cleanup(void);
+
+#endif
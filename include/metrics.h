@@ -0,0 +1,111 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Live metrics served over a Unix socket
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+#include <ev.h>
+
+/** Number of buckets of the painting time histogram: the first one
+    counts the times below 1us, the n-th one the times from 2^(n-2) to
+    2^(n-1) us and the last one all the times above */
+#define METRICS_PAINT_TIME_BUCKETS 20
+
+/** Number of sub-buckets per power of two of the latency histograms,
+    thus a percentile is known within 12.5% */
+#define METRICS_LATENCY_SUB_BUCKETS 8
+
+/** Number of buckets of the latency histograms, up to 2^23 us (8s) */
+#define METRICS_LATENCY_BUCKETS (METRICS_LATENCY_SUB_BUCKETS * 22)
+
+/** Histogram of latencies  in microseconds: the  first buckets count
+    each value below METRICS_LATENCY_SUB_BUCKETS, then each power of two
+    is split in METRICS_LATENCY_SUB_BUCKETS buckets */
+typedef struct _metrics_latency_histogram_t
+{
+  /** Number of latencies in each bucket */
+  uint32_t buckets[METRICS_LATENCY_BUCKETS];
+  /** Number of latencies */
+  uint32_t count;
+} metrics_latency_histogram_t;
+
+/** Counters updated  on the hot path  (simple increments) and only
+    summarised when a snapshot is requested */
+typedef struct _metrics_t
+{
+  /** Painting time histogram, see METRICS_PAINT_TIME_BUCKETS */
+  uint32_t paint_time_histogram[METRICS_PAINT_TIME_BUCKETS];
+  /** Number of frames whose painting exceeded the refresh interval */
+  uint32_t missed_deadlines;
+  /** Time from the DamageNotify to the frame painting it on the screen */
+  metrics_latency_histogram_t damage_latency;
+  /** Number of frames which  painted a damage received more than two
+      refresh intervals before, thus missing at least one refresh */
+  uint32_t late_frames;
+  /** Number of DamageNotify events received */
+  uint64_t damage_notify_counter;
+  /** Value of damage_notify_counter one second ago */
+  uint64_t damage_notify_counter_previous;
+  /** Number of DamageNotify events received during the last second */
+  uint32_t damage_notify_per_second;
+  /** Number of bytes sent to the clients of the metrics socket, not
+      counted in the bytes written per frame */
+  uint64_t bytes_sent;
+  /** Number of bytes written one second ago, see bytes_written_per_frame */
+  uint64_t bytes_written_previous;
+  /** Number of frames painted one second ago */
+  unsigned int frames_previous;
+  /** Number of bytes written by the process per frame during the last
+      second, mostly to the X connection */
+  float bytes_written_per_frame;
+  /** Number of X requests sent, counted at each frame */
+  uint64_t requests;
+  /** Number of X requests sent before the last frame was synced */
+  uint32_t last_frame_requests;
+  /** Sequence number of the request syncing the last frame */
+  unsigned int sync_sequence;
+  /** Number of events processed by the last drain of the queue */
+  uint32_t events_last_drain;
+  /** Maximum number of events processed by a drain of the queue */
+  uint32_t events_max_drain;
+  /** Listening socket, only if the libev watcher is active */
+  int fd;
+  /** libev watcher of the listening socket */
+  ev_io io_watcher;
+  /** libev timer watcher computing the rates per second */
+  ev_timer rate_timer_watcher;
+} metrics_t;
+
+void metrics_init(void);
+void metrics_add_paint_time(const float);
+void metrics_add_frame_requests(const unsigned int);
+void metrics_latency_add(metrics_latency_histogram_t *, const double);
+void metrics_add_damage_latency(metrics_latency_histogram_t **, const double);
+void metrics_add_frame_latency(const double);
+double metrics_latency_get_percentile(const metrics_latency_histogram_t *,
+                                      const double);
+void metrics_cleanup(void);
+
+#endif
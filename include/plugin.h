@@ -43,12 +43,14 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #include <xcb/xcb.h>
 #include <xcb/damage.h>
 #include <xcb/randr.h>
 
 #include "window.h"
+#include "trace.h"
 
 /** Plugin structure holding all the supported event handlers */
 typedef struct
@@ -96,6 +98,10 @@ typedef struct
   uint16_t (*window_get_opacity)(const window_t *);
   /** Hook to allow plugins to provide their own windows */
   window_t *(*render_windows)(void);
+  /** Hook called once a frame is on the screen, given its time */
+  void (*frame_presented)(const double);
+  /** Hook to write the plugin metrics as a JSON object */
+  void (*write_metrics)(FILE *);
 } plugin_vtable_t;
 
 /** Plugin list element */
@@ -119,7 +125,12 @@ typedef struct _plugin_t
       plugin = plugin->next)						\
     {									\
       if(plugin->enable && plugin->vtable->events.event_type)		\
-	(*plugin->vtable->events.event_type)(event, window);		\
+	{								\
+	  const double trace_plugin_begin = trace_begin();		\
+	  (*plugin->vtable->events.event_type)(event, window);		\
+	  trace_end(plugin->vtable->name, #event_type, 0,		\
+		    trace_plugin_begin);				\
+	}								\
     }
 
 plugin_t *plugin_load(const char *);
@@ -0,0 +1,104 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Record of the X events stream
+ */
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <xcb/xcb.h>
+
+#include <ev.h>
+
+/** Magic string at the beginning of a record file */
+#define RECORD_MAGIC "UNAGIREC"
+
+/** Version of the record file format */
+#define RECORD_VERSION 1
+
+/** Header of a record file, followed by the windows tree and the events
+ *  (in host byte order) */
+typedef struct
+{
+  /** RECORD_MAGIC without the trailing NUL character */
+  char magic[8];
+  /** RECORD_VERSION */
+  uint32_t version;
+  /** Root window identifier */
+  uint32_t root;
+  /** Screen width */
+  uint16_t screen_width;
+  /** Screen height */
+  uint16_t screen_height;
+  /** First event of the Damage extension, identifying DamageNotify */
+  uint8_t damage_first_event;
+  uint8_t pad[3];
+  /** Number of windows of the initial tree */
+  uint32_t windows_len;
+} record_header_t;
+
+/** Window of the initial tree, from the bottom to the top of the stack */
+typedef struct
+{
+  uint32_t id;
+  int16_t x;
+  int16_t y;
+  uint16_t width;
+  uint16_t height;
+  uint16_t border_width;
+  uint8_t depth;
+  uint8_t map_state;
+  uint8_t override_redirect;
+  uint8_t pad[3];
+} record_window_t;
+
+/** Event as received from the X server */
+typedef struct
+{
+  /** Time elapsed since the previous event (in microseconds) */
+  uint32_t delay;
+  /** The event itself, X events being 32 bytes long */
+  uint8_t event[32];
+} record_event_t;
+
+/** Record of the events passed to the core */
+typedef struct _record_t
+{
+  /** Record file */
+  FILE *fp;
+  /** Whether the windows tree has been written, thus events recorded */
+  bool is_started;
+  /** Time of the previous event */
+  ev_tstamp previous_time;
+  /** Number of events recorded */
+  uint64_t events_len;
+} record_t;
+
+void record_init(const char *);
+void record_start(void);
+void record_event(const xcb_generic_event_t *);
+void record_cleanup(void);
+
+#endif
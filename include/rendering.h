@@ -65,6 +65,25 @@ typedef struct
   void (*free_window_pixmap) (window_t *);
   /** Free resources associated with a window */
   void (*free_window) (window_t *);
+  /** Start repainting  the damaged part  of the underlay  (optional),
+      windows  are then  painted to  the underlay  rather than  the
+      buffer until paint_underlay_end is called, returns false if the
+      underlay does not need to be repainted */
+  bool (*paint_underlay_begin) (void);
+  /** Paint the underlay to the buffer */
+  void (*paint_underlay_end) (void);
+  /** Check whether the given window has an alpha channel (optional) */
+  bool (*is_window_argb) (window_t *);
+  /** Scale the window contents of the given original size (including
+      border) to its geometry when painting it (optional), returns false
+      if not supported */
+  bool (*set_window_scale) (window_t *, const uint16_t, const uint16_t);
+  /** Tint the damaged Region, the windows repainted in full and the
+      damaged  windows which have not  been painted, on the screen
+      after painting all, the tints of the previous frame being removed
+      (optional) */
+  void (*paint_damage_overlay) (const xcb_rectangle_t *, const uint32_t,
+                                const xcb_rectangle_t *, const uint32_t);
 } rendering_t;
 
 bool rendering_load(void);
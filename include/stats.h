@@ -0,0 +1,57 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Painting statistics
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#include <ev.h>
+
+/** Statistics of the frames painted, recorded for benchmarking */
+typedef struct _stats_t
+{
+  /** Path of the file the statistics are written to on exit */
+  char *path;
+  /** Painting time of each frame (in seconds) */
+  float *paint_times;
+  /** Number of frames painted */
+  unsigned int paint_times_len;
+  /** Number of frames which can be stored without reallocating */
+  unsigned int paint_times_size;
+  /** Time the first frame painting began */
+  ev_tstamp first_paint_time;
+  /** Time the last frame painting ended */
+  ev_tstamp last_paint_time;
+  /** Process CPU time when the first frame painting began (in seconds) */
+  double first_cpu_time;
+  /** Process CPU time when the last frame painting ended (in seconds) */
+  double last_cpu_time;
+} stats_t;
+
+void stats_init(const char *);
+void stats_paint_begin(void);
+void stats_paint_end(const float);
+void stats_cleanup(void);
+
+#endif
@@ -33,6 +33,12 @@
 #include <ev.h>
 
 #include "window.h"
+#include "ghost.h"
+#include "stats.h"
+#include "record.h"
+#include "metrics.h"
+#include "trace.h"
+#include "xid.h"
 #include "rendering.h"
 #include "plugin.h"
 #include "atoms.h"
@@ -49,6 +55,9 @@ typedef struct _display_extensions_t
   const xcb_query_extension_reply_t *damage;
   /** The RandR extension information */
   const xcb_query_extension_reply_t *randr;
+  /** The X-Resource extension information (optional, to get the PID of
+      the clients of windows) */
+  const xcb_query_extension_reply_t *res;
 } display_extensions_t;
 
 /** Repaint interval to 20ms (50Hz) if  it could not have been obtained
@@ -80,6 +89,11 @@ typedef struct _conf_t
   xcb_screen_t *screen;
   /** If the background has been reset */
   bool background_reset;
+  /** Whether the damages are shown on the screen (see 'metrics.c') */
+  bool damage_overlay;
+  /** Whether the damaged Region has only been set to remove the tints
+      of the damage overlay */
+  bool damage_overlay_clear;
   /** Maximum painting interval in seconds (from screen refresh rate) */
   float refresh_rate_interval;
   /** Repaint interval computed from the painting time average */
@@ -100,6 +114,49 @@ typedef struct _conf_t
   util_itree_t *windows_itree;
   /** Damaged region which must be repainted */
   xcb_xfixes_region_t damaged;
+  /** Damaged region of the underlay (static windows at the bottom of
+      the stack) which must be repainted in the underlay */
+  xcb_xfixes_region_t underlay_damaged;
+  /** If the whole underlay must be repainted */
+  bool underlay_reset;
+  /** Time in seconds without being damaged before a window is
+      considered static and cached in the underlay (0 to disable) */
+  float underlay_idle_time;
+  /** Time in seconds after which the Pixmap of a window hidden on
+      another desktop or minimized is released (0 to disable) */
+  float hidden_release_time;
+  /** libev timer watcher releasing Pixmaps of hidden windows */
+  ev_timer event_hidden_timer_watcher;
+  /** Whether the hidden properties of a window have been requested, its
+      hidden state being updated once the events queue is drained */
+  bool hidden_update_pending;
+  /** Maximum estimated size in bytes  of all the windows Pixmaps (0 for
+      no limit) */
+  uint64_t pixmaps_budget;
+  /** Current estimated size in bytes of all the windows Pixmaps */
+  uint64_t pixmaps_size;
+  /** Number of windows Pixmaps released to fit in the budget */
+  unsigned int pixmaps_evictions;
+  /** Last contents of unmapped or destroyed windows, newest first */
+  ghost_t *ghosts;
+  /** Estimated size in bytes of the Pixmaps of the ghosts in the cache */
+  uint64_t ghosts_size;
+  /** Maximum estimated size in bytes of the ghosts cache (0 for no limit) */
+  uint64_t ghosts_budget;
+  /** Time in seconds a ghost is kept in the cache (0 to disable) */
+  float ghost_ttl;
+  /** libev timer watcher removing the expired ghosts */
+  ev_timer event_ghost_timer_watcher;
+  /** Painting statistics, only recorded if requested */
+  stats_t *stats;
+  /** Record of the events, only if requested */
+  record_t *record;
+  /** Live metrics, always collected */
+  metrics_t metrics;
+  /** Trace events of the last frames, only recorded if requested */
+  trace_t *trace;
+  /** Server resources alive, always accounted */
+  xids_t xids;
   /** Confuse configuration file options */
   cfg_t *cfg;
   /** List of KeySyms, only updated when receiving a KeyboardMapping event */
@@ -116,6 +173,17 @@ typedef struct _conf_t
     bool initialised;
   } atoms_supported;
 
+  /** Hold _NET_CURRENT_DESKTOP value */
+  struct
+  {
+    /** _NET_CURRENT_DESKTOP value */
+    uint32_t value;
+    /** _NET_CURRENT_DESKTOP request cookie */
+    xcb_get_property_cookie_t cookie;
+    /** Specify whether this property has been set */
+    bool initialised;
+  } current_desktop;
+
   /** Path to the rendering backends directory */
   char *rendering_dir;
   /** dlopen() opaque structure for the rendering backend */
@@ -0,0 +1,65 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Trace events of the frames painting
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/** Number of  trace events kept  in memory, the oldest ones being
+    overwritten (2 MiB) */
+#define TRACE_EVENTS_SIZE 65536
+
+/** Trace event, only 'complete' events (begin and duration) are used */
+typedef struct _trace_event_t
+{
+  /** Category, a string literal (e.g. "phase", "event", "wait") */
+  const char *category;
+  /** Name, a string literal */
+  const char *name;
+  /** Begin time (in seconds) */
+  double begin;
+  /** Duration (in seconds) */
+  float duration;
+  /** Identifier of the window concerned, if any */
+  uint32_t id;
+} trace_event_t;
+
+/** Ring buffer of the last trace events, only allocated if requested */
+typedef struct _trace_t
+{
+  /** Path of the file the trace events are written to on SIGUSR1 */
+  char *path;
+  /** Trace events, the oldest one being at 'events_n' if full */
+  trace_event_t *events;
+  /** Number of trace events added so far */
+  uint64_t events_n;
+} trace_t;
+
+void trace_init(const char *);
+double trace_begin(void);
+void trace_end(const char *, const char *, const uint32_t, const double);
+void trace_dump(void);
+void trace_cleanup(void);
+
+#endif
@@ -32,10 +32,37 @@
 #include <xcb/damage.h>
 #include <xcb/xfixes.h>
 
+#include <ev.h>
+
 #include "util.h"
+#include "metrics.h"
 
 #define WINDOW_FULLY_DAMAGED_RATIO 0.9
 
+/** _NET_WM_DESKTOP value meaning that the window is on all desktops */
+#define WINDOW_ALL_DESKTOPS 0xFFFFFFFF
+
+/** Painting cost of a window, accumulated since it has been managed,
+    to find out which windows slow down the painting */
+typedef struct _window_cost_t
+{
+  /** Number of DamageNotify events received */
+  uint32_t damage_notify;
+  /** Sum of the areas of the DamageNotify events (in pixels) */
+  uint64_t damaged_area;
+  /** Number of times the window has been painted */
+  uint32_t paint_calls;
+  /** Number of Composite requests sent by the rendering backend */
+  uint32_t composite_calls;
+  /** Number of pixels painted, the window being clipped to the screen */
+  uint64_t painted_pixels;
+  /** Number of pixels painted in the frame being painted */
+  uint32_t frame_pixels;
+  /** Share of  the time spent  by the  server  painting the frames,
+      proportional to the number of pixels painted (in seconds) */
+  double server_time;
+} window_cost_t;
+
 typedef struct _window_t
 {
   xcb_window_t id;
@@ -49,6 +76,59 @@ typedef struct _window_t
   float damaged_ratio;
   short damage_notify_counter;
   xcb_pixmap_t pixmap;
+  /** Time of the last DamageNotify or change of the window, used to
+      determine whether the window is static */
+  ev_tstamp damage_timestamp;
+  /** Time elapsed between the two last DamageNotify */
+  ev_tstamp damage_interval;
+  /** Whether the window is currently painted in the underlay */
+  bool in_underlay;
+  /** Whether the window is entirely hidden by an opaque window above */
+  bool is_occluded;
+  /** _NET_WM_OPAQUE_REGION GetProperty cookie (reply got when needed) */
+  xcb_get_property_cookie_t opaque_region_cookie;
+  /** Opaque rectangles given by _NET_WM_OPAQUE_REGION, relative to the
+      window (excluding border) */
+  xcb_rectangle_t *opaque_rectangles;
+  /** Number of opaque rectangles */
+  uint32_t opaque_rectangles_len;
+  /** Region of the opaque rectangles, relative to the window */
+  xcb_xfixes_region_t opaque_region;
+  /** _NET_WM_DESKTOP GetProperty cookie (reply got when needed) */
+  xcb_get_property_cookie_t desktop_cookie;
+  /** _NET_WM_STATE GetProperty cookie (reply got when needed) */
+  xcb_get_property_cookie_t state_cookie;
+  /** Desktop of the window as given by _NET_WM_DESKTOP */
+  uint32_t desktop;
+  /** Whether the window has _NET_WM_STATE_HIDDEN (minimized) */
+  bool is_minimized;
+  /** Whether the window is on another desktop or minimized, thus it
+      is neither painted nor its damages handled */
+  bool is_hidden;
+  /** Whether the window has been mapped by a plugin to get its Pixmap */
+  bool is_forced_mapped;
+  /** Time when the window has been hidden */
+  ev_tstamp hidden_timestamp;
+  /** Estimated size in bytes of the Pixmap in the X server */
+  uint32_t pixmap_size;
+  /** Time when the window has been painted for the last time */
+  ev_tstamp paint_timestamp;
+  /** Whether the Pixmap has been released to fit in the Pixmaps budget
+      and must be named again before being painted */
+  bool is_pixmap_evicted;
+  /** Whether the Pixmap has been restored from the ghost of the window
+      when mapped again, until the window draws its new contents */
+  bool is_pixmap_ghost;
+  /** Painting cost, reported by the metrics socket */
+  window_cost_t cost;
+  /** Arrival time of the oldest DamageNotify not painted yet (0 if none) */
+  ev_tstamp damage_arrival;
+  /** Arrival time  of the oldest  DamageNotify painted in the  current
+      frame, until the frame is on the screen (0 if none) */
+  ev_tstamp frame_damage_arrival;
+  /** Time  from  the  DamageNotify  to  the  frame painting it on the
+      screen, allocated once the window has been damaged and painted */
+  metrics_latency_histogram_t *damage_latency;
   void *rendering;
   struct _window_t *next;
 } window_t;
@@ -71,15 +151,26 @@ void window_register_notify(const window_t *);
 void window_get_root_background_pixmap(void);
 xcb_pixmap_t window_get_root_background_pixmap_finalise(void);
 xcb_pixmap_t window_new_root_background_pixmap(void);
-xcb_pixmap_t window_get_pixmap(const window_t *);
+xcb_pixmap_t window_get_pixmap(window_t *);
+void window_restore_pixmap(window_t *);
 bool window_is_rectangular(window_t *);
 xcb_xfixes_region_t window_get_region(window_t *, bool, bool);
+void window_get_opaque_region_property(window_t *);
+xcb_xfixes_region_t window_get_opaque_region(window_t *);
 bool window_is_visible(const window_t *);
+uint32_t window_get_screen_area(const window_t *);
+void window_get_current_desktop_property(void);
+void window_get_hidden_properties(window_t *);
+void window_update_hidden(window_t *);
+void window_update_pending_hidden(void);
+void window_update_current_desktop(void);
+void window_free_hidden_pixmaps(void);
 void window_get_invisible_window_pixmap(window_t *);
 void window_get_invisible_window_pixmap_finalise(window_t *);
 void window_manage_existing(const int nwindows, const xcb_window_t *);
 window_t *window_add(const xcb_window_t, bool);
 void window_restack(window_t *, xcb_window_t);
+void window_underlay_remove(window_t *);
 void window_paint_all(window_t *);
 
 static inline float
@@ -0,0 +1,100 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Accounting of the server resources created
+ */
+
+#ifndef XID_H
+#define XID_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "util.h"
+
+/** Types of the server resources accounted */
+typedef enum
+{
+  XID_TYPE_REGION = 0,
+  XID_TYPE_PICTURE,
+  XID_TYPE_PIXMAP,
+  XID_TYPE_DAMAGE,
+  XID_TYPE_GC,
+  XID_TYPE_NB
+} xid_type_t;
+
+/** Call site creating server resources of a given type */
+typedef struct _xid_site_t
+{
+  /** Source file and line (e.g. "window.c:397") */
+  char label[64];
+  /** Type of the resources created */
+  xid_type_t type;
+  /** Index of the site, in creation order */
+  uint32_t index;
+  /** Number of resources created and not freed yet */
+  uint32_t live;
+  /** Number of resources created so far */
+  uint64_t created;
+  /** Next call site */
+  struct _xid_site_t *next;
+} xid_site_t;
+
+/** Server resource created and not freed yet */
+typedef struct _xid_object_t
+{
+  /** Call site which created it */
+  xid_site_t *site;
+  /** Creation time (monotonic, in seconds) */
+  double created;
+} xid_object_t;
+
+/** Live server resources, indexed by XID */
+typedef struct _xids_t
+{
+  /** Live resources ('xid_object_t') */
+  util_itree_t *objects;
+  /** Call sites, the last created first */
+  xid_site_t *sites;
+  /** Number of call sites */
+  uint32_t sites_len;
+  /** Number of live resources by type */
+  uint32_t live[XID_TYPE_NB];
+  /** Number of resources freed while not tracked (e.g. freed twice) */
+  uint32_t orphaned_frees[XID_TYPE_NB];
+} xids_t;
+
+/** Allocate an XID for a server resource of the given type, accounted
+    to the file and line of the caller, whose site is looked up only on
+    the first call */
+#define xid_generate(type)                                              \
+  __extension__                                                         \
+  ({                                                                    \
+    static xid_site_t *__xid_site = NULL;                               \
+    _xid_generate(type, &__xid_site, __FILE__, __LINE__);               \
+  })
+
+uint32_t _xid_generate(const xid_type_t, xid_site_t **, const char *,
+                       const int);
+void xid_free(const xid_type_t, const uint32_t);
+void xid_write_report(FILE *, const double);
+void xid_cleanup(void);
+
+#endif
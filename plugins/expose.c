@@ -21,9 +21,10 @@
  *  \brief Exposé effect plugin
  *
  *  This plugin implements (roughly) Expose  feature as seen in Mac OS
- *  X and Compiz  (known as Scale plugin) but  is not really optimised
- *  (yet) because it repaints all  the windows even if the content has
- *  not been changed  and it should also maybe  use SHM for xcb_image.
+ *  X and Compiz (known as Scale plugin). Only the damaged area of the
+ *  windows is rescaled and  the thumbnails are  kept between
+ *  activations  (up to  CACHE_BUDGET  bytes),  thus only  the  area
+ *  damaged in the meantime has to be rescaled on the next activation.
  *  The window  slots could be arranged  in a better  way by including
  *  the window geometry in the computation and the rescaling algorithm
  *  should be improved to decrease the blurry effect.
@@ -41,16 +42,22 @@
  *
  *   1/  Create the  slots where  each window  will be  put  by simply
  *      dividing the screen in  strips according the current number of
- *      windows ('_expose_create_slots').
+ *      windows, split in pages  if the slots would be too small (see
+ *      'expose_layout.c'). Only the windows of the current page  are
+ *      displayed and rescaled ('_expose_create_page_slots').
  *
- *   2/ Assign each  window to a slot based  on the Euclidian distance
- *      between their center ('_expose_assign_windows_to_slots').
+ *   2/ Assign each  window to a slot  by sorting the windows  by the
+ *      position of their center  (see 'expose_layout.c').
  *
  *   3/ Map all windows which were unmapped to get their content using
  *      NameWindowPixmap  Composite   request  (when  the   window  is
  *      unmapped, the  content is not guaranteed to  be preserved) and
  *      also set OverrideRedirect attribute  to ensure that the window
- *      manager will not care about them anymore.
+ *      manager will not care about them anymore.  The server is not
+ *      grabbed  and  the  MapNotify  events  are  not  waited  for:
+ *      thumbnails  are  first drawn  with  PLACEHOLDER_COLOR  and then
+ *      each  one  is  drawn  as  soon  as its  MapNotify  is  received
+ *      ('expose_event_handle_map_notify').
  *
  *   4/ For each window, create  a new 'window_t' object which will be
  *      then given to 'window_paint_all' function of the core code. If
@@ -59,8 +66,21 @@
  *      ('_expose_prepare_windows'). Then (and each time the window is
  *      repainted), get the Image of  the original window and get each
  *      pixel  which   will  then  be   put  on  the   rescaled  Image
- *      ('_expose_update_scale_pixmap')  using  a Gaussian-filter-like
- *      rescaled algorithm.
+ *      ('_expose_update_scale_pixmap') using a box filter (vectorised
+ *      with SSE2/AVX2  when available, see  'expose_scale.c'), the
+ *      Images being transferred  through MIT-SHM if available.  The
+ *      Images are  rescaled in  parallel by  worker threads  (see
+ *      'expose_pool.c'),  the main loop  only putting the results in
+ *      the Pixmaps.  If the rendering backend  supports it (e.g. Render
+ *      transforms), the window Pixmap  is rather scaled directly in the
+ *      X server when painted.
+ *
+ *   5/ If the rendering backend can scale windows, the windows move
+ *      from their position to their slot  (and back when disabling the
+ *      plugin) over 'expose_animation_time' seconds, their geometry
+ *      being  interpolated  at each  frame  painted  by the  paint timer
+ *      ('_expose_animation_step').  Only the Picture transforms of the
+ *      original windows Pixmaps are updated.
  */
 
 #include <math.h>
@@ -73,7 +93,11 @@
 #include <xcb/xcb_ewmh.h>
 #include <xcb/xcb_keysyms.h>
 #include <xcb/xcb_image.h>
-#include <xcb/xcb_aux.h>
+#include <xcb/shm.h>
+
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 
 #include "structs.h"
 #include "window.h"
@@ -81,7 +105,11 @@
 #include "atoms.h"
 #include "util.h"
 #include "key.h"
-#include "event.h"
+#include "display.h"
+
+#include "expose_scale.h"
+#include "expose_pool.h"
+#include "expose_layout.h"
 
 /** Activation Keysym
  * \todo Remove
@@ -93,22 +121,28 @@
  */
 #define STRIP_SPACING 10
 
-/** Weights values apply  to pixels around a given  pixel value (whose
-    weight is center of the matrice) */
-static const uint32_t _expose_scale_weights[][3] = {
-  { 1, 4, 1},
-  { 4, 10, 4},
-  { 1, 4, 1}
-};
+/** Minimum width and height of a slot, beyond which windows are split
+ *  in pages
+ * \todo Remove
+ */
+#define SLOT_MIN_SIZE 96
+
+/** Keysyms to display the next and previous page of windows
+ * \todo Remove
+ */
+#define PLUGIN_KEY_NEXT_PAGE XK_Next
+#define PLUGIN_KEY_PREVIOUS_PAGE XK_Prior
 
-/** Get each channel component of a 32-bit pixel */
-#define GET_R(pixel, weight) (((pixel) & 0x0000ff) * weight)
-#define GET_G(pixel, weight) GET_R(pixel >> 8, weight)
-#define GET_B(pixel, weight) GET_R(pixel >> 16, weight)
+/** Color of the thumbnails until the window contents are available
+ * \todo Remove
+ */
+#define PLACEHOLDER_COLOR 0x404040
 
-/** From each  channel component, compute  the actual pixel  value but
-    multiply each channel by a weight */
-#define SET_PIXEL(r, g, b, w) ((r / w) | ((g / w) << 8) | ((b / w) << 16))
+/** Maximum  memory used by the  thumbnails kept between activations
+ *  (in bytes)
+ * \todo Remove
+ */
+#define CACHE_BUDGET (64 * 1024 * 1024)
 
 /** Expose window */
 typedef struct
@@ -117,12 +151,70 @@ typedef struct
   window_t *window;
   /** Rescaled image of the window */
   xcb_image_t *image;
+  /** MIT-SHM segment of the rescaled image (if SHM is available) */
+  xcb_shm_segment_info_t image_shm;
+  /** Image of the original window, kept to only get the damaged area
+      of the window on updates */
+  xcb_image_t *window_image;
+  /** MIT-SHM segment of the original window image */
+  xcb_shm_segment_info_t window_image_shm;
   /** Graphical context of the rescaled window pixmap */
   xcb_gcontext_t gc;
   /** If the window was unmapped before enabling the plugin */
   bool was_unmapped;
+  /** If the window is scaled by the rendering backend, thus it simply
+      shares the original window Pixmap */
+  bool is_backend_scaled;
+  /** Whether the original window has been damaged since the last update */
+  bool is_damaged;
+  /** Extents of the damaged area of the original window since the last
+      update (including border) */
+  expose_scale_area_t damaged_area;
+  /** If the thumbnail has been taken from the cache */
+  bool is_cached;
+  /** If the window is being rescaled by a worker thread, its Images
+      must not be touched until done */
+  bool is_pending;
+  /** If the window has been mapped to get its Pixmap, until MapNotify
+      is received */
+  bool is_mapping;
 } _expose_scale_window_t;
 
+/** Rescaling of a window Image by a worker thread */
+typedef struct
+{
+  /** Pool job, must be the first member */
+  expose_pool_job_t job;
+  /** Scale window whose Image is rescaled */
+  _expose_scale_window_t *scale_window;
+  /** Scale window width including border */
+  uint16_t scale_window_width;
+  /** Scale window height including border */
+  uint16_t scale_window_height;
+  /** Original window border width */
+  uint16_t border_width;
+  /** Area of the scale window to rescale */
+  expose_scale_area_t scale_area;
+} _expose_scale_job_t;
+
+/** Thumbnail  kept between activations  of the plugin,  the most
+ *  recently used first */
+typedef struct _expose_cache_entry_t
+{
+  /** Original window identifier */
+  xcb_window_t id;
+  /** Original window width including border when it was scaled */
+  uint16_t window_width;
+  /** Original window height including border when it was scaled */
+  uint16_t window_height;
+  /** Scaled window, updated on damages while the plugin is disabled */
+  _expose_scale_window_t scale_window;
+  /** Memory used by the Images and the Pixmap (in bytes) */
+  uint32_t size;
+  /** Next entry */
+  struct _expose_cache_entry_t *next;
+} _expose_cache_entry_t;
+
 /** Each window is contained within a slot */
 typedef struct
 {
@@ -132,6 +224,9 @@ typedef struct
   window_t *window;
   /** Rescaled window */
   _expose_scale_window_t scale_window;
+  /** Window painted during transitions, sharing the original window
+      Pixmap scaled by the rendering backend */
+  window_t *animation_window;
 } _expose_window_slot_t;
 
 /** Atoms required for this plugin */
@@ -154,8 +249,50 @@ static struct
   bool enabled;
   /** Atoms structure */
   _expose_atoms_t atoms;
-  /** Slots for thumbnails */
+  /** Slots for thumbnails of the current page */
   _expose_window_slot_t *slots;
+  /** Current page of windows */
+  uint32_t page;
+  /** Number of pages of windows */
+  uint32_t pages_n;
+  /** Number of windows mapped  to get their Pixmap whose MapNotify has
+      not been received yet */
+  uint32_t mapping_n;
+  /** Whether  MIT-SHM  is available  to  transfer  the windows  images
+      through shared memory rather than the X connection */
+  bool has_shm;
+  /** Thumbnails kept between activations */
+  _expose_cache_entry_t *cache;
+  /** Memory used by the cached thumbnails (in bytes) */
+  uint32_t cache_size;
+  /** Time of the last activation, until its first frame is on the
+      screen */
+  ev_tstamp activation_time;
+  /** Whether the  first frame since the activation has been rendered,
+      its latency being added once on the screen */
+  bool is_activation_rendered;
+  /** Time from an activation to its first frame on the screen */
+  metrics_latency_histogram_t activation_latency;
+  /** Latency of the last activation (in seconds) */
+  float last_activation_latency;
+  /** Watcher of the worker threads rescaling the windows Images */
+  ev_io pool_watcher;
+  /** Duration of the transitions (in seconds, 0 to disable them) */
+  float animation_time;
+  /** Whether  the  thumbnails  may  be  scaled  by  the  rendering
+      backend in the X server, rather than on the CPU */
+  bool server_scaling;
+  /** Start time of the current transition, 0 if none */
+  ev_tstamp animation_start;
+  /** Whether the  current transition moves the  thumbnails back to the
+      windows position, the plugin being then disabled */
+  bool is_closing;
+  /** Window to activate once the plugin has been disabled */
+  xcb_window_t activate_window;
+  /** Time of the event which selected the window to activate */
+  xcb_timestamp_t activate_timestamp;
+  /** Request a new frame while a transition is running */
+  ev_timer animation_watcher;
 } _expose_global;
 
 /** Called  on  dlopen() to  initialise  memory  areas  and also  send
@@ -183,307 +320,109 @@ expose_constructor(void)
                                          globalconf.screen_nbr);
 }
 
-/** Free all the allocated slots
+/** Create an Image  whose data are  stored in  a MIT-SHM segment
+ *  attached to the X server, so transferring it from or to a Drawable
+ *  does not involve any copy through the X connection
  *
- * \param slots The slots to be freed
+ * \param width The Image width
+ * \param height The Image height
+ * \param depth The Image depth
+ * \param shm The MIT-SHM segment information to fill
+ * \return The new Image or NULL if the segment could not be attached
  */
-static void
-_expose_free_slots(_expose_window_slot_t **slots)
+static xcb_image_t *
+_expose_create_shm_image(const uint16_t width, const uint16_t height,
+			 const uint8_t depth, xcb_shm_segment_info_t *shm)
 {
-  for(_expose_window_slot_t *slot = *slots; slot && slot->window; slot++)
-    {
-      if(slot->scale_window.image)
-	xcb_image_destroy(slot->scale_window.image);
-
-      if(slot->scale_window.gc != XCB_NONE)
-	xcb_free_gc(globalconf.connection, slot->scale_window.gc);
-
-      /* Free the scaled  window Pixmap only if it's  not the original
-	 window one */
-      if(slot->scale_window.window->pixmap != XCB_NONE &&
-	 slot->scale_window.window->geometry->width != slot->window->geometry->width &&
-	 slot->scale_window.window->geometry->height != slot->window->geometry->height)
-	xcb_free_pixmap(globalconf.connection, slot->scale_window.window->pixmap);
-
-      (*globalconf.rendering->free_window)(slot->scale_window.window);
+  /* Only compute the Image format, the data are allocated below */
+  xcb_image_t *image = xcb_image_create_native(globalconf.connection, width,
+					       height, XCB_IMAGE_FORMAT_Z_PIXMAP,
+					       depth, NULL, UINT32_MAX, NULL);
+  if(!image)
+    return NULL;
 
-      free(slot->scale_window.window->geometry);
-      free(slot->scale_window.window);
+  const int shmid = shmget(IPC_PRIVATE, image->size, IPC_CREAT | 0600);
+  if(shmid == -1)
+    {
+      xcb_image_destroy(image);
+      return NULL;
     }
 
-  util_free(slots);
-}
-
-/** Update   the    values   of   _NET_CLIENT_LIST    (required)   and
- *  _NET_ACTIVE_WINDOW (required) if the GetProperty has been sent but
- *  not  already  retrieved  (thus  on  plugin  initialisation  or  on
- *  PropertyNotify event).  This function  also frees the slots if the
- *  clients list has to be updated
- *
- * \param atoms Atoms information
- * \param slots The slots to be freed if necessary
- */
-static void
-_expose_update_atoms_values(_expose_atoms_t *atoms,
-			    _expose_window_slot_t **slots)
-{
-#define CHECK_REQUIRED_ATOM(kind, kind_type, atom_name)			\
-  if(atoms->kind##_cookie.sequence)					\
-    {									\
-      if(!atoms->kind)							\
-	atoms->kind = calloc(1, sizeof(kind_type));			\
-									\
-      if(!xcb_ewmh_get_##kind##_reply(&globalconf.ewmh,                 \
-				      atoms->kind##_cookie,		\
-				      atoms->kind,			\
-				      NULL))				\
-	{								\
-	  warn("Can't get %s: plugin disabled for now", #atom_name);	\
-	  util_free(&atoms->kind);					\
-	}								\
-      else								\
-	_expose_free_slots(slots);					\
-									\
-      /* Reset the cookie sequence for the next request */		\
-      atoms->kind##_cookie.sequence = 0;				\
+  shm->shmid = (uint32_t) shmid;
+  shm->shmaddr = shmat(shmid, NULL, 0);
+  if(shm->shmaddr == (void *) -1)
+    {
+      shmctl(shmid, IPC_RMID, NULL);
+      shm->shmaddr = NULL;
+      xcb_image_destroy(image);
+      return NULL;
     }
 
-  CHECK_REQUIRED_ATOM(client_list, xcb_ewmh_get_windows_reply_t, _NET_CLIENT_LIST)
-  CHECK_REQUIRED_ATOM(active_window, xcb_window_t, _NET_ACTIVE_WINDOW)
-}
-
-/** Check  whether  the plugin  can  actually  be  enabled, only  when
- *  _NET_CLIENT_LIST Atom Property has been set on the root window
- *
- * \todo make the GrabKey completely asynchronous
- * \return true if the plugin can be enabled
- */
-static bool
-expose_check_requirements(void)
-{
-  if(!atoms_is_supported(globalconf.ewmh._NET_CLIENT_LIST))
-    return false;
-
-  _expose_update_atoms_values(&_expose_global.atoms, &_expose_global.slots);
-  if(!_expose_global.atoms.client_list || !_expose_global.atoms.active_window)
-    return false;
-
-  /* Send the GrabKey request on the key given in the configuration */
-  xcb_keycode_t *keycode = keycode = xcb_key_symbols_get_keycode(globalconf.keysyms,
-								 PLUGIN_KEY);
-
-  xcb_void_cookie_t grab_key_cookie = xcb_grab_key_checked(globalconf.connection, false,
-							   globalconf.screen->root,
-							   XCB_NONE, *keycode,
-							   XCB_GRAB_MODE_ASYNC,
-							   XCB_GRAB_MODE_ASYNC);
+  shm->shmseg = xcb_generate_id(globalconf.connection);
 
-  free(keycode);
+  xcb_generic_error_t *error =
+    xcb_request_check(globalconf.connection,
+		      xcb_shm_attach_checked(globalconf.connection, shm->shmseg,
+					     shm->shmid, false));
 
-  /* Check  whether the GrabKey  request succeeded,  otherwise disable
-     the plugin */
-  xcb_generic_error_t *error = xcb_request_check(globalconf.connection,
-						 grab_key_cookie);
+  /* The segment is  destroyed once detached by both  the X server and
+     this process */
+  shmctl(shmid, IPC_RMID, NULL);
 
   if(error)
     {
-      warn("Can't grab selected key");
+      warn("Can't attach MIT-SHM segment");
       free(error);
-      exit(EXIT_FAILURE);
+      shmdt(shm->shmaddr);
+      shm->shmaddr = NULL;
+      xcb_image_destroy(image);
+      return NULL;
     }
 
-  return true;
-}
-
-/** Check whether the window actually needs to be rescaled
- *
- * \param slot_extents The slots rectangle
- * \param window_width The window original width including border
- * \param window_height The window original height including border
- * \return true if the window needs to be rescaled
- */
-static inline bool
-_expose_window_need_rescaling(xcb_rectangle_t *slot_extents,
-			      const uint16_t window_width,
-			      const uint16_t window_height)
-{
-  return slot_extents->width < window_width ||
-    slot_extents->height < window_height;
+  image->data = shm->shmaddr;
+  return image;
 }
 
-/** Create the slots where the  window will be arranged. The screen is
- *  divided in  strips of the same  size whose number is  given by the
- *  square root of the number of windows
+/** Create an Image, using a MIT-SHM segment if available
  *
- * \param nwindows The number of windows
- * \param nwindows_per_strip The number of windows per strip
- * \return The newly allocated slots
+ * \param width The Image width
+ * \param height The Image height
+ * \param depth The Image depth
+ * \param shm The MIT-SHM segment information to fill
+ * \return The new Image
  */
-static _expose_window_slot_t *
-_expose_create_slots(const uint32_t nwindows, unsigned int *nwindows_per_strip)
+static xcb_image_t *
+_expose_create_image(const uint16_t width, const uint16_t height,
+		     const uint8_t depth, xcb_shm_segment_info_t *shm)
 {
-  _expose_window_slot_t *new_slots = calloc(nwindows + 1, sizeof(_expose_window_slot_t));
-  if(!new_slots)
-    return NULL;
-
-  /* The  screen is  divided  in  strips depending  on  the number  of
-     windows */
-  const uint8_t strips_nb = (uint8_t) sqrt(nwindows + 1);
-
-  /* Each strip height excludes spacing */
-  const uint16_t strip_height = (uint16_t) 
-    ((globalconf.screen->height_in_pixels - STRIP_SPACING * (strips_nb + 1)) / strips_nb);
-
-  /* The number of windows per strip depends */
-  *nwindows_per_strip = (unsigned int) ceilf((float) nwindows / (float) strips_nb);
-
-  int16_t current_y = STRIP_SPACING, current_x;
+  xcb_image_t *image = NULL;
 
-  /* Each slot is a rectangle  whose coordinates depends on the number
-     of strips and the number of windows */	
-  unsigned int slot_n = 0;
+  if(_expose_global.has_shm)
+    image = _expose_create_shm_image(width, height, depth, shm);
 
-  /* Create the strips of windows */
-  for(uint8_t strip_n = 0; strip_n < strips_nb; strip_n++)
-    {
-      current_x = STRIP_SPACING;
-
-      /* Number of slots for this strip which depends on the number of
-	 remaining slots (the last strip may contain less windows) */
-      const unsigned int strip_slots_n =
-	(nwindows - slot_n > *nwindows_per_strip ? *nwindows_per_strip : nwindows - slot_n);
-
-      /* Slot width including spacing */
-      const uint16_t slot_width = (uint16_t)
-	((globalconf.screen->width_in_pixels - STRIP_SPACING * (strip_slots_n + 1)) / strip_slots_n);
-
-      /* Now create the slots associated to this strip */
-      for(unsigned int strip_slot = 0; strip_slot < strip_slots_n; strip_slot++)
-	{
-	  new_slots[slot_n].extents.x = current_x;
-	  new_slots[slot_n].extents.y = current_y;
-	  new_slots[slot_n].extents.width = slot_width;
-	  new_slots[slot_n].extents.height = strip_height;
-
-	  current_x = (int16_t) (current_x + slot_width + STRIP_SPACING);
-	  ++slot_n;
-	}
-
-      current_y = (int16_t) (current_y + strip_height + STRIP_SPACING);
-    }
+  if(!image)
+    image = xcb_image_create_native(globalconf.connection, width, height,
+				    XCB_IMAGE_FORMAT_Z_PIXMAP, depth, 0, 0, 0);
 
-  return new_slots;
+  return image;
 }
 
-/** Assign each  window into the  nearest slot based on  the Euclidian
- *  distance between the center of the slot and the window
+/** Destroy an Image previously created by _expose_create_image()
  *
- * \param nwindows The number of windows
- * \param nwindows_per_strip The number of windows per strip
- * \param slots The slots where the window will be assign
+ * \param image The Image
+ * \param shm The MIT-SHM segment information of the Image if any
  */
 static void
-_expose_assign_windows_to_slots(const uint32_t nwindows,
-				const uint32_t nwindows_per_strip,
-				_expose_window_slot_t *slots)
+_expose_destroy_image(xcb_image_t *image, xcb_shm_segment_info_t *shm)
 {
-  struct
-  {
-    window_t *window;
-    /* Coordinates of the window center */
-    int16_t x, y;
-  } windows[nwindows];
-
-  /* Prepare the  windows and their information  before assigning them
-     to a slot */
-  for(uint32_t window_n = 0; window_n < nwindows; window_n++)
-    {
-      window_t *window = window_list_get(_expose_global.atoms.client_list->windows[window_n]);
-
-      windows[window_n].window = window;
-      windows[window_n].x = (int16_t) (window->geometry->x + window->geometry->width / 2);
-      windows[window_n].y = (int16_t) (window->geometry->y + window->geometry->height / 2);
-    }
-
-  /* Assign the windows to its slot using Euclidian distance */
-  for(uint32_t slot_n = 0; slot_n < nwindows; slot_n++)
+  if(shm->shmaddr)
     {
-      const int16_t slot_x = (int16_t) (slots[slot_n].extents.x +
-					slots[slot_n].extents.width / 2);
-
-      const int16_t slot_y = (int16_t) (slots[slot_n].extents.y +
-					slots[slot_n].extents.height / 2);
-
-      int16_t x, y;
-      uint16_t distance, nearest_distance = UINT16_MAX;
-      uint32_t window_n_nearest = 0;
-
-      for(uint32_t window_n = 0; window_n < nwindows; window_n++)
-	{
-	  if(!windows[window_n].window)
-	    continue;
-
-	  x = (int16_t) (windows[window_n].x - slot_x);
-	  y = (int16_t) (windows[window_n].y - slot_y);
-
-	  distance = (uint16_t) sqrt(x * x + y * y);
-
-	  if(distance < nearest_distance)
-	    {
-	      slots[slot_n].window = windows[window_n].window;
-	      window_n_nearest = window_n;
-	      nearest_distance = distance;
-	    }
-	}
-
-      windows[window_n_nearest].window = NULL;
+      xcb_shm_detach(globalconf.connection, shm->shmseg);
+      shmdt(shm->shmaddr);
+      shm->shmaddr = NULL;
     }
 
-  /** Adjust slot width according to the window size
-   * \todo Should also handle the window resize to optimize slot width
-   */
-  for(uint32_t slot_n = 0; slot_n < nwindows; slot_n += nwindows_per_strip)
-    {
-      /* Number of spare pixels */
-      unsigned int slot_spare_pixels = 0;
-      /* Number of slots to extend */
-      unsigned int slots_to_extend_n = 0;
-
-      for(uint32_t window_strip_n = 0; window_strip_n < nwindows_per_strip;
-	  window_strip_n++)
-	{
-	  /* Set the slot width to the window one if the window is smaller */
-	  if(window_width_with_border(slots[window_strip_n].window->geometry) <
-	     slots[window_strip_n].extents.width)
-	    {
-	      slot_spare_pixels += (unsigned int)
-		(slots[window_strip_n].extents.width -
-		 window_width_with_border(slots[window_strip_n].window->geometry));
-
-	      slots[window_strip_n].extents.width = window_width_with_border(slots[window_strip_n].window->geometry);
-	      slots[window_strip_n].extents.x = (int16_t) (slots[window_strip_n].extents.x + (int16_t) slot_spare_pixels);
-	    }
-	  /* Don't do anything if the window is of the same size */
-	  else if(window_width_with_border(slots[window_strip_n].window->geometry) ==
-		  slots[window_strip_n].extents.width)
-	    continue;
-	  /* Number of slots which are going to be extended */
-	  else
-	    slots_to_extend_n++;
-	}
-
-      /* If there is no slot to extend, don't do anything */
-      if(slots_to_extend_n)
-	continue;
-
-      uint16_t spare_pixels_per_slot = (uint16_t) (slot_spare_pixels / slots_to_extend_n);
-
-      for(uint32_t window_strip_n = 0; window_strip_n < nwindows_per_strip;
-	  window_strip_n++)
-	if(window_width_with_border(slots[window_strip_n].window->geometry) >
-	   slots[window_strip_n].extents.width)
-	  slots[window_strip_n].extents.width = (uint16_t) (slots[window_strip_n].extents.width + spare_pixels_per_slot);
-    }
+  xcb_image_destroy(image);
 }
 
 /** Draw the original window border on the scaled window Image
@@ -526,76 +465,33 @@ _expose_draw_scale_window_border(xcb_image_t *scale_window_image,
     }
 }
 
-/** Scale the window content of the given Image according to the given
- *  ratio. It implements a filter similar to Gauss (but with different
- *  weights) which  takes the pixels  arounds and merge  them together
- *  with a weight depending on their position
+/** Scale the  window content  of the  given Image  to the  scaled
+ *  window Image by averaging the pixels covered by each scaled pixel
+ *  (see expose_scale.c)
  *
  * \param scale_window_image The scaled window Image
- * \param scale_window_width The scaled window width including border
- * \param scale_window_height The scaled window height including border
- * \param ratio_rescale The invert of the rescaling ratio
  * \param window_image The original window Image
- * \param window_width The original window width including border
- * \param window_height The original window height including border
- * \param border_width Window border with
+ * \param scale_area The scaled window area to draw, or NULL for all
  */
 static void
 _expose_draw_scale_window_content(xcb_image_t *scale_window_image,
-				  const uint16_t scale_window_width,
-				  const uint16_t scale_window_height,
-				  const double ratio_rescale,
 				  xcb_image_t *window_image,
-				  const uint16_t window_width,
-				  const uint16_t window_height,
-				  const uint16_t border_width)
+				  const expose_scale_area_t *scale_area)
 {
-  uint32_t window_pixels[window_width][window_height];
-
-  /* Get the pixel for optimisation purpose */
-  for(uint16_t x = 0; x < window_width; x++)
-    for(uint16_t y = 0; y < window_height; y++)
-      window_pixels[x][y] = xcb_image_get_pixel(window_image, x, y);
-
-  int16_t ys, xs, ymin, ymax, xmin, xmax;
-
-  const uint16_t scale_content_width = (uint16_t) (scale_window_width - border_width);
-  const uint16_t scale_content_height = (uint16_t) (scale_window_height - border_width);
-
-  const bool do_pixels_around = (1.0 / ratio_rescale) <= 0.90;
-
-  for(uint16_t y_scale = border_width; y_scale < scale_content_height; y_scale++)
+  /* The scaler works on 32-bit pixels, which is always the case of
+     depth 24 and 32 Z-Pixmap images in practice */
+  if(window_image->bpp != 32 || scale_window_image->bpp != 32)
     {
-      ys = (int16_t) trunc((double) y_scale * ratio_rescale);
-
-      /* Compute the minimum and maxmimum y depending on the pixel position */
-      ymin = (int16_t) (y_scale == border_width || !do_pixels_around ? ys : ys - 1);
-      ymax = (int16_t) (y_scale == scale_content_height - 1 || !do_pixels_around ? ys : ys + 1);
-
-      for(uint16_t x_scale = border_width; x_scale < scale_content_width; x_scale++)
-	{
-	  uint32_t moy[3] = { 0, 0, 0 };
-
-	  xs = (int16_t) trunc((double) x_scale * ratio_rescale);
-	  xmin = (int16_t) (x_scale == border_width || !do_pixels_around ? xs : xs - 1);
-	  xmax = (int16_t) (x_scale == scale_content_width - 1 || !do_pixels_around ? xs : xs + 1);
-
-	  uint32_t weight = 0;
-
-	  for(int16_t y = ymin, y_gaussian = (int16_t) (ymin - ys + 1); y <= ymax; y++, y_gaussian++)
-	    for(int16_t x = xmin, x_gaussian = (int16_t) (xmin - xs + 1); x <= xmax; x++, x_gaussian++)
-	      {
-		moy[2] += GET_R(window_pixels[x][y], _expose_scale_weights[x_gaussian][y_gaussian]);
-		moy[1] += GET_G(window_pixels[x][y], _expose_scale_weights[x_gaussian][y_gaussian]);
-		moy[0] += GET_B(window_pixels[x][y], _expose_scale_weights[x_gaussian][y_gaussian]);
-
-		weight += _expose_scale_weights[x_gaussian][y_gaussian];
-	      }
-
-	  xcb_image_put_pixel(scale_window_image, x_scale, y_scale,
-			      SET_PIXEL(moy[2], moy[1], moy[0], weight));
-	}
+      warn("Unsupported Image format (%u bits per pixel)", window_image->bpp);
+      return;
     }
+
+  expose_scale_pixels((const uint32_t *) window_image->data,
+		      window_image->width, window_image->height,
+		      window_image->stride / 4,
+		      (uint32_t *) scale_window_image->data,
+		      scale_window_image->width, scale_window_image->height,
+		      scale_window_image->stride / 4, scale_area);
 }
 
 /** Perform window  rescaling and draw  the borders too which  are not
@@ -605,22 +501,19 @@ _expose_draw_scale_window_content(xcb_image_t *scale_window_image,
  * \param scale_window_width The scale window width including border
  * \param scale_window_height The scale window height including border
  * \param window_image The original window image
- * \param window_width The original window width including border
- * \param window_height The original window height including border
  * \param border_width The border width
+ * \param scale_area The scaled window area to draw, or NULL for all
  */
 static void
 _expose_do_scale_window(xcb_image_t *scale_window_image,
 			const uint16_t scale_window_width,
 			const uint16_t scale_window_height,
 			xcb_image_t *window_image,
-			const uint16_t window_width,
-			const uint16_t window_height,
-			const uint16_t border_width)
+			const uint16_t border_width,
+			const expose_scale_area_t *scale_area)
 {
-  _expose_draw_scale_window_content(scale_window_image, scale_window_width, scale_window_height,
-				    (double) window_width / (double) scale_window_width,
-				    window_image, window_width, window_height, border_width);
+  _expose_draw_scale_window_content(scale_window_image, window_image,
+				    scale_area);
 
   /* A window may have no border at all */
   if(border_width)
@@ -629,76 +522,774 @@ _expose_do_scale_window(xcb_image_t *scale_window_image,
 				     border_width);
 }
 
-/** Update the rescaled window Pixmap
+/** Get the  original window contents  into its Image.  Only the
+ *  damaged area is transferred if  any, unless getting all the window
+ *  through shared memory is cheaper
  *
  * \param scale_window The scale window object
- * \param scale_window_width The scale window width including border
- * \param scale_window_height The scale window height including border
  * \param window The original window object
  * \param window_width The original window width including border
  * \param window_height The original window height including border
+ * \param area The damaged area of the original window, or NULL for all
+ * \return true if the Image has been updated
  */
-static void
-_expose_update_scale_pixmap(_expose_scale_window_t *scale_window,
-			    const uint16_t scale_window_width,
-			    const uint16_t scale_window_height,
-			    const window_t *window,
-			    const uint16_t window_width,
-			    const uint16_t window_height)
+static bool
+_expose_get_window_image(_expose_scale_window_t *scale_window,
+			 const window_t *window,
+			 const uint16_t window_width,
+			 const uint16_t window_height,
+			 const expose_scale_area_t *area)
 {
-  /* Create the image associated with the original window */
-  xcb_image_t *window_image = xcb_image_get(globalconf.connection,
-					    window->pixmap,
-					    0, 0,
-					    window_width,
-					    window_height,
-					    UINT32_MAX, XCB_IMAGE_FORMAT_Z_PIXMAP);
+  xcb_image_t *window_image = scale_window->window_image;
 
-  _expose_do_scale_window(scale_window->image, scale_window_width, scale_window_height,
-			  window_image, window_width, window_height,
-			  window->geometry->border_width);
+  /* The window may have been resized since the Image was got */
+  if(area && window_image && window_image->width == window_width &&
+     window_image->height == window_height &&
+     !(scale_window->window_image_shm.shmaddr &&
+       area->width * area->height * 2 >= (uint32_t) window_width * window_height))
+    {
+      xcb_image_t *area_image = xcb_image_get(globalconf.connection,
+					      window->pixmap,
+					      (int16_t) area->x, (int16_t) area->y,
+					      (uint16_t) area->width,
+					      (uint16_t) area->height,
+					      UINT32_MAX, XCB_IMAGE_FORMAT_Z_PIXMAP);
+
+      if(!area_image)
+	return false;
 
-  xcb_image_put(globalconf.connection, scale_window->window->pixmap,
-		scale_window->gc, scale_window->image, 0, 0, 0);
+      if(area_image->bpp != window_image->bpp)
+	{
+	  xcb_image_destroy(area_image);
+	  return false;
+	}
 
-  xcb_image_destroy(window_image);
+      const uint32_t pixel_size = window_image->bpp / 8;
 
-  scale_window->window->damaged = true;
+      for(uint32_t y = 0; y < area->height; y++)
+	memcpy(window_image->data + (area->y + y) * window_image->stride +
+	       area->x * pixel_size,
+	       area_image->data + y * area_image->stride,
+	       area->width * pixel_size);
+
+      xcb_image_destroy(area_image);
+      return true;
+    }
+
+  /* With  MIT-SHM, the X server  writes the window contents directly
+     in the shared memory segment */
+  if(scale_window->window_image_shm.shmaddr)
+    return xcb_image_shm_get(globalconf.connection, window->pixmap, window_image,
+			     scale_window->window_image_shm, 0, 0, UINT32_MAX);
+
+  window_image = xcb_image_get(globalconf.connection, window->pixmap,
+			       0, 0, window_width, window_height,
+			       UINT32_MAX, XCB_IMAGE_FORMAT_Z_PIXMAP);
+
+  if(!window_image)
+    return false;
+
+  if(scale_window->window_image)
+    xcb_image_destroy(scale_window->window_image);
+
+  scale_window->window_image = window_image;
+  return true;
 }
 
-/** Prepare the rescaled windows which  are going to be painted on the
- *  screen  by creating  the rescale  window  image and  then put  the
- *  pixels in it from the original window
+/** Add the thumbnail to the damaged Region to repaint it
  *
- * \param slots The windows slots
+ * \param scale_window The scale window object
  */
 static void
-_expose_prepare_windows(_expose_window_slot_t *slots)
+_expose_damage_scale_window(_expose_scale_window_t *scale_window)
 {
-  window_t *scale_window_prev = NULL;
+  xcb_rectangle_t rectangle = {
+    scale_window->window->geometry->x,
+    scale_window->window->geometry->y,
+    window_width_with_border(scale_window->window->geometry),
+    window_height_with_border(scale_window->window->geometry)
+  };
+
+  xcb_xfixes_region_t region = xid_generate(XID_TYPE_REGION);
+  xcb_xfixes_create_region(globalconf.connection, region, 1, &rectangle);
+  display_add_damaged_region(&region, true);
+}
 
-  for(_expose_window_slot_t *slot = slots; slot && slot->window; slot++)
+/** Put the rescaled area of the window Image in its Pixmap
+ *
+ * \param scale_window The scale window object
+ * \param scale_area The rescaled area
+ */
+static void
+_expose_put_scale_pixmap(_expose_scale_window_t *scale_window,
+			 const expose_scale_area_t *scale_area)
+{
+  if(scale_window->image_shm.shmaddr)
+    xcb_image_shm_put(globalconf.connection, scale_window->window->pixmap,
+		      scale_window->gc, scale_window->image,
+		      scale_window->image_shm,
+		      (int16_t) scale_area->x, (int16_t) scale_area->y,
+		      (int16_t) scale_area->x, (int16_t) scale_area->y,
+		      (uint16_t) scale_area->width, (uint16_t) scale_area->height,
+		      false);
+  else if(scale_area->width == scale_window->image->width &&
+	  scale_area->height == scale_window->image->height)
+    xcb_image_put(globalconf.connection, scale_window->window->pixmap,
+		  scale_window->gc, scale_window->image, 0, 0, 0);
+  else
     {
-      /* Allocate  the space  needed  for the  scale  window which  is
-	 basically a copy of the window object itself */
-      slot->scale_window.window = calloc(1, sizeof(window_t));
-
-      /* Link the previous element with the current one */
-      if(scale_window_prev)
-	scale_window_prev->next = slot->scale_window.window;
+      xcb_image_t *scale_area_image = xcb_image_subimage(scale_window->image,
+							 scale_area->x, scale_area->y,
+							 scale_area->width,
+							 scale_area->height,
+							 NULL, 0, NULL);
+      if(scale_area_image)
+	{
+	  xcb_image_put(globalconf.connection, scale_window->window->pixmap,
+			scale_window->gc, scale_area_image,
+			(int16_t) scale_area->x, (int16_t) scale_area->y, 0);
 
-      scale_window_prev = slot->scale_window.window;
+	  xcb_image_destroy(scale_area_image);
+	}
+    }
 
-      /* The scale window coordinates are the slot ones */
-      slot->scale_window.window->geometry = calloc(1, sizeof(xcb_get_geometry_reply_t));
-      slot->scale_window.window->geometry->x = slot->extents.x;
-      slot->scale_window.window->geometry->y = slot->extents.y;
-      slot->scale_window.window->geometry->border_width = slot->window->geometry->border_width;
+  scale_window->window->damaged = true;
+}
 
-      slot->scale_window.window->attributes = slot->window->attributes;
+/** Rescale a window Image in a worker thread, which must not send any
+ *  X request
+ *
+ * \param job The rescaling job
+ */
+static void
+_expose_scale_job_run(expose_pool_job_t *job)
+{
+  _expose_scale_job_t *scale_job = (_expose_scale_job_t *) job;
+
+  _expose_do_scale_window(scale_job->scale_window->image,
+			  scale_job->scale_window_width,
+			  scale_job->scale_window_height,
+			  scale_job->scale_window->window_image,
+			  scale_job->border_width,
+			  &scale_job->scale_area);
+}
 
-      const uint16_t window_width = window_width_with_border(slot->window->geometry);
-      const uint16_t window_height = window_height_with_border(slot->window->geometry);
+/** Put the  Images rescaled by the worker  threads in the Pixmaps and
+ *  repaint the thumbnails
+ *
+ * \param jobs The rescaling jobs done
+ */
+static void
+_expose_finish_scale_jobs(expose_pool_job_t *jobs)
+{
+  while(jobs)
+    {
+      _expose_scale_job_t *scale_job = (_expose_scale_job_t *) jobs;
+      jobs = jobs->next;
+
+      scale_job->scale_window->is_pending = false;
+
+      _expose_put_scale_pixmap(scale_job->scale_window, &scale_job->scale_area);
+      _expose_damage_scale_window(scale_job->scale_window);
+
+      free(scale_job);
+    }
+}
+
+/** Called from the main loop when the worker threads have rescaled
+ *  windows Images
+ */
+static void
+_expose_pool_callback(EV_P_ ev_io *w __attribute__((unused)),
+		      int revents __attribute__((unused)))
+{
+  _expose_finish_scale_jobs(expose_pool_take_done());
+}
+
+/** Wait for  all the windows being  rescaled by the worker threads,
+ *  before freeing them
+ */
+static void
+_expose_wait_scale_jobs(void)
+{
+  if(!expose_pool_get_size())
+    return;
+
+  expose_pool_wait();
+  _expose_finish_scale_jobs(expose_pool_take_done());
+}
+
+/** Free the resources of a scaled window
+ *
+ * \param scale_window The scale window object
+ * \param free_pixmap Whether the scaled window owns its Pixmap
+ */
+static void
+_expose_free_scale_window(_expose_scale_window_t *scale_window,
+			  const bool free_pixmap)
+{
+  if(scale_window->image)
+    _expose_destroy_image(scale_window->image, &scale_window->image_shm);
+
+  if(scale_window->window_image)
+    _expose_destroy_image(scale_window->window_image,
+			  &scale_window->window_image_shm);
+
+  if(scale_window->gc != XCB_NONE)
+    {
+      xid_free(XID_TYPE_GC, scale_window->gc);
+      xcb_free_gc(globalconf.connection, scale_window->gc);
+    }
+
+  if(free_pixmap && scale_window->window->pixmap != XCB_NONE)
+    {
+      xid_free(XID_TYPE_PIXMAP, scale_window->window->pixmap);
+      xcb_free_pixmap(globalconf.connection, scale_window->window->pixmap);
+    }
+
+  /* The  Picture  is specific  to the  scaled window, even  if the
+     Pixmap is the original window one */
+  (*globalconf.rendering->free_window_pixmap)(scale_window->window);
+  (*globalconf.rendering->free_window)(scale_window->window);
+
+  free(scale_window->window->geometry);
+  free(scale_window->window);
+}
+
+/** Free a cache entry, which must not be in the cache anymore
+ *
+ * \param entry The cache entry
+ */
+static void
+_expose_cache_free_entry(_expose_cache_entry_t *entry)
+{
+  _expose_free_scale_window(&entry->scale_window, true);
+  free(entry);
+}
+
+/** Take the cached thumbnail of the given window out of the cache
+ *
+ * \param id The original window identifier
+ * \return The cache entry or NULL if not found
+ */
+static _expose_cache_entry_t *
+_expose_cache_take(const xcb_window_t id)
+{
+  for(_expose_cache_entry_t *entry = _expose_global.cache, *entry_prev = NULL;
+      entry; entry_prev = entry, entry = entry->next)
+    if(entry->id == id)
+      {
+	if(entry_prev)
+	  entry_prev->next = entry->next;
+	else
+	  _expose_global.cache = entry->next;
+
+	_expose_global.cache_size -= entry->size;
+	entry->next = NULL;
+	return entry;
+      }
+
+  return NULL;
+}
+
+/** Keep the thumbnail  of  a slot  for the next activations,  evicting
+ *  the least recently used thumbnails to fit in the cache budget
+ *
+ * \param slot The slot whose rescaled window is moved to the cache
+ */
+static void
+_expose_cache_add(_expose_window_slot_t *slot)
+{
+  _expose_cache_entry_t *entry = calloc(1, sizeof(_expose_cache_entry_t));
+
+  entry->id = slot->window->id;
+  entry->window_width = window_width_with_border(slot->window->geometry);
+  entry->window_height = window_height_with_border(slot->window->geometry);
+  entry->scale_window = slot->scale_window;
+  entry->scale_window.window->next = NULL;
+  entry->scale_window.was_unmapped = false;
+
+  /* The Pixmap has the same size as the rescaled Image */
+  entry->size = entry->scale_window.image->size * 2;
+  if(entry->scale_window.window_image)
+    entry->size += entry->scale_window.window_image->size;
+
+  /* Remove any previous thumbnail of this window */
+  _expose_cache_entry_t *old_entry = _expose_cache_take(entry->id);
+  if(old_entry)
+    _expose_cache_free_entry(old_entry);
+
+  entry->next = _expose_global.cache;
+  _expose_global.cache = entry;
+  _expose_global.cache_size += entry->size;
+
+  while(_expose_global.cache_size > CACHE_BUDGET)
+    {
+      _expose_cache_entry_t *lru_entry = _expose_global.cache;
+      while(lru_entry->next)
+	lru_entry = lru_entry->next;
+
+      debug("Evicting thumbnail of %jx from cache", (uintmax_t) lru_entry->id);
+      _expose_cache_free_entry(_expose_cache_take(lru_entry->id));
+    }
+}
+
+/** Free all the cached thumbnails */
+static void
+_expose_cache_free(void)
+{
+  while(_expose_global.cache)
+    _expose_cache_free_entry(_expose_cache_take(_expose_global.cache->id));
+}
+
+/** Free all the allocated slots, the thumbnails scaled by the plugin
+ *  being kept in the cache for the next activations
+ *
+ * \param slots The slots to be freed
+ */
+static void
+_expose_free_slots(_expose_window_slot_t **slots)
+{
+  _expose_wait_scale_jobs();
+
+  for(_expose_window_slot_t *slot = *slots; slot && slot->window; slot++)
+    {
+      if(slot->scale_window.image)
+	{
+	  _expose_cache_add(slot);
+	  continue;
+	}
+
+      /* Free the scaled  window Pixmap only if it's  not the original
+	 window one */
+      _expose_free_scale_window(&slot->scale_window,
+				!slot->scale_window.is_backend_scaled &&
+				slot->scale_window.window->geometry->width != slot->window->geometry->width &&
+				slot->scale_window.window->geometry->height != slot->window->geometry->height);
+    }
+
+  util_free(slots);
+}
+
+/** Update   the    values   of   _NET_CLIENT_LIST    (required)   and
+ *  _NET_ACTIVE_WINDOW (required) if the GetProperty has been sent but
+ *  not  already  retrieved  (thus  on  plugin  initialisation  or  on
+ *  PropertyNotify event).  This function  also frees the slots if the
+ *  clients list has to be updated
+ *
+ * \param atoms Atoms information
+ * \param slots The slots to be freed if necessary
+ */
+static void
+_expose_update_atoms_values(_expose_atoms_t *atoms,
+			    _expose_window_slot_t **slots)
+{
+#define CHECK_REQUIRED_ATOM(kind, kind_type, atom_name)			\
+  if(atoms->kind##_cookie.sequence)					\
+    {									\
+      if(!atoms->kind)							\
+	atoms->kind = calloc(1, sizeof(kind_type));			\
+									\
+      if(!xcb_ewmh_get_##kind##_reply(&globalconf.ewmh,                 \
+				      atoms->kind##_cookie,		\
+				      atoms->kind,			\
+				      NULL))				\
+	{								\
+	  warn("Can't get %s: plugin disabled for now", #atom_name);	\
+	  util_free(&atoms->kind);					\
+	}								\
+      else								\
+	_expose_free_slots(slots);					\
+									\
+      /* Reset the cookie sequence for the next request */		\
+      atoms->kind##_cookie.sequence = 0;				\
+    }
+
+  CHECK_REQUIRED_ATOM(client_list, xcb_ewmh_get_windows_reply_t, _NET_CLIENT_LIST)
+  CHECK_REQUIRED_ATOM(active_window, xcb_window_t, _NET_ACTIVE_WINDOW)
+}
+
+/** Check  whether  the plugin  can  actually  be  enabled, only  when
+ *  _NET_CLIENT_LIST Atom Property has been set on the root window
+ *
+ * \todo make the GrabKey completely asynchronous
+ * \return true if the plugin can be enabled
+ */
+static bool
+expose_check_requirements(void)
+{
+  if(!atoms_is_supported(globalconf.ewmh._NET_CLIENT_LIST))
+    return false;
+
+  _expose_update_atoms_values(&_expose_global.atoms, &_expose_global.slots);
+  if(!_expose_global.atoms.client_list || !_expose_global.atoms.active_window)
+    return false;
+
+  /* Transfer the windows images through shared memory if possible */
+  const xcb_query_extension_reply_t *shm_extension =
+    xcb_get_extension_data(globalconf.connection, &xcb_shm_id);
+
+  _expose_global.has_shm = shm_extension && shm_extension->present;
+
+  _expose_global.animation_time = (float) cfg_getfloat(globalconf.cfg,
+						       "expose_animation_time");
+
+  _expose_global.server_scaling = cfg_getbool(globalconf.cfg,
+					      "expose_server_scaling");
+
+  /* Send the GrabKey request on the key given in the configuration */
+  xcb_keycode_t *keycode = keycode = xcb_key_symbols_get_keycode(globalconf.keysyms,
+								 PLUGIN_KEY);
+
+  xcb_void_cookie_t grab_key_cookie = xcb_grab_key_checked(globalconf.connection, false,
+							   globalconf.screen->root,
+							   XCB_NONE, *keycode,
+							   XCB_GRAB_MODE_ASYNC,
+							   XCB_GRAB_MODE_ASYNC);
+
+  free(keycode);
+
+  /* Check  whether the GrabKey  request succeeded,  otherwise disable
+     the plugin */
+  xcb_generic_error_t *error = xcb_request_check(globalconf.connection,
+						 grab_key_cookie);
+
+  if(error)
+    {
+      warn("Can't grab selected key");
+      free(error);
+      exit(EXIT_FAILURE);
+    }
+
+  /* Rescale the windows Images in parallel on all the CPUs, otherwise
+     they are just rescaled in the main loop */
+  const long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if(expose_pool_init(ncpus > 0 ? (unsigned int) ncpus : 1))
+    {
+      ev_io_init(&_expose_global.pool_watcher, _expose_pool_callback,
+		 expose_pool_get_fd(), EV_READ);
+
+      ev_io_start(globalconf.event_loop, &_expose_global.pool_watcher);
+    }
+  else
+    warn("Can't create worker threads, rescale windows in the main loop");
+
+  return true;
+}
+
+/** Check whether the window actually needs to be rescaled
+ *
+ * \param slot_extents The slots rectangle
+ * \param window_width The window original width including border
+ * \param window_height The window original height including border
+ * \return true if the window needs to be rescaled
+ */
+static inline bool
+_expose_window_need_rescaling(xcb_rectangle_t *slot_extents,
+			      const uint16_t window_width,
+			      const uint16_t window_height)
+{
+  return slot_extents->width < window_width ||
+    slot_extents->height < window_height;
+}
+
+/** Get the size of the rescaled window (not including border) from the
+ *  ratio of the largest side (width or height) of the window
+ *
+ * \param slot The slot of the window
+ * \param width The rescaled window width to fill
+ * \param height The rescaled window height to fill
+ */
+static void
+_expose_get_scale_window_size(const _expose_window_slot_t *slot,
+			      uint16_t *width, uint16_t *height)
+{
+  const uint16_t window_width = window_width_with_border(slot->window->geometry);
+  const uint16_t window_height = window_height_with_border(slot->window->geometry);
+
+  float ratio;
+
+  if((window_width - slot->extents.width) > (window_height - slot->extents.height))
+    ratio = (float) slot->extents.width / (float) window_width;
+  else
+    ratio = (float) slot->extents.height / (float) window_height;
+
+  *width = (uint16_t) floorf(ratio * (float) slot->window->geometry->width);
+  *height = (uint16_t) floorf(ratio * (float) slot->window->geometry->height);
+}
+
+/** Consider the whole original window as damaged
+ *
+ * \param scale_window The scale window object
+ * \param window The original window
+ */
+static void
+_expose_scale_window_damage_all(_expose_scale_window_t *scale_window,
+				const window_t *window)
+{
+  scale_window->is_damaged = true;
+  scale_window->damaged_area.x = 0;
+  scale_window->damaged_area.y = 0;
+  scale_window->damaged_area.width = window_width_with_border(window->geometry);
+  scale_window->damaged_area.height = window_height_with_border(window->geometry);
+}
+
+/** Get the  thumbnail of the  window of  the given slot from  the cache
+ *  if it has been scaled to the same size in a previous activation
+ *
+ * \param slot The slot of the window
+ * \return true if the thumbnail has been found in the cache
+ */
+static bool
+_expose_cache_get(_expose_window_slot_t *slot)
+{
+  _expose_cache_entry_t *entry = _expose_cache_take(slot->window->id);
+  if(!entry)
+    return false;
+
+  const uint16_t window_width = window_width_with_border(slot->window->geometry);
+  const uint16_t window_height = window_height_with_border(slot->window->geometry);
+
+  uint16_t scale_width, scale_height;
+  _expose_get_scale_window_size(slot, &scale_width, &scale_height);
+
+  /* The window or the slot have been resized in the meantime */
+  if(!_expose_window_need_rescaling(&slot->extents, window_width, window_height) ||
+     entry->window_width != window_width || entry->window_height != window_height ||
+     entry->scale_window.window->geometry->width != scale_width ||
+     entry->scale_window.window->geometry->height != scale_height ||
+     entry->scale_window.window->geometry->border_width != slot->window->geometry->border_width)
+    {
+      _expose_cache_free_entry(entry);
+      return false;
+    }
+
+  slot->scale_window = entry->scale_window;
+  slot->scale_window.is_cached = true;
+  free(entry);
+
+  /* The window attributes may have been updated in the meantime */
+  slot->scale_window.window->attributes = slot->window->attributes;
+
+  /* DamageNotify events are ignored for hidden windows */
+  if(slot->window->is_hidden)
+    _expose_scale_window_damage_all(&slot->scale_window, slot->window);
+
+  return true;
+}
+
+/** Create the slots of the given page, each page containing as many
+ *  windows as possible without  slots smaller than SLOT_MIN_SIZE, and
+ *  assign the windows to the slots (see 'expose_layout.c')
+ *
+ * \param page The page number
+ * \return The newly allocated slots, or NULL if there is no window
+ */
+static _expose_window_slot_t *
+_expose_create_page_slots(const uint32_t page)
+{
+  const uint32_t client_list_len = _expose_global.atoms.client_list->windows_len;
+  window_t **windows = malloc(client_list_len * sizeof(window_t *));
+
+  /* Only the windows actually managed can be displayed */
+  uint32_t nwindows = 0;
+  for(uint32_t window_n = 0; window_n < client_list_len; window_n++)
+    {
+      window_t *window = window_list_get(_expose_global.atoms.client_list->windows[window_n]);
+      if(window)
+	windows[nwindows++] = window;
+    }
+
+  const uint32_t page_size =
+    expose_layout_get_page_size(nwindows, globalconf.screen->width_in_pixels,
+				globalconf.screen->height_in_pixels,
+				STRIP_SPACING, SLOT_MIN_SIZE);
+
+  _expose_global.pages_n = (nwindows + page_size - 1) / page_size;
+
+  if(page >= _expose_global.pages_n)
+    {
+      free(windows);
+      return NULL;
+    }
+
+  _expose_global.page = page;
+
+  /* Only the windows of this page get a slot, thus a Pixmap */
+  window_t **page_windows = windows + page * page_size;
+  const uint32_t nslots = (nwindows - page * page_size > page_size ?
+			   page_size : nwindows - page * page_size);
+
+  _expose_window_slot_t *new_slots = calloc(nslots + 1, sizeof(_expose_window_slot_t));
+  expose_layout_rectangle_t *slots_extents = malloc(nslots * sizeof(expose_layout_rectangle_t));
+  expose_layout_rectangle_t *windows_extents = malloc(nslots * sizeof(expose_layout_rectangle_t));
+  uint32_t *assignment = malloc(nslots * sizeof(uint32_t));
+
+  const uint32_t nslots_per_strip =
+    expose_layout_create_slots(nslots, globalconf.screen->width_in_pixels,
+			       globalconf.screen->height_in_pixels,
+			       STRIP_SPACING, slots_extents);
+
+  for(uint32_t window_n = 0; window_n < nslots; window_n++)
+    {
+      const xcb_get_geometry_reply_t *geometry = page_windows[window_n]->geometry;
+
+      windows_extents[window_n].x = geometry->x;
+      windows_extents[window_n].y = geometry->y;
+      windows_extents[window_n].width = window_width_with_border(geometry);
+      windows_extents[window_n].height = window_height_with_border(geometry);
+    }
+
+  expose_layout_assign(nslots, nslots_per_strip, STRIP_SPACING,
+		       windows_extents, slots_extents, assignment);
+
+  for(uint32_t slot_n = 0; slot_n < nslots; slot_n++)
+    {
+      new_slots[slot_n].extents.x = slots_extents[slot_n].x;
+      new_slots[slot_n].extents.y = slots_extents[slot_n].y;
+      new_slots[slot_n].extents.width = slots_extents[slot_n].width;
+      new_slots[slot_n].extents.height = slots_extents[slot_n].height;
+      new_slots[slot_n].window = page_windows[assignment[slot_n]];
+    }
+
+  free(assignment);
+  free(windows_extents);
+  free(slots_extents);
+  free(windows);
+
+  return new_slots;
+}
+
+/** Update the rescaled window Pixmap,  only rescaling the area covered
+ *  by the damaged area of the original window if given. The rescaling
+ *  itself is done by a worker thread if possible, the Pixmap being then
+ *  updated once done ('_expose_finish_scale_jobs')
+ *
+ * \param scale_window The scale window object
+ * \param scale_window_width The scale window width including border
+ * \param scale_window_height The scale window height including border
+ * \param window The original window object
+ * \param window_width The original window width including border
+ * \param window_height The original window height including border
+ * \param area The damaged area of the original window, or NULL for all
+ */
+static void
+_expose_update_scale_pixmap(_expose_scale_window_t *scale_window,
+			    const uint16_t scale_window_width,
+			    const uint16_t scale_window_height,
+			    const window_t *window,
+			    const uint16_t window_width,
+			    const uint16_t window_height,
+			    const expose_scale_area_t *area)
+{
+  if(!_expose_get_window_image(scale_window, window, window_width,
+			       window_height, area))
+    return;
+
+  /* Unless the whole Image has been got again */
+  expose_scale_area_t scale_area = { 0, 0, scale_window_width, scale_window_height };
+  if(area && area->x + area->width <= scale_window->window_image->width &&
+     area->y + area->height <= scale_window->window_image->height)
+    expose_scale_get_area(scale_window->window_image->width,
+			  scale_window->window_image->height,
+			  scale_window_width, scale_window_height, area,
+			  &scale_area);
+
+  if(expose_pool_get_size())
+    {
+      _expose_scale_job_t *scale_job = calloc(1, sizeof(_expose_scale_job_t));
+
+      scale_job->job.run = _expose_scale_job_run;
+      scale_job->scale_window = scale_window;
+      scale_job->scale_window_width = scale_window_width;
+      scale_job->scale_window_height = scale_window_height;
+      scale_job->border_width = window->geometry->border_width;
+      scale_job->scale_area = scale_area;
+
+      scale_window->is_pending = true;
+      expose_pool_submit(&scale_job->job);
+      return;
+    }
+
+  _expose_do_scale_window(scale_window->image, scale_window_width, scale_window_height,
+			  scale_window->window_image, window->geometry->border_width,
+			  &scale_area);
+
+  _expose_put_scale_pixmap(scale_window, &scale_area);
+}
+
+/** Fill the rescaled window Pixmap with PLACEHOLDER_COLOR until the
+ *  window contents are available
+ *
+ * \param scale_window The scale window object
+ * \param scale_window_width The scale window width including border
+ * \param scale_window_height The scale window height including border
+ */
+static void
+_expose_draw_placeholder(_expose_scale_window_t *scale_window,
+			 const uint16_t scale_window_width,
+			 const uint16_t scale_window_height)
+{
+  const uint32_t foreground = PLACEHOLDER_COLOR;
+  xcb_change_gc(globalconf.connection, scale_window->gc,
+		XCB_GC_FOREGROUND, &foreground);
+
+  const xcb_rectangle_t rectangle = { 0, 0, scale_window_width, scale_window_height };
+  xcb_poly_fill_rectangle(globalconf.connection, scale_window->window->pixmap,
+			  scale_window->gc, 1, &rectangle);
+
+  scale_window->window->damaged = true;
+}
+
+/** Prepare the rescaled windows which  are going to be painted on the
+ *  screen  by creating  the rescale  window  image and  then put  the
+ *  pixels in it from the original window
+ *
+ * \param slots The windows slots
+ */
+static void
+_expose_prepare_windows(_expose_window_slot_t *slots)
+{
+  window_t *scale_window_prev = NULL;
+
+  for(_expose_window_slot_t *slot = slots; slot && slot->window; slot++)
+    {
+      /* The Pixmap may have been released to fit in the Pixmaps budget */
+      window_restore_pixmap(slot->window);
+
+      /* Allocate  the space  needed  for the  scale  window which  is
+	 basically a copy of the window object itself */
+      if(!slot->scale_window.is_cached)
+	slot->scale_window.window = calloc(1, sizeof(window_t));
+
+      /* Link the previous element with the current one */
+      if(scale_window_prev)
+	scale_window_prev->next = slot->scale_window.window;
+
+      scale_window_prev = slot->scale_window.window;
+
+      /* The cached thumbnail  only needs to be moved to the slot,  the
+	 area damaged since then will be rescaled when rendering */
+      if(slot->scale_window.is_cached)
+	{
+	  slot->scale_window.window->geometry->x = slot->extents.x;
+	  slot->scale_window.window->geometry->y = slot->extents.y;
+	  slot->scale_window.window->damaged = true;
+
+	  debug("Get %jx from cache", (uintmax_t) slot->window->id);
+	  continue;
+	}
+
+      /* The scale window coordinates are the slot ones */
+      slot->scale_window.window->geometry = calloc(1, sizeof(xcb_get_geometry_reply_t));
+      slot->scale_window.window->geometry->x = slot->extents.x;
+      slot->scale_window.window->geometry->y = slot->extents.y;
+      slot->scale_window.window->geometry->border_width = slot->window->geometry->border_width;
+
+      slot->scale_window.window->attributes = slot->window->attributes;
+
+      const uint16_t window_width = window_width_with_border(slot->window->geometry);
+      const uint16_t window_height = window_height_with_border(slot->window->geometry);
 
       /* If the window does not need to be rescaled, just ignore it */
       if(!_expose_window_need_rescaling(&slot->extents, window_width, window_height))
@@ -706,26 +1297,31 @@ _expose_prepare_windows(_expose_window_slot_t *slots)
 	  slot->scale_window.window->geometry->width = slot->window->geometry->width;
 	  slot->scale_window.window->geometry->height = slot->window->geometry->height;
 	  slot->scale_window.window->pixmap = slot->window->pixmap;
-	  slot->scale_window.window->damaged = true;
+	  slot->scale_window.window->damaged = (slot->window->pixmap != XCB_NONE);
 
 	  debug("Don't scale %jx", (uintmax_t) slot->window->id);
 	  continue;
 	}
 
-      float ratio;
-
-      /* Compute the ratio from the  largest side (width or height) of
-	 the window */
-      if((window_width - slot->extents.width) > (window_height - slot->extents.height))
-	ratio = (float) slot->extents.width / (float) window_width;
-      else
-	ratio = (float) slot->extents.height / (float) window_height;
+      _expose_get_scale_window_size(slot,
+				    &slot->scale_window.window->geometry->width,
+				    &slot->scale_window.window->geometry->height);
 
-      slot->scale_window.window->geometry->width = (uint16_t)
-	floorf(ratio * (float) slot->window->geometry->width);
+      /* Let the rendering backend  scale the original window Pixmap in
+	 the X server if possible, thus no pixels are transferred */
+      if(_expose_global.server_scaling &&
+	 globalconf.rendering->set_window_scale &&
+	 (*globalconf.rendering->set_window_scale)(slot->scale_window.window,
+						    window_width, window_height))
+	{
+	  slot->scale_window.is_backend_scaled = true;
+	  slot->scale_window.window->is_rectangular = true;
+	  slot->scale_window.window->pixmap = slot->window->pixmap;
+	  slot->scale_window.window->damaged = (slot->window->pixmap != XCB_NONE);
 
-      slot->scale_window.window->geometry->height = (uint16_t)
-	floorf(ratio * (float) slot->window->geometry->height);
+	  debug("Scale %jx in the X server", (uintmax_t) slot->window->id);
+	  continue;
+	}
 
       /* The geometry width and height never include the border width */
       const uint16_t scale_window_width =
@@ -735,14 +1331,21 @@ _expose_prepare_windows(_expose_window_slot_t *slots)
 	window_height_with_border(slot->scale_window.window->geometry);
 
       /* Create the image associated with the rescaled window */
-      slot->scale_window.image = xcb_image_create_native(globalconf.connection,
-							 scale_window_width,
-							 scale_window_height,
-							 XCB_IMAGE_FORMAT_Z_PIXMAP,
-							 24, 0, 0, 0);
+      slot->scale_window.image = _expose_create_image(scale_window_width,
+						      scale_window_height, 24,
+						      &slot->scale_window.image_shm);
+
+      /* The original window image is  kept to only get the damaged area
+	 afterwards, allocated by  xcb_image_get() unless it can be got
+	 through shared memory */
+      if(_expose_global.has_shm)
+	slot->scale_window.window_image =
+	  _expose_create_shm_image(window_width, window_height,
+				   slot->window->geometry->depth,
+				   &slot->scale_window.window_image_shm);
 
       /* Create the rescaled window Pixmap and put the image in it */
-      slot->scale_window.window->pixmap = xcb_generate_id(globalconf.connection);
+      slot->scale_window.window->pixmap = xid_generate(XID_TYPE_PIXMAP);
 
       xcb_create_pixmap(globalconf.connection, 24,
 			slot->scale_window.window->pixmap,
@@ -750,14 +1353,19 @@ _expose_prepare_windows(_expose_window_slot_t *slots)
 			scale_window_width,
 			scale_window_height);
 
-      slot->scale_window.gc = xcb_generate_id(globalconf.connection);
+      slot->scale_window.gc = xid_generate(XID_TYPE_GC);
 
       xcb_create_gc(globalconf.connection, slot->scale_window.gc,
 		    slot->scale_window.window->pixmap, 0, NULL);
 
-      _expose_update_scale_pixmap(&slot->scale_window, scale_window_width,
-				  scale_window_height, slot->window,
-				  window_width, window_height);
+      /* The window contents will be available on MapNotify */
+      if(slot->scale_window.is_mapping)
+	_expose_draw_placeholder(&slot->scale_window, scale_window_width,
+				 scale_window_height);
+      else
+	_expose_update_scale_pixmap(&slot->scale_window, scale_window_width,
+				    scale_window_height, slot->window,
+				    window_width, window_height, NULL);
     }
 
 #ifdef __DEBUG__
@@ -777,44 +1385,85 @@ _expose_prepare_windows(_expose_window_slot_t *slots)
 #endif
 }
 
-/** Enable  the plugin  by  creating  the windows  slots  and map  the
- *  windows which are not already mapped, then fits the windows in the
- *  slots and create their Pixmap, and finally repaint the screen
+/** Repaint the whole screen, when enabling or disabling the plugin */
+static void
+_expose_damage_screen(void)
+{
+  xcb_rectangle_t rectangle = { 0, 0,
+				globalconf.screen->width_in_pixels,
+				globalconf.screen->height_in_pixels };
+
+  xcb_xfixes_region_t region = xid_generate(XID_TYPE_REGION);
+  xcb_xfixes_create_region(globalconf.connection, region, 1, &rectangle);
+  display_add_damaged_region(&region, true);
+}
+
+/** Get the thumbnails from the cache if possible and map the windows
+ *  which are not already mapped to get their Pixmap
  *
- * \param nwindows The numbers of windows on the screen
- * \return The newly allocated slots
+ * \param new_slots The windows slots
  */
-static _expose_window_slot_t *
-_expose_plugin_enable(const uint32_t nwindows)
+static void
+_expose_map_windows(_expose_window_slot_t *new_slots)
 {
-  unsigned int nwindows_per_strip;
-
-  _expose_window_slot_t *new_slots = _expose_create_slots(nwindows,
-							  &nwindows_per_strip);
-  if(!new_slots)
-    return NULL;
-
-  _expose_assign_windows_to_slots(nwindows, nwindows_per_strip, new_slots);
-
-  xcb_grab_server(globalconf.connection);
+  /* Reuse the thumbnails of the previous activations if possible,  an
+     unmapped window whose thumbnail is up-to-date does not need to be
+     mapped as its contents cannot change */
+  for(_expose_window_slot_t *slot = new_slots; slot && slot->window; slot++)
+    _expose_cache_get(slot);
 
   /* Map windows which where  unmapped otherwise the window content is
-     not guaranteed to be preserved while the window is unmapped */
+     not guaranteed to be preserved while the window is unmapped.  The
+     server is not grabbed  and MapNotify is not waited for: the
+     thumbnail is drawn once received ('expose_event_handle_map_notify') */
   for(_expose_window_slot_t *slot = new_slots; slot && slot->window; slot++)
     if(slot->window->attributes->map_state != XCB_MAP_STATE_VIEWABLE &&
-       !slot->scale_window.was_unmapped)
+       !slot->scale_window.was_unmapped &&
+       (!slot->scale_window.is_cached || slot->scale_window.is_damaged))
       {
 	window_get_invisible_window_pixmap(slot->window);
 	slot->scale_window.was_unmapped = true;
+	slot->scale_window.is_mapping = true;
+	_expose_global.mapping_n++;
+
+	if(slot->scale_window.is_cached)
+	  _expose_scale_window_damage_all(&slot->scale_window, slot->window);
       }
+}
 
-  /** Process MapNotify event to get the NameWindowPixmap
-   *  \todo get only MapNotify? */
-  xcb_aux_sync(globalconf.connection);
-  
-  event_handle_poll_loop(event_handle);
+/** Unmap the  windows which were unmapped  before being displayed and
+ *  also restore override redirect, then free the slots
+ *
+ * \param slots The windows slots, freed
+ */
+static void
+_expose_unmap_windows(_expose_window_slot_t **slots)
+{
+  for(_expose_window_slot_t *slot = *slots; slot && slot->window; slot++)
+    if(slot->scale_window.was_unmapped)
+      window_get_invisible_window_pixmap_finalise(slot->window);
+
+  _expose_global.mapping_n = 0;
+
+  /* Keep the thumbnails for the next activation */
+  _expose_free_slots(slots);
+}
+
+/** Enable  the plugin  by  creating  the windows  slots  of the first
+ *  page  and map  the windows which  are not already mapped, then fits
+ *  the windows in the slots and create their Pixmap, and finally
+ *  repaint the screen
+ *
+ * \return The newly allocated slots
+ */
+static _expose_window_slot_t *
+_expose_plugin_enable(void)
+{
+  _expose_window_slot_t *new_slots = _expose_create_page_slots(0);
+  if(!new_slots)
+    return NULL;
 
-  xcb_ungrab_server(globalconf.connection);
+  _expose_map_windows(new_slots);
 
   /** Grab the pointer in an  active way to avoid EnterNotify event due
    *  to the mapping hack
@@ -851,11 +1500,8 @@ _expose_plugin_enable(const uint32_t nwindows)
       _expose_free_slots(&new_slots);
     }
   else
-    {
-      /* The plugin is now enabled, so paint the screen */
-      /* TODO-PERF: globalconf.do_repaint = true; */
-      ;
-    }
+    /* The plugin is now enabled, so paint the screen */
+    _expose_damage_screen();
 
   free(grab_pointer_reply);
   free(grab_keyboard_reply);
@@ -863,19 +1509,43 @@ _expose_plugin_enable(const uint32_t nwindows)
   return new_slots;
 }
 
+/** Stop the current transition and free the windows painted meanwhile */
+static void
+_expose_animation_stop(void)
+{
+  if(!_expose_global.animation_start)
+    return;
+
+  ev_timer_stop(globalconf.event_loop, &_expose_global.animation_watcher);
+  _expose_global.animation_start = 0;
+
+  for(_expose_window_slot_t *slot = _expose_global.slots; slot && slot->window; slot++)
+    {
+      window_t *animation_window = slot->animation_window;
+      if(!animation_window)
+	continue;
+
+      /* Only the Picture is specific, the Pixmap is the original window one */
+      (*globalconf.rendering->free_window_pixmap)(animation_window);
+      (*globalconf.rendering->free_window)(animation_window);
+
+      free(animation_window->geometry);
+      free(animation_window);
+      slot->animation_window = NULL;
+    }
+}
+
 /** Disable the  plugin by unmapping  the windows which  were unmapped
- *  before enabling the plugin and then repaint the screen again
+ *  before enabling the plugin, moving the thumbnails to the cache and
+ *  then repaint the screen again
  *
- * \param slots The windows slots
+ * \param slots The windows slots, freed
  */
 static void
-_expose_plugin_disable(_expose_window_slot_t *slots)
+_expose_plugin_disable(_expose_window_slot_t **slots)
 {
-  /* Unmap the  window which were  previously mapped and  also restore
-     override redirect */
-  for(_expose_window_slot_t *slot = slots; slot && slot->window; slot++)
-    if(slot->scale_window.was_unmapped)
-      window_get_invisible_window_pixmap_finalise(slot->window);
+  _expose_animation_stop();
+  _expose_unmap_windows(slots);
 
   /* Now ungrab both the keyboard and the pointer */
   xcb_ungrab_keyboard(globalconf.connection, XCB_CURRENT_TIME);
@@ -883,11 +1553,389 @@ _expose_plugin_disable(_expose_window_slot_t *slots)
 
   /* Force repaint of the screen as the plugin is now disabled */
   _expose_global.enabled = false;
-  /* TODO-PERF: globalconf.do_repaint = true; */
+  _expose_damage_screen();
+}
+
+/** Request a new  frame of the current  transition at each  repaint
+ *  interval, the frames being then painted by the paint timer
+ *
+ * \param w The timer watcher
+ * \param revents Unused
+ */
+static void
+_expose_animation_callback(EV_P_ ev_timer *w,
+			   int revents __attribute__((unused)))
+{
+  _expose_damage_screen();
+
+  w->repeat = globalconf.repaint_interval;
+  ev_timer_again(EV_A_ w);
+}
+
+/** Create the windows painted during a  transition, which are copies of
+ *  the original windows whose Pixmap is scaled by the rendering backend
+ *  to the interpolated geometry
+ *
+ * \return false if the rendering backend cannot scale the windows
+ */
+static bool
+_expose_animation_create_windows(void)
+{
+  if(!globalconf.rendering->set_window_scale)
+    return false;
+
+  window_t *animation_window_prev = NULL;
+
+  for(_expose_window_slot_t *slot = _expose_global.slots; slot && slot->window; slot++)
+    {
+      window_t *animation_window = calloc(1, sizeof(window_t));
+      slot->animation_window = animation_window;
+
+      animation_window->geometry = calloc(1, sizeof(xcb_get_geometry_reply_t));
+      *animation_window->geometry = *slot->window->geometry;
+      animation_window->attributes = slot->window->attributes;
+      animation_window->pixmap = slot->window->pixmap;
+      animation_window->is_rectangular = true;
+
+      if(!(*globalconf.rendering->set_window_scale)(animation_window,
+						     window_width_with_border(slot->window->geometry),
+						     window_height_with_border(slot->window->geometry)))
+	return false;
+
+      if(animation_window_prev)
+	animation_window_prev->next = animation_window;
+
+      animation_window_prev = animation_window;
+    }
+
+  return true;
+}
+
+/** Start  a transition  between  the windows  position and  their
+ *  thumbnail, or reverse the current one from its current state
+ *
+ * \param is_closing Whether the thumbnails move back to the windows
+ * \return false if there is no transition, thus nothing to wait for
+ */
+static bool
+_expose_animation_begin(const bool is_closing)
+{
+  if(_expose_global.animation_time <= 0)
+    return false;
+
+  const ev_tstamp now = ev_time();
+
+  if(_expose_global.animation_start)
+    {
+      ev_tstamp elapsed = now - _expose_global.animation_start;
+      if(elapsed > _expose_global.animation_time)
+	elapsed = _expose_global.animation_time;
+
+      _expose_global.animation_start = now - (_expose_global.animation_time - elapsed);
+    }
+  else
+    {
+      /* animation_start must be set to free the windows */
+      _expose_global.animation_start = now;
+
+      if(!_expose_animation_create_windows())
+	{
+	  _expose_animation_stop();
+	  return false;
+	}
+
+      ev_timer_init(&_expose_global.animation_watcher, _expose_animation_callback,
+		    0, globalconf.repaint_interval);
+
+      ev_timer_start(globalconf.event_loop, &_expose_global.animation_watcher);
+    }
+
+  _expose_global.is_closing = is_closing;
+  return true;
+}
+
+/** Disable the plugin  and  activate the selected  window if any, once
+ *  the thumbnails have moved back to the windows position
+ */
+static void
+_expose_plugin_close(void)
+{
+  const xcb_window_t window_id = _expose_global.activate_window;
+
+  _expose_plugin_disable(&_expose_global.slots);
+
+  if(window_id != XCB_NONE)
+    xcb_ewmh_request_change_active_window(&globalconf.ewmh, globalconf.screen_nbr,
+					  window_id,
+					  XCB_EWMH_CLIENT_SOURCE_TYPE_OTHER,
+					  _expose_global.activate_timestamp,
+					  XCB_NONE);
+}
+
+/** Interpolate a coordinate or dimension
+ *
+ * \param from The value at the windows position
+ * \param to The value at the thumbnail position
+ * \param progress The progress between both, from 0 to 1
+ * \return The interpolated value
+ */
+static inline int32_t
+_expose_animation_interpolate(const int32_t from, const int32_t to,
+			      const float progress)
+{
+  return from + (int32_t) lroundf((float) (to - from) * progress);
+}
+
+/** Compute the current  frame of  the transition,  ending it  when the
+ *  last one has been reached
+ *
+ * \return The windows to paint, NULL if the transition has ended
+ */
+static window_t *
+_expose_animation_step(void)
+{
+  /* The  geometry is  interpolated for  the time  the  frame will be
+     displayed according to the average painting time, a frame being
+     late just skips the intermediate steps rather than slowing down the
+     transition and the input handling */
+  const float paint_time = globalconf.paint_counter ?
+    globalconf.paint_time_sum / (float) globalconf.paint_counter : 0;
+
+  float progress = (float) (ev_time() + paint_time - _expose_global.animation_start) /
+    _expose_global.animation_time;
+
+  if(progress >= 1)
+    {
+      if(_expose_global.is_closing)
+	_expose_plugin_close();
+      else
+	{
+	  _expose_animation_stop();
+	  _expose_damage_screen();
+	}
+
+      return NULL;
+    }
+
+  /* Ease in and out */
+  progress = progress * progress * (3 - 2 * progress);
+  if(_expose_global.is_closing)
+    progress = 1 - progress;
+
+  for(_expose_window_slot_t *slot = _expose_global.slots; slot && slot->window; slot++)
+    {
+      const xcb_get_geometry_reply_t *from = slot->window->geometry;
+      const xcb_get_geometry_reply_t *to = slot->scale_window.window->geometry;
+      window_t *animation_window = slot->animation_window;
+
+      animation_window->geometry->x = (int16_t)
+	_expose_animation_interpolate(from->x, to->x, progress);
+      animation_window->geometry->y = (int16_t)
+	_expose_animation_interpolate(from->y, to->y, progress);
+      animation_window->geometry->width = (uint16_t)
+	_expose_animation_interpolate(from->width, to->width, progress);
+      animation_window->geometry->height = (uint16_t)
+	_expose_animation_interpolate(from->height, to->height, progress);
+
+      /* The window Pixmap is only available on MapNotify if it was
+	 unmapped */
+      if(animation_window->pixmap != slot->window->pixmap)
+	{
+	  (*globalconf.rendering->free_window_pixmap)(animation_window);
+	  animation_window->pixmap = slot->window->pixmap;
+	}
+
+      /* Only update the Picture transform, no pixels are transferred */
+      (*globalconf.rendering->set_window_scale)(animation_window,
+						 window_width_with_border(from),
+						 window_height_with_border(from));
+
+      animation_window->damaged = (animation_window->pixmap != XCB_NONE);
+    }
+
+  return _expose_global.slots[0].animation_window;
+}
+
+/** Record  the  damaged area  of  the original window, which  will be
+ *  the only area rescaled when the thumbnail is updated
+ *
+ * \param scale_window The scale window object
+ * \param window The damaged window
+ * \param event The X DamageNotify event
+ * \return true if the scale window was not already damaged
+ */
+static bool
+_expose_scale_window_add_damage(_expose_scale_window_t *scale_window,
+				const window_t *window,
+				const xcb_damage_notify_event_t *event)
+{
+  const uint16_t window_width = window_width_with_border(window->geometry);
+  const uint16_t window_height = window_height_with_border(window->geometry);
+
+  /* The  damaged area is  relative to the  window origin,  inside the
+     border,  whereas the window  Pixmap includes the border. Besides,
+     the core  ignores further DamageNotify  once the window  is fully
+     damaged, so consider it entirely damaged in this case */
+  int32_t x = 0, y = 0, x_end = window_width, y_end = window_height;
+  if(window->damaged_ratio < WINDOW_FULLY_DAMAGED_RATIO)
+    {
+      x = event->area.x + window->geometry->border_width;
+      y = event->area.y + window->geometry->border_width;
+      x_end = x + event->area.width;
+      y_end = y + event->area.height;
+
+      if(x < 0)
+	x = 0;
+      if(y < 0)
+	y = 0;
+      if(x_end > window_width)
+	x_end = window_width;
+      if(y_end > window_height)
+	y_end = window_height;
+    }
+
+  if(x_end <= x || y_end <= y)
+    return false;
+
+  const bool was_damaged = scale_window->is_damaged;
+  if(was_damaged)
+    {
+      expose_scale_area_t *area = &scale_window->damaged_area;
+
+      if(x_end < (int32_t) (area->x + area->width))
+	x_end = (int32_t) (area->x + area->width);
+      if(y_end < (int32_t) (area->y + area->height))
+	y_end = (int32_t) (area->y + area->height);
+      if(x > (int32_t) area->x)
+	x = (int32_t) area->x;
+      if(y > (int32_t) area->y)
+	y = (int32_t) area->y;
+    }
+
+  scale_window->is_damaged = true;
+  scale_window->damaged_area.x = (uint32_t) x;
+  scale_window->damaged_area.y = (uint32_t) y;
+  scale_window->damaged_area.width = (uint32_t) (x_end - x);
+  scale_window->damaged_area.height = (uint32_t) (y_end - y);
+
+  return !was_damaged;
+}
+
+/** Handle  X DamageNotify event by  recording the damaged area  of the
+ *  original window and  repainting its thumbnail. When the plugin  is
+ *  disabled, the damage is recorded on the cached thumbnail if any, to
+ *  only update this area on the next activation
+ *
+ * \param event The X DamageNotify event
+ * \param window The damaged window
+ */
+static void
+expose_event_handle_damage_notify(xcb_damage_notify_event_t *event,
+				  window_t *window)
+{
+  if(!_expose_global.enabled)
+    {
+      for(_expose_cache_entry_t *entry = _expose_global.cache; entry;
+	  entry = entry->next)
+	if(entry->id == window->id)
+	  {
+	    _expose_scale_window_add_damage(&entry->scale_window, window, event);
+	    break;
+	  }
+
+      return;
+    }
+
+  _expose_window_slot_t *slot;
+  for(slot = _expose_global.slots; slot && slot->window; slot++)
+    if(slot->window == window)
+      break;
+
+  if(!slot || !slot->window)
+    return;
+
+  _expose_scale_window_t *scale_window = &slot->scale_window;
+
+  /* Repaint the thumbnail, only once until it is updated */
+  if(_expose_scale_window_add_damage(scale_window, window, event))
+    _expose_damage_scale_window(scale_window);
+}
+
+/** Handle  MapNotify  of  windows  mapped  on  activation  to get  their
+ *  Pixmap, which is now available to draw the thumbnail in place of the
+ *  placeholder
+ *
+ * \param event The X MapNotify event
+ * \param window The window object
+ */
+static void
+expose_event_handle_map_notify(xcb_map_notify_event_t *event __attribute__((unused)),
+			       window_t *window)
+{
+  if(!_expose_global.enabled)
+    return;
+
+  _expose_window_slot_t *slot;
+  for(slot = _expose_global.slots; slot && slot->window; slot++)
+    if(slot->window == window)
+      break;
+
+  if(!slot || !slot->window || !slot->scale_window.is_mapping)
+    return;
+
+  slot->scale_window.is_mapping = false;
+
+  /* The placeholder has to be replaced by the whole window contents */
+  if(slot->scale_window.image)
+    _expose_scale_window_damage_all(&slot->scale_window, window);
+
+  _expose_damage_scale_window(&slot->scale_window);
+
+  if(!--_expose_global.mapping_n)
+    debug("All the windows mapped on activation are now available");
+}
+
+/** Handle  X DestroyNotify event by  dropping the cached thumbnail of
+ *  the window if any
+ *
+ * \param event The X DestroyNotify event
+ * \param window The destroyed window
+ */
+static void
+expose_event_handle_destroy_notify(xcb_destroy_notify_event_t *event __attribute__((unused)),
+				   window_t *window)
+{
+  _expose_cache_entry_t *entry = _expose_cache_take(window->id);
+  if(entry)
+    _expose_cache_free_entry(entry);
+}
+
+/** Display another  page of windows,  the thumbnails of the current
+ *  one being kept in the cache
+ *
+ * \param page The page number
+ */
+static void
+_expose_set_page(const uint32_t page)
+{
+  _expose_unmap_windows(&_expose_global.slots);
+
+  _expose_global.slots = _expose_create_page_slots(page);
+  if(!_expose_global.slots)
+    {
+      warn("Couldn't create the slots");
+      _expose_plugin_disable(&_expose_global.slots);
+      return;
+    }
+
+  _expose_map_windows(_expose_global.slots);
+  _expose_prepare_windows(_expose_global.slots);
+  _expose_damage_screen();
 }
 
 /** When receiving a KeyRelease  event, just enable/disable the plugin
- *  if the plugin shortcuts key has been pressed and released
+ *  if the plugin shortcuts key has been pressed and released, or
+ *  display another page of windows
  *
  * \param event The X KeyPress event
  */
@@ -895,11 +1943,37 @@ static void
 expose_event_handle_key_release(xcb_key_release_event_t *event,
 				window_t *window __attribute__((unused)))
 {
-  if(key_getkeysym(event->detail, event->state) != PLUGIN_KEY)
+  const xcb_keysym_t keysym = key_getkeysym(event->detail, event->state);
+
+  if(_expose_global.enabled && _expose_global.pages_n > 1 &&
+     !_expose_global.animation_start &&
+     (keysym == PLUGIN_KEY_NEXT_PAGE || keysym == PLUGIN_KEY_PREVIOUS_PAGE))
+    {
+      const uint32_t pages_n = _expose_global.pages_n;
+
+      _expose_set_page(keysym == PLUGIN_KEY_NEXT_PAGE ?
+		       (_expose_global.page + 1) % pages_n :
+		       (_expose_global.page + pages_n - 1) % pages_n);
+
+      return;
+    }
+
+  if(keysym != PLUGIN_KEY)
     return;
 
   if(_expose_global.enabled)
-    _expose_plugin_disable(_expose_global.slots);
+    {
+      /* Move the thumbnails back to the windows position */
+      if(_expose_global.animation_start && _expose_global.is_closing)
+	_expose_animation_begin(false);
+      else
+	{
+	  _expose_global.activate_window = XCB_NONE;
+
+	  if(!_expose_animation_begin(true))
+	    _expose_plugin_disable(&_expose_global.slots);
+	}
+    }
   else
     {
       /* Update the  atoms values  now if it  has been changed  in the
@@ -911,12 +1985,16 @@ expose_event_handle_key_release(xcb_key_release_event_t *event,
       const uint32_t nwindows = _expose_global.atoms.client_list->windows_len;
       if(nwindows)
 	{
-	  _expose_global.slots = _expose_plugin_enable(nwindows);
+	  _expose_global.activation_time = ev_time();
+	  _expose_global.slots = _expose_plugin_enable();
 
 	  if(!_expose_global.slots)
 	    warn("Couldn't create the slots");
 	  else
-	    _expose_global.enabled = true;
+	    {
+	      _expose_global.enabled = true;
+	      _expose_animation_begin(false);
+	    }
 	}
     }
 }
@@ -947,19 +2025,21 @@ static void
 expose_event_handle_button_release(xcb_button_release_event_t *event,
 				   window_t *window __attribute__ ((unused)))
 {
-  for(uint32_t window_n = 0;
-      window_n < _expose_global.atoms.client_list->windows_len;
-      window_n++)
+  if(!_expose_global.enabled ||
+     (_expose_global.animation_start && _expose_global.is_closing))
+    return;
+
+  for(_expose_window_slot_t *slot = _expose_global.slots; slot && slot->window; slot++)
     {
       if(_expose_in_window(event->root_x, event->root_y,
-			   _expose_global.slots[window_n].scale_window.window))
+			   slot->scale_window.window))
 	{
-	  _expose_plugin_disable(_expose_global.slots);
+	  /* The slots are freed when disabling the plugin */
+	  _expose_global.activate_window = slot->window->id;
+	  _expose_global.activate_timestamp = event->time;
 
-	  xcb_ewmh_request_change_active_window(&globalconf.ewmh, globalconf.screen_nbr,
-						_expose_global.slots[window_n].window->id,
-						XCB_EWMH_CLIENT_SOURCE_TYPE_OTHER,
-						event->time, XCB_NONE);
+	  if(!_expose_animation_begin(true))
+	    _expose_plugin_close();
 
 	  break;
 	}
@@ -1021,19 +2101,110 @@ expose_render_windows(void)
     {
       const uint16_t window_width = window_width_with_border(slot->window->geometry);
       const uint16_t window_height = window_height_with_border(slot->window->geometry);
-
-      if(_expose_window_need_rescaling(&slot->extents, window_width, window_height))
-	_expose_update_scale_pixmap(&slot->scale_window,
-				    window_width_with_border(slot->scale_window.window->geometry),
-				    window_height_with_border(slot->scale_window.window->geometry),
-				    slot->window, window_width, window_height);
+      _expose_scale_window_t *scale_window = &slot->scale_window;
+      const bool was_pending = scale_window->is_pending;
+
+      /* Only rescale the  area of  the window damaged since  the last
+	 update, thumbnails of idle windows are left untouched, as well as
+	 the placeholder until the window Pixmap has been received */
+      if(!slot->scale_window.is_backend_scaled &&
+	 _expose_window_need_rescaling(&slot->extents, window_width, window_height))
+	{
+	  /* Wait for the worker thread to finish the previous update */
+	  if(scale_window->is_damaged && !scale_window->is_pending &&
+	     slot->window->pixmap != XCB_NONE)
+	    _expose_update_scale_pixmap(scale_window,
+					window_width_with_border(scale_window->window->geometry),
+					window_height_with_border(scale_window->window->geometry),
+					slot->window, window_width, window_height,
+					&scale_window->damaged_area);
+	  else
+	    continue;
+	}
+      /* The window contents are  scaled when painted (if at all), just
+	 follow the window Pixmap which may have been named again in the
+	 meantime, or only on MapNotify */
       else
-	slot->scale_window.window->damaged = true;
+	{
+	  if(slot->scale_window.window->pixmap != slot->window->pixmap)
+	    {
+	      (*globalconf.rendering->free_window_pixmap)(slot->scale_window.window);
+	      slot->scale_window.window->pixmap = slot->window->pixmap;
+	    }
+
+	  slot->scale_window.window->damaged = (slot->window->pixmap != XCB_NONE);
+	}
+
+      /* As done  by the core  when painting  a window, reset  the damage
+	 state of the original window to get the next DamageNotify (the
+	 damaged area is kept if the update has been delayed) */
+      if(scale_window->is_damaged)
+	{
+	  scale_window->is_damaged = was_pending;
+
+	  slot->window->damaged_ratio = 0.0;
+	  slot->window->damage_notify_counter = 0;
+
+	  xcb_damage_subtract(globalconf.connection, slot->window->damage,
+			      XCB_NONE, XCB_NONE);
+	}
+    }
+
+  /* The thumbnails are now going to be painted for the first time, the
+     latency is added once the frame is on the screen */
+  if(_expose_global.activation_time)
+    _expose_global.is_activation_rendered = true;
+
+  /* Paint the windows at their interpolated geometry until the end of
+     the transition, which may disable the plugin */
+  if(_expose_global.animation_start)
+    {
+      window_t *animation_windows = _expose_animation_step();
+      if(animation_windows || !_expose_global.enabled)
+	return animation_windows;
     }
 
   return _expose_global.slots[0].scale_window.window;
 }
 
+/** Add the  time from the activation  to the frame on the screen, if
+ *  this frame is the first one rendered since the activation
+ *
+ * \param present_time The time the frame is on the screen
+ */
+static void
+expose_frame_presented(const double present_time)
+{
+  if(!_expose_global.is_activation_rendered)
+    return;
+
+  const double latency = present_time - _expose_global.activation_time;
+
+  metrics_latency_add(&_expose_global.activation_latency, latency);
+  _expose_global.last_activation_latency = (float) latency;
+
+  _expose_global.activation_time = 0;
+  _expose_global.is_activation_rendered = false;
+
+  debug("Time from activation to first frame: %.3fms", latency * 1000);
+}
+
+/** Write the activation latency distribution (in microseconds)
+ *
+ * \param fp The file to write to
+ */
+static void
+expose_write_metrics(FILE *fp)
+{
+  const metrics_latency_histogram_t *latency = &_expose_global.activation_latency;
+
+  fprintf(fp, "{\"activation_latency_us\": {\"count\": %u, \"last\": %.0f, "
+	  "\"p50\": %.0f, \"p99\": %.0f}}",
+	  latency->count, _expose_global.last_activation_latency * 1e6,
+	  metrics_latency_get_percentile(latency, 50) * 1e6,
+	  metrics_latency_get_percentile(latency, 99) * 1e6);
+}
+
 /** Called on dlclose() and fee the memory allocated by this plugin */
 static void __attribute__((destructor))
 expose_destructor(void)
@@ -1045,14 +2216,22 @@ expose_destructor(void)
     }
 
   free(_expose_global.atoms.active_window);
+  _expose_animation_stop();
   _expose_free_slots(&_expose_global.slots);
+  _expose_cache_free();
+
+  if(expose_pool_get_size())
+    {
+      ev_io_stop(globalconf.event_loop, &_expose_global.pool_watcher);
+      expose_pool_free();
+    }
 }
 
 /** Structure holding all the functions addresses */
 plugin_vtable_t plugin_vtable = {
   .name = "expose",
   .events = {
-    NULL,
+    expose_event_handle_damage_notify,
     NULL,
     NULL,
     expose_event_handle_key_release,
@@ -1060,8 +2239,8 @@ plugin_vtable_t plugin_vtable = {
     NULL,
     NULL,
     NULL,
-    NULL,
-    NULL,
+    expose_event_handle_destroy_notify,
+    expose_event_handle_map_notify,
     NULL,
     NULL,
     expose_event_handle_property_notify
@@ -1069,5 +2248,7 @@ plugin_vtable_t plugin_vtable = {
   .check_requirements = expose_check_requirements,
   .window_manage_existing = NULL,
   .window_get_opacity = NULL,
-  .render_windows = expose_render_windows
+  .render_windows = expose_render_windows,
+  .frame_presented = expose_frame_presented,
+  .write_metrics = expose_write_metrics
 };
@@ -0,0 +1,311 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Slots layout of the expose plugin
+ *
+ *  The screen is divided in strips whose number is given by the square
+ *  root  of the  number of  slots  ('expose_layout_create_slots'), the
+ *  slots being smaller as  the number of windows grows, thus windows
+ *  are split in pages  of slots no smaller than a  given size
+ *  ('expose_layout_get_page_size').
+ *
+ *  Windows are assigned to  slots by sorting them spatially, in O(n log
+ *  n)  ('expose_layout_assign'): windows  are sorted  by the  ordinate
+ *  of  their center  and split  in  as many  groups as  strips, from
+ *  top to bottom, then each  group is sorted by abscissa and assigned
+ *  to the slots of the strip from left to right.  Thus, windows keep
+ *  roughly their relative position on the screen.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "expose_layout.h"
+
+/** Window center used to sort windows spatially */
+typedef struct
+{
+  /** Abscissa of the window center */
+  int32_t x;
+  /** Ordinate of the window center */
+  int32_t y;
+  /** Index of the window */
+  uint32_t window_n;
+} _expose_layout_center_t;
+
+/** Get the number of strips of a page
+ *
+ * \param nslots The number of slots of the page
+ * \return The number of strips
+ */
+static inline uint32_t
+_expose_layout_get_strips_nb(const uint32_t nslots)
+{
+  return (uint32_t) sqrt(nslots + 1);
+}
+
+/** Get the number of slots per strip (the last one may contain less)
+ *
+ * \param nslots The number of slots of the page
+ * \return The number of slots per strip
+ */
+static inline uint32_t
+_expose_layout_get_nslots_per_strip(const uint32_t nslots)
+{
+  const uint32_t strips_nb = _expose_layout_get_strips_nb(nslots);
+  return (nslots + strips_nb - 1) / strips_nb;
+}
+
+/** Get the maximum  number of windows displayed at  once, so the slots
+ *  are not smaller than the given size
+ *
+ * \param nwindows The number of windows
+ * \param screen_width The screen width
+ * \param screen_height The screen height
+ * \param spacing The spacing between slots
+ * \param slot_min_size The minimum width and height of a slot
+ * \return The number of slots of a page (at least 1)
+ */
+uint32_t
+expose_layout_get_page_size(const uint32_t nwindows,
+                            const uint16_t screen_width,
+                            const uint16_t screen_height,
+                            const uint16_t spacing,
+                            const uint16_t slot_min_size)
+{
+  /* Largest number of strips and of slots per strip */
+  const int32_t strips_max = (screen_height - spacing) / (slot_min_size + spacing);
+  const int32_t nslots_per_strip_max = (screen_width - spacing) / (slot_min_size + spacing);
+
+  uint32_t nslots = nwindows;
+  while(nslots > 1 &&
+        ((int32_t) _expose_layout_get_strips_nb(nslots) > strips_max ||
+         (int32_t) _expose_layout_get_nslots_per_strip(nslots) > nslots_per_strip_max))
+    nslots--;
+
+  return nslots ? nslots : 1;
+}
+
+/** Create the slots of a page, strip by strip from top to bottom and
+ *  from left to right
+ *
+ * \param nslots The number of slots
+ * \param screen_width The screen width
+ * \param screen_height The screen height
+ * \param spacing The spacing between slots
+ * \param slots The slots to fill
+ * \return The number of slots per strip
+ */
+uint32_t
+expose_layout_create_slots(const uint32_t nslots,
+                           const uint16_t screen_width,
+                           const uint16_t screen_height,
+                           const uint16_t spacing,
+                           expose_layout_rectangle_t *slots)
+{
+  const uint32_t strips_nb = _expose_layout_get_strips_nb(nslots);
+  const uint32_t nslots_per_strip = _expose_layout_get_nslots_per_strip(nslots);
+
+  /* Each strip height excludes spacing */
+  const uint16_t strip_height = (uint16_t)
+    ((screen_height - spacing * (strips_nb + 1)) / strips_nb);
+
+  int16_t current_y = (int16_t) spacing;
+  uint32_t slot_n = 0;
+
+  for(uint32_t strip_n = 0; strip_n < strips_nb && slot_n < nslots; strip_n++)
+    {
+      /* The last strip may contain less slots */
+      const uint32_t strip_slots_n = (nslots - slot_n > nslots_per_strip ?
+                                      nslots_per_strip : nslots - slot_n);
+
+      /* Slot width excluding spacing */
+      const uint16_t slot_width = (uint16_t)
+        ((screen_width - spacing * (strip_slots_n + 1)) / strip_slots_n);
+
+      int16_t current_x = (int16_t) spacing;
+
+      for(uint32_t strip_slot = 0; strip_slot < strip_slots_n; strip_slot++)
+        {
+          slots[slot_n].x = current_x;
+          slots[slot_n].y = current_y;
+          slots[slot_n].width = slot_width;
+          slots[slot_n].height = strip_height;
+
+          current_x = (int16_t) (current_x + slot_width + spacing);
+          ++slot_n;
+        }
+
+      current_y = (int16_t) (current_y + strip_height + spacing);
+    }
+
+  return nslots_per_strip;
+}
+
+/** Compare windows centers by ordinate, then abscissa
+ *
+ * \param a The first window center
+ * \param b The second window center
+ * \return The comparison result as expected by qsort()
+ */
+static int
+_expose_layout_cmp_y(const void *a, const void *b)
+{
+  const _expose_layout_center_t *center_a = a, *center_b = b;
+
+  if(center_a->y != center_b->y)
+    return center_a->y < center_b->y ? -1 : 1;
+
+  if(center_a->x != center_b->x)
+    return center_a->x < center_b->x ? -1 : 1;
+
+  return center_a->window_n < center_b->window_n ? -1 : 1;
+}
+
+/** Compare windows centers by abscissa, then ordinate
+ *
+ * \param a The first window center
+ * \param b The second window center
+ * \return The comparison result as expected by qsort()
+ */
+static int
+_expose_layout_cmp_x(const void *a, const void *b)
+{
+  const _expose_layout_center_t *center_a = a, *center_b = b;
+
+  if(center_a->x != center_b->x)
+    return center_a->x < center_b->x ? -1 : 1;
+
+  return _expose_layout_cmp_y(a, b);
+}
+
+/** Shrink  the  slots  of a  strip larger  than their  window, give the
+ *  spare pixels  to the slots smaller  than their window and then
+ *  center the slots in the strip
+ *
+ * \param windows The windows geometry, including border
+ * \param spacing The spacing between slots
+ * \param slots The slots of the strip
+ * \param strip_slots_n The number of slots of the strip
+ * \param assignment The window index of each slot of the strip
+ */
+static void
+_expose_layout_adjust_strip(const expose_layout_rectangle_t *windows,
+                            const uint16_t spacing,
+                            expose_layout_rectangle_t *slots,
+                            const uint32_t strip_slots_n,
+                            const uint32_t *assignment)
+{
+  const int32_t strip_begin = slots[0].x;
+  const int32_t strip_end = slots[strip_slots_n - 1].x + slots[strip_slots_n - 1].width;
+
+  uint32_t spare_pixels = 0, slots_to_extend_n = 0;
+
+  for(uint32_t slot_n = 0; slot_n < strip_slots_n; slot_n++)
+    {
+      const uint16_t window_width = windows[assignment[slot_n]].width;
+
+      if(window_width < slots[slot_n].width)
+        {
+          spare_pixels += (uint32_t) (slots[slot_n].width - window_width);
+          slots[slot_n].width = window_width;
+        }
+      else if(window_width > slots[slot_n].width)
+        slots_to_extend_n++;
+    }
+
+  if(slots_to_extend_n)
+    {
+      const uint32_t spare_pixels_per_slot = spare_pixels / slots_to_extend_n;
+
+      for(uint32_t slot_n = 0; slot_n < strip_slots_n; slot_n++)
+        {
+          const uint16_t window_width = windows[assignment[slot_n]].width;
+
+          if(window_width > slots[slot_n].width)
+            slots[slot_n].width = (uint16_t)
+              (slots[slot_n].width + spare_pixels_per_slot > window_width ?
+               window_width : slots[slot_n].width + spare_pixels_per_slot);
+        }
+    }
+
+  int32_t strip_width = spacing * (int32_t) (strip_slots_n - 1);
+  for(uint32_t slot_n = 0; slot_n < strip_slots_n; slot_n++)
+    strip_width += slots[slot_n].width;
+
+  int32_t current_x = strip_begin + (strip_end - strip_begin - strip_width) / 2;
+  for(uint32_t slot_n = 0; slot_n < strip_slots_n; slot_n++)
+    {
+      slots[slot_n].x = (int16_t) current_x;
+      current_x += slots[slot_n].width + spacing;
+    }
+}
+
+/** Assign each window to a slot, keeping their relative position on the
+ *  screen, and adjust the slots width to the windows
+ *
+ * \param nslots The number of windows and slots
+ * \param nslots_per_strip The number of slots per strip
+ * \param spacing The spacing between slots
+ * \param windows The windows geometry, including border
+ * \param slots The slots created by 'expose_layout_create_slots'
+ * \param assignment The window index of each slot to fill
+ */
+void
+expose_layout_assign(const uint32_t nslots,
+                     const uint32_t nslots_per_strip,
+                     const uint16_t spacing,
+                     const expose_layout_rectangle_t *windows,
+                     expose_layout_rectangle_t *slots,
+                     uint32_t *assignment)
+{
+  if(!nslots)
+    return;
+
+  _expose_layout_center_t *centers = malloc(nslots * sizeof(_expose_layout_center_t));
+
+  for(uint32_t window_n = 0; window_n < nslots; window_n++)
+    {
+      centers[window_n].x = windows[window_n].x + windows[window_n].width / 2;
+      centers[window_n].y = windows[window_n].y + windows[window_n].height / 2;
+      centers[window_n].window_n = window_n;
+    }
+
+  qsort(centers, nslots, sizeof(_expose_layout_center_t), _expose_layout_cmp_y);
+
+  /* Slots are  created strip by strip, thus  each group of windows is
+     sorted and assigned to consecutive slots */
+  for(uint32_t slot_n = 0; slot_n < nslots; slot_n += nslots_per_strip)
+    {
+      const uint32_t strip_slots_n = (nslots - slot_n > nslots_per_strip ?
+                                      nslots_per_strip : nslots - slot_n);
+
+      qsort(centers + slot_n, strip_slots_n, sizeof(_expose_layout_center_t),
+            _expose_layout_cmp_x);
+
+      for(uint32_t strip_slot = 0; strip_slot < strip_slots_n; strip_slot++)
+        assignment[slot_n + strip_slot] = centers[slot_n + strip_slot].window_n;
+
+      _expose_layout_adjust_strip(windows, spacing, slots + slot_n,
+                                  strip_slots_n, assignment + slot_n);
+    }
+
+  free(centers);
+}
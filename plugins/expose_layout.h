@@ -0,0 +1,50 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Slots layout of the expose plugin
+ */
+
+#ifndef EXPOSE_LAYOUT_H
+#define EXPOSE_LAYOUT_H
+
+#include <stdint.h>
+
+/** Rectangle, with the same members as xcb_rectangle_t */
+typedef struct
+{
+  int16_t x;
+  int16_t y;
+  uint16_t width;
+  uint16_t height;
+} expose_layout_rectangle_t;
+
+uint32_t expose_layout_get_page_size(const uint32_t, const uint16_t,
+                                     const uint16_t, const uint16_t,
+                                     const uint16_t);
+
+uint32_t expose_layout_create_slots(const uint32_t, const uint16_t,
+                                    const uint16_t, const uint16_t,
+                                    expose_layout_rectangle_t *);
+
+void expose_layout_assign(const uint32_t, const uint32_t, const uint16_t,
+                          const expose_layout_rectangle_t *,
+                          expose_layout_rectangle_t *, uint32_t *);
+
+#endif
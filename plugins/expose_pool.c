@@ -0,0 +1,266 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Worker threads pool used by the expose plugin
+ *
+ *  A fixed number of  threads run the jobs submitted  by the main
+ *  thread (e.g.  scaling a window  Image), which  never touch  the X
+ *  connection.
+ *
+ *  Submitted jobs are  queued in a FIFO protected by a  mutex as the
+ *  workers have to sleep when there is nothing to do.  Once run, jobs
+ *  are pushed  by the workers on  a lock-free stack and  the eventfd
+ *  returned by 'expose_pool_get_fd' is  written to wake up  the main
+ *  loop, which then takes all the done jobs at once with a single
+ *  atomic exchange ('expose_pool_take_done').
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "expose_pool.h"
+
+/** Global variables of the pool */
+static struct
+{
+  /** Worker threads */
+  pthread_t *threads;
+  /** Number of worker threads */
+  unsigned int threads_len;
+  /** Protect the jobs queue and the counter of jobs not done yet */
+  pthread_mutex_t mutex;
+  /** Signaled when a job is submitted or the pool is freed */
+  pthread_cond_t job_cond;
+  /** Signaled when all the submitted jobs are done */
+  pthread_cond_t done_cond;
+  /** First job to be run */
+  expose_pool_job_t *jobs_head;
+  /** Last job to be run */
+  expose_pool_job_t *jobs_tail;
+  /** Number of jobs submitted but not done yet */
+  unsigned int jobs_pending;
+  /** Whether the workers must exit */
+  bool do_exit;
+  /** Jobs done, pushed by the workers without locking */
+  expose_pool_job_t *done;
+  /** Written by the workers when a job is done */
+  int fd;
+  /** Whether the pool has been initialised */
+  bool is_initialised;
+} _expose_pool;
+
+/** Push a job on the done jobs stack, which may be done concurrently
+ *  by several worker threads
+ *
+ * \param job The job done
+ */
+static void
+_expose_pool_push_done(expose_pool_job_t *job)
+{
+  job->next = __atomic_load_n(&_expose_pool.done, __ATOMIC_RELAXED);
+
+  while(!__atomic_compare_exchange_n(&_expose_pool.done, &job->next, job, true,
+                                     __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    ;
+
+  const uint64_t value = 1;
+  while(write(_expose_pool.fd, &value, sizeof(value)) < 0 && errno == EINTR)
+    ;
+}
+
+/** Worker thread main loop
+ *
+ * \param arg Unused
+ * \return NULL
+ */
+static void *
+_expose_pool_worker(void *arg __attribute__((unused)))
+{
+  pthread_mutex_lock(&_expose_pool.mutex);
+
+  for(;;)
+    {
+      while(!_expose_pool.jobs_head && !_expose_pool.do_exit)
+        pthread_cond_wait(&_expose_pool.job_cond, &_expose_pool.mutex);
+
+      if(!_expose_pool.jobs_head)
+        break;
+
+      expose_pool_job_t *job = _expose_pool.jobs_head;
+      _expose_pool.jobs_head = job->next;
+      if(!_expose_pool.jobs_head)
+        _expose_pool.jobs_tail = NULL;
+
+      pthread_mutex_unlock(&_expose_pool.mutex);
+
+      (*job->run)(job);
+      _expose_pool_push_done(job);
+
+      pthread_mutex_lock(&_expose_pool.mutex);
+
+      if(!--_expose_pool.jobs_pending)
+        pthread_cond_broadcast(&_expose_pool.done_cond);
+    }
+
+  pthread_mutex_unlock(&_expose_pool.mutex);
+  return NULL;
+}
+
+/** Create the  worker threads, which  may be less than  requested if
+ *  the system does not allow it
+ *
+ * \param threads_len The number of worker threads
+ * \return true if at least one worker thread has been created
+ */
+bool
+expose_pool_init(unsigned int threads_len)
+{
+  _expose_pool.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(_expose_pool.fd < 0)
+    return false;
+
+  pthread_mutex_init(&_expose_pool.mutex, NULL);
+  pthread_cond_init(&_expose_pool.job_cond, NULL);
+  pthread_cond_init(&_expose_pool.done_cond, NULL);
+  _expose_pool.is_initialised = true;
+
+  _expose_pool.threads = calloc(threads_len, sizeof(pthread_t));
+
+  for(_expose_pool.threads_len = 0;
+      _expose_pool.threads_len < threads_len;
+      _expose_pool.threads_len++)
+    if(pthread_create(&_expose_pool.threads[_expose_pool.threads_len], NULL,
+                      _expose_pool_worker, NULL))
+      break;
+
+  if(!_expose_pool.threads_len)
+    {
+      expose_pool_free();
+      return false;
+    }
+
+  return true;
+}
+
+/** Get the number of worker threads
+ *
+ * \return The number of worker threads, 0 if the pool is not running
+ */
+unsigned int
+expose_pool_get_size(void)
+{
+  return _expose_pool.threads_len;
+}
+
+/** Get the file descriptor  to watch for reading,  readable when jobs
+ *  are done
+ *
+ * \return The eventfd file descriptor
+ */
+int
+expose_pool_get_fd(void)
+{
+  return _expose_pool.fd;
+}
+
+/** Queue a job to be run by the first available worker
+ *
+ * \param job The job, which must stay valid until taken once done
+ */
+void
+expose_pool_submit(expose_pool_job_t *job)
+{
+  job->next = NULL;
+
+  pthread_mutex_lock(&_expose_pool.mutex);
+
+  if(_expose_pool.jobs_tail)
+    _expose_pool.jobs_tail->next = job;
+  else
+    _expose_pool.jobs_head = job;
+
+  _expose_pool.jobs_tail = job;
+  _expose_pool.jobs_pending++;
+
+  pthread_cond_signal(&_expose_pool.job_cond);
+  pthread_mutex_unlock(&_expose_pool.mutex);
+}
+
+/** Take all the jobs done so far, in no particular order
+ *
+ * \return The list of jobs done
+ */
+expose_pool_job_t *
+expose_pool_take_done(void)
+{
+  /* Reset the eventfd counter  first, so jobs pushed after taking them
+     will wake up the main loop again */
+  uint64_t value;
+  while(read(_expose_pool.fd, &value, sizeof(value)) < 0 && errno == EINTR)
+    ;
+
+  return __atomic_exchange_n(&_expose_pool.done, NULL, __ATOMIC_ACQUIRE);
+}
+
+/** Wait until all the submitted jobs are done, which then have to be
+ *  taken with 'expose_pool_take_done'
+ */
+void
+expose_pool_wait(void)
+{
+  pthread_mutex_lock(&_expose_pool.mutex);
+
+  while(_expose_pool.jobs_pending)
+    pthread_cond_wait(&_expose_pool.done_cond, &_expose_pool.mutex);
+
+  pthread_mutex_unlock(&_expose_pool.mutex);
+}
+
+/** Stop the worker threads once the queued jobs are done */
+void
+expose_pool_free(void)
+{
+  if(!_expose_pool.is_initialised)
+    return;
+
+  pthread_mutex_lock(&_expose_pool.mutex);
+  _expose_pool.do_exit = true;
+  pthread_cond_broadcast(&_expose_pool.job_cond);
+  pthread_mutex_unlock(&_expose_pool.mutex);
+
+  for(unsigned int thread_n = 0; thread_n < _expose_pool.threads_len; thread_n++)
+    pthread_join(_expose_pool.threads[thread_n], NULL);
+
+  free(_expose_pool.threads);
+  _expose_pool.threads = NULL;
+  _expose_pool.threads_len = 0;
+  _expose_pool.do_exit = false;
+
+  pthread_cond_destroy(&_expose_pool.done_cond);
+  pthread_cond_destroy(&_expose_pool.job_cond);
+  pthread_mutex_destroy(&_expose_pool.mutex);
+
+  close(_expose_pool.fd);
+  _expose_pool.is_initialised = false;
+}
@@ -0,0 +1,47 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Worker threads pool used by the expose plugin
+ */
+
+#ifndef EXPOSE_POOL_H
+#define EXPOSE_POOL_H
+
+#include <stdbool.h>
+
+/** Job run by a worker thread, generally embedded as the first member
+ *  of a larger structure holding the job data */
+typedef struct _expose_pool_job_t
+{
+  /** Function run by the worker thread */
+  void (*run)(struct _expose_pool_job_t *);
+  /** Next job in the queue */
+  struct _expose_pool_job_t *next;
+} expose_pool_job_t;
+
+bool expose_pool_init(unsigned int);
+unsigned int expose_pool_get_size(void);
+int expose_pool_get_fd(void);
+void expose_pool_submit(expose_pool_job_t *);
+expose_pool_job_t *expose_pool_take_done(void);
+void expose_pool_wait(void);
+void expose_pool_free(void);
+
+#endif
@@ -0,0 +1,401 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief CPU downscaler of 32-bit pixels used by the expose plugin
+ *
+ *  Each destination  pixel is the  average of the source  pixels it
+ *  covers (box filter), computed separately for each byte (channel) of
+ *  the pixels. The filter is separable:
+ *
+ *   1/ The source rows covered by a destination row are summed up, per
+ *      channel,  into  an  accumulator row  as  wide  as the  source
+ *      ('accumulate_row'). This  is where almost all the  time is spent
+ *      as each source pixel is read exactly once, thus it is vectorised
+ *      with SSE2 or  AVX2 when the CPU supports it  (checked at runtime).
+ *
+ *   2/  The columns of  the accumulator row  covered by each destination
+ *      pixel are then summed up and divided by the number of pixels.
+ *
+ *  Pixels are processed row by row, following the memory layout of the
+ *  Z-Pixmap images. Only an area of the destination may be computed,
+ *  for instance the one covering the damaged part of the source.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "expose_scale.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define EXPOSE_SCALE_X86 1
+#include <immintrin.h>
+#endif
+
+/** Function adding the  channels of a source row  to the accumulator
+ *  row (4 accumulators per pixel) */
+typedef void (*_expose_scale_accumulate_row_func_t)(const uint32_t *,
+                                                    uint32_t *,
+                                                    const uint32_t);
+
+/** Add the channels of each pixel of the row to the accumulator row
+ *
+ * \param row The source row
+ * \param accumulator The accumulator row (4 values per pixel)
+ * \param width The number of pixels of the row
+ */
+static void
+_expose_scale_accumulate_row_scalar(const uint32_t *row,
+                                    uint32_t *accumulator,
+                                    const uint32_t width)
+{
+  const uint8_t *bytes = (const uint8_t *) row;
+
+  for(uint32_t byte_n = 0; byte_n < width * 4; byte_n++)
+    accumulator[byte_n] += bytes[byte_n];
+}
+
+#ifdef EXPOSE_SCALE_X86
+/** SSE2 version of _expose_scale_accumulate_row_scalar(), processing 4
+ *  pixels at once
+ */
+static void __attribute__((target("sse2")))
+_expose_scale_accumulate_row_sse2(const uint32_t *row,
+                                  uint32_t *accumulator,
+                                  const uint32_t width)
+{
+  const __m128i zero = _mm_setzero_si128();
+  uint32_t pixel_n = 0;
+
+  for(; pixel_n + 4 <= width; pixel_n += 4)
+    {
+      const __m128i pixels = _mm_loadu_si128((const __m128i *) (row + pixel_n));
+
+      /* Widen the 16 bytes to 16-bit and then 32-bit integers */
+      const __m128i low = _mm_unpacklo_epi8(pixels, zero);
+      const __m128i high = _mm_unpackhi_epi8(pixels, zero);
+
+      __m128i *acc = (__m128i *) (accumulator + pixel_n * 4);
+
+      _mm_storeu_si128(acc, _mm_add_epi32(_mm_loadu_si128(acc),
+                                          _mm_unpacklo_epi16(low, zero)));
+      _mm_storeu_si128(acc + 1, _mm_add_epi32(_mm_loadu_si128(acc + 1),
+                                              _mm_unpackhi_epi16(low, zero)));
+      _mm_storeu_si128(acc + 2, _mm_add_epi32(_mm_loadu_si128(acc + 2),
+                                              _mm_unpacklo_epi16(high, zero)));
+      _mm_storeu_si128(acc + 3, _mm_add_epi32(_mm_loadu_si128(acc + 3),
+                                              _mm_unpackhi_epi16(high, zero)));
+    }
+
+  _expose_scale_accumulate_row_scalar(row + pixel_n, accumulator + pixel_n * 4,
+                                      width - pixel_n);
+}
+
+/** AVX2 version of _expose_scale_accumulate_row_scalar(), processing 8
+ *  pixels at once
+ */
+static void __attribute__((target("avx2")))
+_expose_scale_accumulate_row_avx2(const uint32_t *row,
+                                  uint32_t *accumulator,
+                                  const uint32_t width)
+{
+  uint32_t pixel_n = 0;
+
+  for(; pixel_n + 8 <= width; pixel_n += 8)
+    {
+      const __m128i *pixels = (const __m128i *) (row + pixel_n);
+      __m256i *acc = (__m256i *) (accumulator + pixel_n * 4);
+
+      /* Each 8 bytes (2 pixels) are widened to 8 32-bit integers */
+      for(int half = 0; half < 2; half++)
+        {
+          const __m128i bytes = _mm_loadu_si128(pixels + half);
+
+          _mm256_storeu_si256(acc + half * 2,
+                              _mm256_add_epi32(_mm256_loadu_si256(acc + half * 2),
+                                               _mm256_cvtepu8_epi32(bytes)));
+
+          _mm256_storeu_si256(acc + half * 2 + 1,
+                              _mm256_add_epi32(_mm256_loadu_si256(acc + half * 2 + 1),
+                                               _mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8))));
+        }
+    }
+
+  _expose_scale_accumulate_row_scalar(row + pixel_n, accumulator + pixel_n * 4,
+                                      width - pixel_n);
+}
+#endif /* EXPOSE_SCALE_X86 */
+
+/** Implementations names and functions, indexed by expose_scale_impl_t */
+static const struct
+{
+  const char *name;
+  _expose_scale_accumulate_row_func_t accumulate_row;
+} _expose_scale_impls[EXPOSE_SCALE_IMPL_NUMBER] = {
+  { "scalar", _expose_scale_accumulate_row_scalar },
+#ifdef EXPOSE_SCALE_X86
+  { "sse2", _expose_scale_accumulate_row_sse2 },
+  { "avx2", _expose_scale_accumulate_row_avx2 }
+#else
+  { "sse2", NULL },
+  { "avx2", NULL }
+#endif
+};
+
+/** Implementation currently used, selected on first use if not set.
+ *  Only accessed atomically as the scaler may run in several threads */
+static _expose_scale_accumulate_row_func_t _expose_scale_accumulate_row = NULL;
+
+/** Check whether the given implementation is supported by the CPU
+ *
+ * \param impl The implementation
+ * \return true if supported
+ */
+bool
+expose_scale_impl_is_supported(const expose_scale_impl_t impl)
+{
+  switch(impl)
+    {
+    case EXPOSE_SCALE_IMPL_SCALAR:
+      return true;
+#ifdef EXPOSE_SCALE_X86
+    case EXPOSE_SCALE_IMPL_SSE2:
+      return __builtin_cpu_supports("sse2");
+    case EXPOSE_SCALE_IMPL_AVX2:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+    }
+}
+
+/** Get the name of the given implementation
+ *
+ * \param impl The implementation
+ * \return The implementation name
+ */
+const char *
+expose_scale_impl_get_name(const expose_scale_impl_t impl)
+{
+  return impl < EXPOSE_SCALE_IMPL_NUMBER ? _expose_scale_impls[impl].name : NULL;
+}
+
+/** Force the  implementation to use (mostly useful  for benchmarking),
+ *  it must be supported by the CPU
+ *
+ * \param impl The implementation
+ */
+void
+expose_scale_set_impl(const expose_scale_impl_t impl)
+{
+  __atomic_store_n(&_expose_scale_accumulate_row,
+                   _expose_scale_impls[impl].accumulate_row, __ATOMIC_RELAXED);
+}
+
+/** Select the fastest implementation supported by the CPU */
+static void
+_expose_scale_select_impl(void)
+{
+#ifdef EXPOSE_SCALE_X86
+  __builtin_cpu_init();
+#endif
+
+  for(int impl = EXPOSE_SCALE_IMPL_NUMBER - 1; impl >= 0; impl--)
+    if(expose_scale_impl_is_supported((expose_scale_impl_t) impl))
+      {
+        expose_scale_set_impl((expose_scale_impl_t) impl);
+        return;
+      }
+}
+
+/** Get the  first source row  or column covered by  the destination
+ *  one
+ *
+ * \param dst_n The destination row or column
+ * \param src_size The source height or width
+ * \param dst_size The destination height or width
+ * \return The first source row or column
+ */
+static inline uint32_t
+_expose_scale_get_src(const uint32_t dst_n, const uint32_t src_size,
+                      const uint32_t dst_size)
+{
+  return (uint32_t) (((uint64_t) dst_n * src_size) / dst_size);
+}
+
+/** Get  the source row  or column after the  last one covered  by the
+ *  destination one (always covering at least one)
+ *
+ * \param dst_n The destination row or column
+ * \param src_size The source height or width
+ * \param dst_size The destination height or width
+ * \return The source row or column after the last one
+ */
+static inline uint32_t
+_expose_scale_get_src_end(const uint32_t dst_n, const uint32_t src_size,
+                          const uint32_t dst_size)
+{
+  const uint32_t src_begin = _expose_scale_get_src(dst_n, src_size, dst_size);
+  const uint32_t src_end = _expose_scale_get_src(dst_n + 1, src_size, dst_size);
+
+  return src_end > src_begin ? src_end : src_begin + 1;
+}
+
+/** Get the destination area whose  pixels are computed from at least
+ *  one pixel of the given source area (e.g. a damaged area)
+ *
+ * \param src_width The source width
+ * \param src_height The source height
+ * \param dst_width The destination width
+ * \param dst_height The destination height
+ * \param src_area The source area
+ * \param dst_area The destination area to fill
+ */
+void
+expose_scale_get_area(const uint32_t src_width,
+                      const uint32_t src_height,
+                      const uint32_t dst_width,
+                      const uint32_t dst_height,
+                      const expose_scale_area_t *src_area,
+                      expose_scale_area_t *dst_area)
+{
+  uint32_t x = (uint32_t) (((uint64_t) src_area->x * dst_width) / src_width);
+  uint32_t y = (uint32_t) (((uint64_t) src_area->y * dst_height) / src_height);
+
+  /* Move back while the previous destination pixel still covers the
+     beginning of the source area */
+  while(x && _expose_scale_get_src_end(x - 1, src_width, dst_width) > src_area->x)
+    x--;
+  while(y && _expose_scale_get_src_end(y - 1, src_height, dst_height) > src_area->y)
+    y--;
+
+  uint32_t x_end = x, y_end = y;
+  while(x_end < dst_width &&
+        _expose_scale_get_src(x_end, src_width, dst_width) < src_area->x + src_area->width)
+    x_end++;
+  while(y_end < dst_height &&
+        _expose_scale_get_src(y_end, src_height, dst_height) < src_area->y + src_area->height)
+    y_end++;
+
+  dst_area->x = x;
+  dst_area->y = y;
+  dst_area->width = x_end - x;
+  dst_area->height = y_end - y;
+}
+
+/** Downscale the source pixels to  the destination pixels, both given
+ *  as rows of  32-bit pixels. The destination must  not be larger than
+ *  the source
+ *
+ * \param src The source pixels
+ * \param src_width The source width
+ * \param src_height The source height
+ * \param src_stride The number of pixels between two source rows
+ * \param dst The destination pixels
+ * \param dst_width The destination width
+ * \param dst_height The destination height
+ * \param dst_stride The number of pixels between two destination rows
+ * \param dst_area The destination area to compute, or NULL for all
+ */
+void
+expose_scale_pixels(const uint32_t *src,
+                    const uint32_t src_width,
+                    const uint32_t src_height,
+                    const uint32_t src_stride,
+                    uint32_t *dst,
+                    const uint32_t dst_width,
+                    const uint32_t dst_height,
+                    const uint32_t dst_stride,
+                    const expose_scale_area_t *dst_area)
+{
+  if(!src_width || !src_height || !dst_width || !dst_height)
+    return;
+
+  const expose_scale_area_t area = {
+    dst_area ? dst_area->x : 0,
+    dst_area ? dst_area->y : 0,
+    dst_area ? dst_area->width : dst_width,
+    dst_area ? dst_area->height : dst_height
+  };
+
+  if(!area.width || !area.height || area.x + area.width > dst_width ||
+     area.y + area.height > dst_height)
+    return;
+
+  _expose_scale_accumulate_row_func_t accumulate_row =
+    __atomic_load_n(&_expose_scale_accumulate_row, __ATOMIC_RELAXED);
+
+  if(!accumulate_row)
+    {
+      _expose_scale_select_impl();
+      accumulate_row = __atomic_load_n(&_expose_scale_accumulate_row,
+                                       __ATOMIC_RELAXED);
+    }
+
+  /* Only the source columns covered by the destination area */
+  const uint32_t src_x = _expose_scale_get_src(area.x, src_width, dst_width);
+  const uint32_t src_area_width =
+    _expose_scale_get_src_end(area.x + area.width - 1, src_width, dst_width) - src_x;
+
+  uint32_t *accumulator = malloc(src_area_width * 4 * sizeof(uint32_t));
+
+  /* First source column covered by each destination column, relative to
+     the accumulator row, and the one after the last */
+  uint32_t *columns = malloc(area.width * 2 * sizeof(uint32_t));
+  for(uint32_t x = 0; x < area.width; x++)
+    {
+      columns[x * 2] = _expose_scale_get_src(area.x + x, src_width, dst_width) - src_x;
+      columns[x * 2 + 1] = _expose_scale_get_src_end(area.x + x, src_width, dst_width) - src_x;
+    }
+
+  for(uint32_t y = area.y; y < area.y + area.height; y++)
+    {
+      const uint32_t row_begin = _expose_scale_get_src(y, src_height, dst_height);
+      const uint32_t row_end = _expose_scale_get_src_end(y, src_height, dst_height);
+
+      memset(accumulator, 0, src_area_width * 4 * sizeof(uint32_t));
+
+      for(uint32_t row = row_begin; row < row_end; row++)
+        (*accumulate_row)(src + (size_t) row * src_stride + src_x,
+                          accumulator, src_area_width);
+
+      uint8_t *dst_bytes = (uint8_t *) (dst + (size_t) y * dst_stride + area.x);
+
+      for(uint32_t x = 0; x < area.width; x++)
+        {
+          const uint32_t column_begin = columns[x * 2];
+          const uint32_t column_end = columns[x * 2 + 1];
+
+          uint32_t sum[4] = { 0, 0, 0, 0 };
+          for(uint32_t column = column_begin; column < column_end; column++)
+            for(int channel = 0; channel < 4; channel++)
+              sum[channel] += accumulator[column * 4 + (uint32_t) channel];
+
+          const uint32_t count = (row_end - row_begin) * (column_end - column_begin);
+
+          /* Round to the nearest value */
+          for(int channel = 0; channel < 4; channel++)
+            dst_bytes[x * 4 + (uint32_t) channel] =
+              (uint8_t) ((sum[channel] + count / 2) / count);
+        }
+    }
+
+  free(columns);
+  free(accumulator);
+}
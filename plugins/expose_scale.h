@@ -0,0 +1,61 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief CPU downscaler of 32-bit pixels used by the expose plugin
+ */
+
+#ifndef EXPOSE_SCALE_H
+#define EXPOSE_SCALE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Implementations of the downscaler, from the slowest to the fastest */
+typedef enum
+{
+  EXPOSE_SCALE_IMPL_SCALAR = 0,
+  EXPOSE_SCALE_IMPL_SSE2,
+  EXPOSE_SCALE_IMPL_AVX2,
+  EXPOSE_SCALE_IMPL_NUMBER
+} expose_scale_impl_t;
+
+bool expose_scale_impl_is_supported(const expose_scale_impl_t);
+const char *expose_scale_impl_get_name(const expose_scale_impl_t);
+void expose_scale_set_impl(const expose_scale_impl_t);
+
+/** Rectangular area of pixels */
+typedef struct
+{
+  uint32_t x;
+  uint32_t y;
+  uint32_t width;
+  uint32_t height;
+} expose_scale_area_t;
+
+void expose_scale_get_area(const uint32_t, const uint32_t, const uint32_t,
+                           const uint32_t, const expose_scale_area_t *,
+                           expose_scale_area_t *);
+
+void expose_scale_pixels(const uint32_t *, const uint32_t, const uint32_t,
+                         const uint32_t, uint32_t *, const uint32_t,
+                         const uint32_t, const uint32_t,
+                         const expose_scale_area_t *);
+
+#endif
@@ -283,6 +283,7 @@ opacity_event_handle_property_notify(xcb_property_notify_event_t *event,
     }
       
   /* Force redraw of the window as the opacity has changed */
+  window_underlay_remove(window);
   display_add_damaged_region(&window->region, false);
 }
 
@@ -362,5 +363,7 @@ plugin_vtable_t plugin_vtable = {
   .check_requirements = NULL,
   .window_manage_existing = opacity_window_manage_existing,
   .window_get_opacity = opacity_get_window_opacity,
-  .render_windows = NULL
+  .render_windows = NULL,
+  .frame_presented = NULL,
+  .write_metrics = NULL
 };
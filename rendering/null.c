@@ -0,0 +1,249 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Rendering backend which does not paint anything
+ *
+ *  No drawing request is sent to the X server, thus the painting time
+ *  is  only spent  in  the core (events,  damaged  regions,  stacking,
+ *  occlusion...),  which can then  be measured  on its own, e.g.  with
+ *  the end-to-end benchmark ('bench/unagi-bench.sh -b null').
+ *
+ *  It counts the frames, the windows which would have been painted, the
+ *  painted  area, the  windows which would  have been clipped to their
+ *  shape and the time spent  in each painting phase, written to the
+ *  standard error as a JSON object when unloaded.
+ */
+
+#include <stdio.h>
+
+#include <xcb/xcb.h>
+
+#include "window.h"
+#include "structs.h"
+#include "util.h"
+
+/** Counters of the painting operations */
+static struct
+{
+  /** Number of frames painted */
+  uint64_t frames;
+  /** Number of frames where the underlay has been repainted */
+  uint64_t underlay_frames;
+  /** Number of calls to paint a window */
+  uint64_t paint_window_calls;
+  /** Number of pixels painted (windows area within the screen) */
+  uint64_t painted_area;
+  /** Number of non-rectangular windows clipped to their shape */
+  uint64_t clipped_windows;
+  /** Start time of the current painting phase */
+  ev_tstamp phase_begin;
+  /** Time spent repainting the underlay (in seconds) */
+  double underlay_time;
+  /** Time spent painting the windows above the underlay or the
+      background, including occlusion computation (in seconds) */
+  double windows_time;
+} _null_stats;
+
+/** Nothing to initialise
+ *
+ * \return true
+ */
+static bool
+null_init(void)
+{
+  return true;
+}
+
+/** Nothing to initialise
+ *
+ * \return true
+ */
+static bool
+null_init_finalise(void)
+{
+  return true;
+}
+
+/** There is no background */
+static void
+null_reset_background(void)
+{
+}
+
+/** Start painting a frame without underlay */
+static void
+null_paint_background(void)
+{
+  _null_stats.phase_begin = ev_time();
+}
+
+/** Count the window painting and its area within the screen
+ *
+ * \param window The window to be painted
+ */
+static void
+null_paint_window(window_t *window)
+{
+  if(window->pixmap == XCB_NONE)
+    return;
+
+  _null_stats.paint_window_calls++;
+  _null_stats.painted_area += window_get_screen_area(window);
+
+  if(!window_is_rectangular(window))
+    _null_stats.clipped_windows++;
+}
+
+/** End painting a frame */
+static void
+null_paint_all(void)
+{
+  _null_stats.windows_time += ev_time() - _null_stats.phase_begin;
+  _null_stats.frames++;
+}
+
+/** There is no backend-specific request
+ *
+ * \param request_major_code The X request major opcode
+ * \return false
+ */
+static bool
+null_is_request(const uint8_t request_major_code __attribute__((unused)))
+{
+  return false;
+}
+
+/** There is no backend-specific request
+ *
+ * \param request_minor_code The X request minor opcode
+ * \return NULL
+ */
+static const char *
+null_get_request_label(const uint16_t request_minor_code __attribute__((unused)))
+{
+  return NULL;
+}
+
+/** There is no backend-specific error
+ *
+ * \param error_code The X error code
+ * \return NULL
+ */
+static const char *
+null_get_error_label(const uint8_t error_code __attribute__((unused)))
+{
+  return NULL;
+}
+
+/** No resource is associated with the window Pixmap
+ *
+ * \param window The window object
+ */
+static void
+null_free_window_pixmap(window_t *window __attribute__((unused)))
+{
+}
+
+/** No resource is associated with the window
+ *
+ * \param window The window object
+ */
+static void
+null_free_window(window_t *window __attribute__((unused)))
+{
+}
+
+/** Start painting a frame, the underlay being repainted if damaged
+ *
+ * \return false if the underlay does not need to be repainted
+ */
+static bool
+null_paint_underlay_begin(void)
+{
+  _null_stats.phase_begin = ev_time();
+
+  if(!globalconf.underlay_reset && !globalconf.underlay_damaged)
+    return false;
+
+  _null_stats.underlay_frames++;
+  return true;
+}
+
+/** End repainting the underlay */
+static void
+null_paint_underlay_end(void)
+{
+  const ev_tstamp now = ev_time();
+
+  _null_stats.underlay_time += now - _null_stats.phase_begin;
+  _null_stats.phase_begin = now;
+}
+
+/** Pretend to scale the window when painting it, so plugins do not have
+ *  to scale it themselves
+ *
+ * \param window The window object
+ * \param width The original width including border
+ * \param height The original height including border
+ * \return true
+ */
+static bool
+null_set_window_scale(window_t *window __attribute__((unused)),
+                      const uint16_t width __attribute__((unused)),
+                      const uint16_t height __attribute__((unused)))
+{
+  return true;
+}
+
+/** Called on dlclose(), write the counters to the standard error */
+static void __attribute__((destructor))
+null_free(void)
+{
+  fprintf(stderr, "{\"frames\": %ju, \"underlay_frames\": %ju, "
+          "\"paint_window_calls\": %ju, \"painted_area\": %ju, "
+          "\"clipped_windows\": %ju, \"underlay_time\": %.6f, "
+          "\"windows_time\": %.6f}\n",
+          (uintmax_t) _null_stats.frames,
+          (uintmax_t) _null_stats.underlay_frames,
+          (uintmax_t) _null_stats.paint_window_calls,
+          (uintmax_t) _null_stats.painted_area,
+          (uintmax_t) _null_stats.clipped_windows,
+          _null_stats.underlay_time, _null_stats.windows_time);
+}
+
+/** Structure holding all the functions addresses */
+rendering_t rendering_functions = {
+  null_init,
+  null_init_finalise,
+  null_reset_background,
+  null_paint_background,
+  null_paint_window,
+  null_paint_all,
+  null_is_request,
+  null_get_request_label,
+  null_get_error_label,
+  null_free_window_pixmap,
+  null_free_window,
+  null_paint_underlay_begin,
+  null_paint_underlay_end,
+  NULL,
+  null_set_window_scale,
+  NULL
+};
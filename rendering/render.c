@@ -33,22 +33,20 @@
 #include "plugin.h"
 #include "util.h"
 
-/** Global alpha Pictures cache. This avoids creating an alpha Picture
-    for each window */
-typedef struct __render_alpha_picture_t
+/** Default number of quantized opacity levels in the alpha Pictures
+    table if not given in the configuration file */
+#define RENDER_DEFAULT_ALPHA_LEVELS 256
+
+/** Global alpha  Pictures cache, directly indexed  by the quantized
+    opacity level.  This avoids creating an alpha Picture for each
+    window and looking it up on each repaint */
+typedef struct
 {
-  /** Alpha Picture of the Window */
+  /** Alpha Picture of this opacity level (None until needed) */
   xcb_render_picture_t picture;
   /** Number of windows currently using this Picture (free the Picture
       once it reaches 0) */
   unsigned int reference_counter;
-  /** Alpha Picture opacity */
-  uint16_t opacity;
-  /** Double linked list, perhaps there is a more efficient way, such
-      as hash table but as there are usually not so many opacity
-      pictures... */
-  struct __render_alpha_picture_t *next;
-  struct __render_alpha_picture_t *previous;
 } _render_alpha_picture_t;
 
 /** Information related to Render */
@@ -60,8 +58,18 @@ typedef struct
   xcb_render_picture_t picture;
   /** Buffer Picture used to paint the windows before the root Picture */
   xcb_render_picture_t buffer_picture;
-  /** Picture associated with the background Pixmap */
+  /** Screen-sized Picture holding the background and static windows
+      at the bottom of the stack (created when needed) */
+  xcb_render_picture_t underlay_picture;
+  /** Picture windows are currently painted to (either the buffer or the
+      underlay Picture) */
+  xcb_render_picture_t paint_picture;
+  /** Screen-sized Picture  holding the background  image (already
+      tiled) rendered once when the background is reset */
   xcb_render_picture_t background_picture;
+  /** Region of the root Picture tinted by the damage overlay on the
+      last frame, painted again from the buffer Picture on the next one */
+  xcb_xfixes_region_t overlay_region;
   /** All Picture formats supported by the screen */
   xcb_render_query_pict_formats_reply_t *pict_formats;
   /** A8 PictFormat used mainly for alpha Picture (opacity) */
@@ -73,8 +81,17 @@ typedef struct
   /** Only the opacity plugins needs such hook ATM, but well something
       more generic will be written if needed */
   plugin_t *opacity_plugin;
-  /** Alpha pictures list */
+  /** Alpha pictures table indexed by quantized opacity level */
   _render_alpha_picture_t *alpha_pictures;
+  /** Number of entries of the alpha pictures table, the last one
+      being the opaque level (thus never allocated) */
+  uint32_t alpha_levels;
+  /** Whether  RenderCreateSolidFill  is  supported (Render  >=  0.10)
+      which avoids creating a Pixmap for each alpha Picture */
+  bool has_solid_fill;
+  /** Whether   RenderSetPictureTransform  and   RenderSetPictureFilter
+      are supported (Render >= 0.6) to scale windows in the X server */
+  bool has_transform;
 } _render_conf_t;
 
 static _render_conf_t _render_conf;
@@ -88,6 +105,15 @@ typedef struct
   bool is_argb;
   /** Pointer to global alpha picture */
   _render_alpha_picture_t *alpha_picture;
+  /** Quantized opacity level of the alpha picture */
+  uint32_t alpha_level;
+  /** Whether the  Picture is scaled from  its original size  to the
+      window geometry when painted */
+  bool is_scaled;
+  /** Original width of the Pixmap including border (if scaled) */
+  uint16_t scale_width;
+  /** Original height of the Pixmap including border (if scaled) */
+  uint16_t scale_height;
 } _render_window_t;
 
 /** Request label of Render extension for X error reporting, which are
@@ -186,7 +212,21 @@ render_init(void)
   window_get_root_background_pixmap();
 
   _render_conf.opacity_plugin = plugin_search_by_name("opacity");
-  _render_conf.alpha_pictures = NULL;
+
+  /* The alpha Pictures  are only created when  needed, but allocating
+     the table now allows direct lookups when painting */
+  long alpha_levels = cfg_getint(globalconf.cfg, "alpha_levels");
+  if(alpha_levels < 2 || alpha_levels > UINT16_MAX + 1)
+    {
+      warn("Invalid alpha_levels value %ld, set it to %d", alpha_levels,
+           RENDER_DEFAULT_ALPHA_LEVELS);
+
+      alpha_levels = RENDER_DEFAULT_ALPHA_LEVELS;
+    }
+
+  _render_conf.alpha_levels = (uint32_t) alpha_levels;
+  _render_conf.alpha_pictures = calloc(_render_conf.alpha_levels,
+                                       sizeof(_render_alpha_picture_t));
 
   return true;
 }
@@ -228,7 +268,8 @@ _render_paint_root_buffer_to_root(void)
 		       globalconf.screen->height_in_pixels);
 }
 
-/** Paint the background to the buffer Picture */
+/** Paint the background to the buffer Picture, which is a plain copy
+ *  as the background Picture is already screen-sized and opaque */
 static inline void
 _render_paint_root_background_to_buffer(void)
 {
@@ -239,6 +280,42 @@ _render_paint_root_background_to_buffer(void)
 		       globalconf.screen->height_in_pixels);
 }
 
+/** Render the  background Picture, which  may be tiled or  not match
+ *  the screen size, once in a screen-sized Picture which then replaces
+ *  the background  Picture.  This way, the  server does not  have to
+ *  perform  the tiling  again  on each  repaint  but simply  copy the
+ *  damaged area
+ */
+static void
+_render_cache_root_background(void)
+{
+  xcb_pixmap_t pixmap = xid_generate(XID_TYPE_PIXMAP);
+
+  xcb_create_pixmap(globalconf.connection, globalconf.screen->root_depth, pixmap,
+                    globalconf.screen->root, globalconf.screen->width_in_pixels,
+                    globalconf.screen->height_in_pixels);
+
+  xcb_render_picture_t cache_picture = xid_generate(XID_TYPE_PICTURE);
+
+  xcb_render_create_picture(globalconf.connection, cache_picture, pixmap,
+                            _render_conf.pictvisual->format, 0, NULL);
+
+  xid_free(XID_TYPE_PIXMAP, pixmap);
+  xcb_free_pixmap(globalconf.connection, pixmap);
+
+  xcb_render_composite(globalconf.connection, XCB_RENDER_PICT_OP_SRC,
+		       _render_conf.background_picture, XCB_NONE,
+		       cache_picture, 0, 0, 0, 0, 0, 0,
+		       globalconf.screen->width_in_pixels,
+		       globalconf.screen->height_in_pixels);
+
+  xid_free(XID_TYPE_PICTURE, _render_conf.background_picture);
+  xcb_render_free_picture(globalconf.connection,
+                          _render_conf.background_picture);
+
+  _render_conf.background_picture = cache_picture;
+}
+
 /** Create the root background  Picture associated with the background
  *  image Pixmap  (as given by _XROOTPMAP_ID or  _XSETROOT_ID) if any,
  *  otherwise, fill the background with a color
@@ -257,7 +334,7 @@ _render_init_root_background(void)
       root_background_fill = true;
     }
 
-  _render_conf.background_picture = xcb_generate_id(globalconf.connection);
+  _render_conf.background_picture = xid_generate(XID_TYPE_PICTURE);
   const uint32_t root_buffer_val = true;
 
   /* Create  a new  picture holding  the background  pixmap through  a
@@ -296,9 +373,12 @@ _render_init_root_background(void)
 
   if(root_background_fill)
     {
+      xid_free(XID_TYPE_PIXMAP, root_background_pixmap);
       xcb_free_pixmap(globalconf.connection, root_background_pixmap);
       _render_root_background_fill();
     }
+
+  _render_cache_root_background();
 }
 
 /** Create the  Picture associated  with the root  Window and  get its
@@ -342,7 +422,7 @@ _render_init_root_picture(void)
 
   /* Create Picture associated with the root window */
   {
-    _render_conf.picture = xcb_generate_id(globalconf.connection);
+    _render_conf.picture = xid_generate(XID_TYPE_PICTURE);
     const uint32_t root_picture_val = XCB_SUBWINDOW_MODE_INCLUDE_INFERIORS;
 
     xcb_render_create_picture(globalconf.connection,
@@ -356,13 +436,13 @@ _render_init_root_picture(void)
   /* Create a buffer Picture to  avoid image flickering when trying to
      draw on the root window Picture directly */
   {
-    xcb_pixmap_t pixmap = xcb_generate_id(globalconf.connection);
+    xcb_pixmap_t pixmap = xid_generate(XID_TYPE_PIXMAP);
     
     xcb_create_pixmap(globalconf.connection, globalconf.screen->root_depth, pixmap,
 		      globalconf.screen->root, globalconf.screen->width_in_pixels,
 		      globalconf.screen->height_in_pixels);
 
-    _render_conf.buffer_picture = xcb_generate_id(globalconf.connection);
+    _render_conf.buffer_picture = xid_generate(XID_TYPE_PICTURE);
 
     xcb_render_create_picture(globalconf.connection,
 			      _render_conf.buffer_picture,
@@ -370,9 +450,12 @@ _render_init_root_picture(void)
 			      _render_conf.pictvisual->format,
 			      0, NULL);
 
+    xid_free(XID_TYPE_PIXMAP, pixmap);
     xcb_free_pixmap(globalconf.connection, pixmap);
   }
 
+  _render_conf.paint_picture = _render_conf.buffer_picture;
+
   /* Initialise the root background Picture */
   _render_init_root_background();
 
@@ -399,6 +482,14 @@ render_init_finalise(void)
       return false;
     }
 
+  /* RenderCreateSolidFill has been introduced in Render 0.10 */
+  _render_conf.has_solid_fill = (render_version_reply->major_version > 0 ||
+                                 render_version_reply->minor_version >= 10);
+
+  /* Picture transforms and filters have been introduced in Render 0.6 */
+  _render_conf.has_transform = (render_version_reply->major_version > 0 ||
+                                render_version_reply->minor_version >= 6);
+
   free(render_version_reply);
 
   return _render_init_root_picture();
@@ -410,50 +501,74 @@ render_init_finalise(void)
 static void
 render_reset_background(void)
 {
+  xid_free(XID_TYPE_PICTURE, _render_conf.background_picture);
   xcb_render_free_picture(globalconf.connection,
 			  _render_conf.background_picture);
 
+  /* The screen may have been resized, so create the underlay again when
+     needed */
+  if(_render_conf.underlay_picture != XCB_NONE)
+    {
+      xid_free(XID_TYPE_PICTURE, _render_conf.underlay_picture);
+      xcb_render_free_picture(globalconf.connection,
+                              _render_conf.underlay_picture);
+
+      _render_conf.underlay_picture = XCB_NONE;
+    }
+
   /* Send requests to get the root window background pixmap */
   window_get_root_background_pixmap();
 
   _render_init_root_background();
 }
 
-/** Create the alpha Picture associated  with a window by only filling
- *  it with the alpha channel value
+/** Get the quantized opacity level of the given opacity value, which
+ *  is the index in the alpha Pictures table
  *
- * \param render_window Rendering backend window
  * \param opacity The Window opacity
- * \return The newly created alpha picture data structure
+ * \return The opacity level
  */
-static _render_alpha_picture_t *
-_render_create_window_alpha_picture(_render_window_t *render_window,
-                                    const uint16_t opacity)
+static inline uint32_t
+_render_get_alpha_level(const uint16_t opacity)
 {
-  /* Create a new global alpha_picture */
-  _render_alpha_picture_t *alpha_picture = malloc(sizeof(_render_alpha_picture_t));
-  render_window->alpha_picture = alpha_picture;
+  return (uint32_t) (((uint64_t) opacity * (_render_conf.alpha_levels - 1) +
+                      UINT16_MAX / 2) / UINT16_MAX);
+}
 
-  alpha_picture->reference_counter = 1;
-  alpha_picture->opacity = opacity;
+/** Create the alpha Picture of the  given opacity level, either as a
+ *  SolidFill Picture if supported, or by filling a 1x1 repeat Pixmap
+ *  with the alpha channel value
+ *
+ * \param alpha_picture The alpha Pictures table entry
+ * \param alpha_level The quantized opacity level
+ */
+static void
+_render_create_alpha_picture(_render_alpha_picture_t *alpha_picture,
+                             const uint32_t alpha_level)
+{
+  const xcb_render_color_t color = {
+    .red = 0, .green = 0, .blue = 0,
+    .alpha = (uint16_t) (((uint64_t) alpha_level * UINT16_MAX) /
+                         (_render_conf.alpha_levels - 1))
+  };
 
-  /* Insert it at the beginning of global alpha pictures list */
-  alpha_picture->previous = NULL;
-  alpha_picture->next = _render_conf.alpha_pictures;
-  if(_render_conf.alpha_pictures)
-    _render_conf.alpha_pictures->previous = alpha_picture;
+  alpha_picture->picture = xid_generate(XID_TYPE_PICTURE);
 
-  _render_conf.alpha_pictures = alpha_picture;
+  if(_render_conf.has_solid_fill)
+    {
+      xcb_render_create_solid_fill(globalconf.connection,
+                                   alpha_picture->picture, color);
 
-  const xcb_pixmap_t pixmap = xcb_generate_id(globalconf.connection);
+      return;
+    }
+
+  const xcb_pixmap_t pixmap = xid_generate(XID_TYPE_PIXMAP);
 
   xcb_create_pixmap(globalconf.connection, 8, pixmap,
 		    globalconf.screen->root, 1, 1);
 
   const uint32_t create_picture_val = true;
 
-  alpha_picture->picture = xcb_generate_id(globalconf.connection);
-
   xcb_render_create_picture(globalconf.connection,
                             alpha_picture->picture,
 			    pixmap,
@@ -461,11 +576,6 @@ _render_create_window_alpha_picture(_render_window_t *render_window,
 			    XCB_RENDER_CP_REPEAT,
 			    &create_picture_val);
 
-  const xcb_render_color_t color = {
-    .red = 0, .green = 0, .blue = 0,
-    .alpha = opacity
-  };
-
   const xcb_rectangle_t rect = { .x = 0, .y = 0, .width = 1, .height = 1 };
 
   xcb_render_fill_rectangles(globalconf.connection,
@@ -473,48 +583,35 @@ _render_create_window_alpha_picture(_render_window_t *render_window,
                              alpha_picture->picture,
 			     color, 1, &rect);
 
+  xid_free(XID_TYPE_PIXMAP, pixmap);
   xcb_free_pixmap(globalconf.connection, pixmap);
-
-  return alpha_picture;
 }
 
 /** Decrement  the reference  counter of  the alpha  picture currently
  *  associated  with  the  given  rendering  backend  window.  If  the
- *  reference counter reaches  0, then free its  Picture and allocated
- *  memory, and update the global alpha picture list.
+ *  reference counter reaches 0, then free its Picture (the table entry
+ *  itself is kept and will be filled again when needed)
  *
  * \param render_window Rendering backend window
  */
 static void
 _render_unref_window_alpha_picture(_render_window_t *render_window)
 {
-  if(render_window->alpha_picture->reference_counter == 1)
-    {
-      xcb_render_free_picture(globalconf.connection,
-                              render_window->alpha_picture->picture);
-
-      if(render_window->alpha_picture->previous)
-        render_window->alpha_picture->previous->next =
-          render_window->alpha_picture->next;
+  _render_alpha_picture_t *alpha_picture = render_window->alpha_picture;
 
-      if(render_window->alpha_picture->next)
-        render_window->alpha_picture->next->previous =
-          render_window->alpha_picture->previous;
-
-      if(render_window->alpha_picture == _render_conf.alpha_pictures)
-        _render_conf.alpha_pictures = _render_conf.alpha_pictures->next;
-
-      util_free(&render_window->alpha_picture);
-    }
-  else
+  if(--alpha_picture->reference_counter == 0)
     {
-      --render_window->alpha_picture->reference_counter;
-      render_window->alpha_picture = NULL;
+      xid_free(XID_TYPE_PICTURE, alpha_picture->picture);
+      xcb_render_free_picture(globalconf.connection, alpha_picture->picture);
+      alpha_picture->picture = XCB_NONE;
     }
+
+  render_window->alpha_picture = NULL;
 }
 
 /** Get the alpha Picture associated  with the given rendering backend
- *  window, and create it if it does not already exist.
+ *  window, and create it if it does not already exist.  The lookup is
+ *  done in constant time as the table is indexed by opacity level.
  *
  * \param render_window Rendering backend window
  * \param opacity New opacity value
@@ -524,34 +621,32 @@ static xcb_render_picture_t
 _render_get_window_alpha_picture(_render_window_t *render_window,
                                  const uint16_t opacity)
 {
+  const uint32_t alpha_level = _render_get_alpha_level(opacity);
+
   /* Return the Picture XID if  the opacity has not changed, otherwise
      decrement the reference counter of the previous alpha Picture */
   if(render_window->alpha_picture)
     {
-      if(render_window->alpha_picture->opacity == opacity)
+      if(render_window->alpha_level == alpha_level)
         return render_window->alpha_picture->picture;
       else
         _render_unref_window_alpha_picture(render_window);
     }
 
   /* Opaque Window, do nothing */
-  if(opacity == UINT16_MAX)
+  if(alpha_level == _render_conf.alpha_levels - 1)
     return XCB_NONE;
 
-  /* The opacity property  value has changed, try to get  one from the
-     cache if possible */
-  _render_alpha_picture_t *alpha_picture;
-  for(alpha_picture = _render_conf.alpha_pictures; alpha_picture;
-      alpha_picture = alpha_picture->next)
-    if(alpha_picture->opacity == opacity)
-      {
-        ++alpha_picture->reference_counter;
-        render_window->alpha_picture = alpha_picture;
-        return alpha_picture->picture;
-      }
+  _render_alpha_picture_t *alpha_picture = &_render_conf.alpha_pictures[alpha_level];
 
-  /* Otherwise, create a new one */
-  return _render_create_window_alpha_picture(render_window, opacity)->picture;
+  if(alpha_picture->picture == XCB_NONE)
+    _render_create_alpha_picture(alpha_picture, alpha_level);
+
+  ++alpha_picture->reference_counter;
+  render_window->alpha_picture = alpha_picture;
+  render_window->alpha_level = alpha_level;
+
+  return alpha_picture->picture;
 }
 
 /** Paint the root background to the buffer Picture */
@@ -565,6 +660,154 @@ render_paint_background(void)
   _render_paint_root_background_to_buffer();
 }
 
+/** Composite the window Picture to the Picture currently painted
+ *
+ * \param window The window to be painted
+ * \param render_window The rendering-specific window data
+ * \param op The Render composite operator
+ * \param alpha_picture The alpha mask Picture or None
+ */
+static inline void
+_render_composite_window(window_t *window,
+                         _render_window_t *render_window,
+                         uint8_t op,
+                         xcb_render_picture_t alpha_picture)
+{
+  window->cost.composite_calls++;
+
+  xcb_render_composite(globalconf.connection,
+		       op,
+		       render_window->picture,
+                       alpha_picture,
+                       _render_conf.paint_picture,
+		       0, 0, 0, 0,
+		       window->geometry->x,
+		       window->geometry->y,
+		       (uint16_t) (window->geometry->width +
+                                   window->geometry->border_width * 2),
+		       (uint16_t) (window->geometry->height +
+                                   window->geometry->border_width * 2));
+}
+
+/** Paint  an  ARGB  window  whose  opaque  Region  is  known  from
+ *  _NET_WM_OPAQUE_REGION: the  opaque part is simply copied  with Src
+ *  operator and only the remaining part is blended with Over operator
+ *
+ * \param window The window to be painted
+ * \param render_window The rendering-specific window data
+ * \param opaque_region The opaque Region relative to the window
+ */
+static void
+_render_paint_window_opaque_region(window_t *window,
+                                   _render_window_t *render_window,
+                                   xcb_xfixes_region_t opaque_region)
+{
+  const int16_t border_width = (int16_t) window->geometry->border_width;
+
+  /* The opaque Region is relative to the window inside its border */
+  xcb_rectangle_t window_rectangle = {
+    .x = (int16_t) -border_width,
+    .y = (int16_t) -border_width,
+    .width = window_width_with_border(window->geometry),
+    .height = window_height_with_border(window->geometry)
+  };
+
+  xcb_xfixes_region_t translucent_region = xid_generate(XID_TYPE_REGION);
+  xcb_xfixes_create_region(globalconf.connection, translucent_region, 1,
+                           &window_rectangle);
+
+  xcb_xfixes_subtract_region(globalconf.connection, translucent_region,
+                             opaque_region, translucent_region);
+
+  xcb_xfixes_set_picture_clip_region(globalconf.connection,
+                                     render_window->picture, opaque_region,
+                                     border_width, border_width);
+
+  _render_composite_window(window, render_window, XCB_RENDER_PICT_OP_SRC,
+                           XCB_NONE);
+
+  xcb_xfixes_set_picture_clip_region(globalconf.connection,
+                                     render_window->picture,
+                                     translucent_region,
+                                     border_width, border_width);
+
+  _render_composite_window(window, render_window, XCB_RENDER_PICT_OP_OVER,
+                           XCB_NONE);
+
+  xcb_xfixes_set_picture_clip_region(globalconf.connection,
+                                     render_window->picture, XCB_NONE, 0, 0);
+
+  xid_free(XID_TYPE_REGION, translucent_region);
+  xcb_xfixes_destroy_region(globalconf.connection, translucent_region);
+}
+
+/** Filter used when scaling window Pictures */
+#define RENDER_SCALE_FILTER "bilinear"
+
+/** Set the transform of the window Picture scaling its original size to
+ *  the current window geometry, along with a bilinear filter
+ *
+ * \param window The window object
+ * \param render_window The rendering-specific window data
+ */
+static void
+_render_set_picture_scale(window_t *window, _render_window_t *render_window)
+{
+  const uint16_t width = window_width_with_border(window->geometry);
+  const uint16_t height = window_height_with_border(window->geometry);
+
+  /* The matrix maps destination coordinates to source coordinates, as
+     16.16 fixed-point numbers */
+  const xcb_render_transform_t transform = {
+    (xcb_render_fixed_t) (((int64_t) render_window->scale_width << 16) / width),
+    0, 0,
+    0,
+    (xcb_render_fixed_t) (((int64_t) render_window->scale_height << 16) / height),
+    0,
+    0, 0, 1 << 16
+  };
+
+  xcb_render_set_picture_transform(globalconf.connection,
+                                   render_window->picture, transform);
+
+  xcb_render_set_picture_filter(globalconf.connection, render_window->picture,
+                                sizeof(RENDER_SCALE_FILTER) - 1,
+                                RENDER_SCALE_FILTER, 0, NULL);
+}
+
+/** Scale the  window Picture from its  original size to  the window
+ *  geometry when painting it, so no pixels have to be transferred to
+ *  the client to scale the window
+ *
+ * \param window The window object whose geometry is the scaled one
+ * \param width The original width including border
+ * \param height The original height including border
+ * \return false if not supported by the X server
+ */
+static bool
+render_set_window_scale(window_t *window, const uint16_t width,
+                        const uint16_t height)
+{
+  if(!_render_conf.has_transform || !width || !height ||
+     !window_width_with_border(window->geometry) ||
+     !window_height_with_border(window->geometry))
+    return false;
+
+  if(!window->rendering)
+    window->rendering = calloc(1, sizeof(_render_window_t));
+
+  _render_window_t *render_window = (_render_window_t *) window->rendering;
+
+  render_window->is_scaled = true;
+  render_window->scale_width = width;
+  render_window->scale_height = height;
+
+  if(render_window->picture != XCB_NONE)
+    _render_set_picture_scale(window, render_window);
+
+  return true;
+}
+
 /** Paint the window to the buffer Picture
  *
  * \param window The window to be painted
@@ -589,7 +832,7 @@ render_paint_window(window_t *window)
     {
       debug("Creating new picture for window %jx", (uintmax_t) window->id);
 
-      render_window->picture = xcb_generate_id(globalconf.connection);
+      render_window->picture = xid_generate(XID_TYPE_PICTURE);
       const uint32_t create_picture_val = XCB_SUBWINDOW_MODE_CLIP_BY_CHILDREN;
 
       xcb_render_pictvisual_t *window_pictvisual =
@@ -604,6 +847,9 @@ render_paint_window(window_t *window)
 				window_pictvisual->format,
 				XCB_RENDER_CP_SUBWINDOW_MODE,
 				&create_picture_val);
+
+      if(render_window->is_scaled)
+        _render_set_picture_scale(window, render_window);
     }
 
   uint8_t render_composite_op = XCB_RENDER_PICT_OP_SRC;
@@ -639,21 +885,217 @@ render_paint_window(window_t *window)
                                          window->geometry->border_width,
                                          window->geometry->border_width);
 
+      xid_free(XID_TYPE_REGION, shape_region);
       xcb_xfixes_destroy_region(globalconf.connection, shape_region);
     }
+  /* Fully opaque ARGB window with client-side decorations or shadows */
+  else if(render_window->is_argb && alpha_picture == XCB_NONE)
+    {
+      xcb_xfixes_region_t opaque_region = window_get_opaque_region(window);
+      if(opaque_region != XCB_NONE)
+        {
+          _render_paint_window_opaque_region(window, render_window,
+                                             opaque_region);
+          return;
+        }
+    }
 
-  xcb_render_composite(globalconf.connection,
-		       render_composite_op,
-		       render_window->picture,
-                       alpha_picture,
-                       _render_conf.buffer_picture,
-		       0, 0, 0, 0,
-		       window->geometry->x,
-		       window->geometry->y,
-		       (uint16_t) (window->geometry->width +
-                                   window->geometry->border_width * 2),
-		       (uint16_t) (window->geometry->height +
-                                   window->geometry->border_width * 2));
+  _render_composite_window(window, render_window, render_composite_op,
+                           alpha_picture);
+}
+
+/** Check whether the window has an alpha channel
+ *
+ * \param window The window object
+ * \return true if the window visual has an alpha channel
+ */
+static bool
+render_is_window_argb(window_t *window)
+{
+  if(window->rendering &&
+     ((_render_window_t *) window->rendering)->picture != XCB_NONE)
+    return ((_render_window_t *) window->rendering)->is_argb;
+
+  xcb_render_pictvisual_t *window_pictvisual =
+    xcb_render_util_find_visual_format(_render_conf.pict_formats,
+                                       window->attributes->visual);
+
+  return (window_pictvisual &&
+          window_pictvisual->format == _render_conf.argb_pictformat_id);
+}
+
+/** Create the underlay Picture, which  has the same size as the screen
+ *  and is entirely repainted afterwards
+ */
+static void
+_render_init_underlay_picture(void)
+{
+  xcb_pixmap_t pixmap = xid_generate(XID_TYPE_PIXMAP);
+
+  xcb_create_pixmap(globalconf.connection, globalconf.screen->root_depth, pixmap,
+                    globalconf.screen->root, globalconf.screen->width_in_pixels,
+                    globalconf.screen->height_in_pixels);
+
+  _render_conf.underlay_picture = xid_generate(XID_TYPE_PICTURE);
+
+  xcb_render_create_picture(globalconf.connection,
+                            _render_conf.underlay_picture,
+                            pixmap,
+                            _render_conf.pictvisual->format,
+                            0, NULL);
+
+  xid_free(XID_TYPE_PIXMAP, pixmap);
+  xcb_free_pixmap(globalconf.connection, pixmap);
+
+  globalconf.underlay_reset = true;
+}
+
+/** Repaint the  background to the damaged  Region of the  underlay and
+ *  paint the next windows there until render_paint_underlay_end()
+ *
+ * \return false if the underlay does not need to be repainted
+ */
+static bool
+render_paint_underlay_begin(void)
+{
+  if(_render_conf.underlay_picture == XCB_NONE)
+    _render_init_underlay_picture();
+
+  if(!globalconf.underlay_reset && !globalconf.underlay_damaged)
+    return false;
+
+  /* A None Region removes the clip, thus repaint the whole underlay */
+  xcb_xfixes_set_picture_clip_region(globalconf.connection,
+                                     _render_conf.underlay_picture,
+                                     globalconf.underlay_reset ?
+                                     XCB_NONE : globalconf.underlay_damaged,
+                                     0, 0);
+
+  xcb_render_composite(globalconf.connection, XCB_RENDER_PICT_OP_SRC,
+		       _render_conf.background_picture, XCB_NONE,
+		       _render_conf.underlay_picture, 0, 0, 0, 0, 0, 0,
+		       globalconf.screen->width_in_pixels,
+		       globalconf.screen->height_in_pixels);
+
+  _render_conf.paint_picture = _render_conf.underlay_picture;
+  return true;
+}
+
+/** Paint the  damaged Region  of the underlay  to the  buffer Picture,
+ *  which replaces painting the background and the windows it holds
+ */
+static void
+render_paint_underlay_end(void)
+{
+  _render_conf.paint_picture = _render_conf.buffer_picture;
+
+  xcb_xfixes_set_picture_clip_region(globalconf.connection,
+                                     _render_conf.buffer_picture,
+                                     globalconf.damaged, 0, 0);
+
+  xcb_render_composite(globalconf.connection, XCB_RENDER_PICT_OP_SRC,
+		       _render_conf.underlay_picture, XCB_NONE,
+		       _render_conf.buffer_picture, 0, 0, 0, 0, 0, 0,
+		       globalconf.screen->width_in_pixels,
+		       globalconf.screen->height_in_pixels);
+}
+
+/** Tint the root Picture once the buffer Picture has been painted to
+ *  it, thus the tints are never kept in the buffer Picture: the area
+ *  tinted on the previous frame is first painted again from the buffer
+ *  Picture, then the damaged Region  is tinted with a colour changing
+ *  at each frame, the windows repainted in full in red and the damaged
+ *  windows  which have not been painted in blue.  The latter are not
+ *  clipped to the damaged Region, which does not include occluded
+ *  windows
+ *
+ * \param full_rectangles The windows repainted in full
+ * \param full_rectangles_len The number of windows repainted in full
+ * \param skipped_rectangles The damaged windows not painted
+ * \param skipped_rectangles_len The number of damaged windows not painted
+ */
+static void
+render_paint_damage_overlay(const xcb_rectangle_t *full_rectangles,
+                            const uint32_t full_rectangles_len,
+                            const xcb_rectangle_t *skipped_rectangles,
+                            const uint32_t skipped_rectangles_len)
+{
+  /* Premultiplied alpha colors */
+  static const xcb_render_color_t damaged_colors[] = {
+    { 0x4000, 0x4000, 0x0000, 0x4000 },
+    { 0x0000, 0x4000, 0x4000, 0x4000 },
+    { 0x4000, 0x0000, 0x4000, 0x4000 }
+  };
+  static const xcb_render_color_t full_color = { 0x6000, 0x0000, 0x0000, 0x6000 };
+  static const xcb_render_color_t skipped_color = { 0x0000, 0x0000, 0x6000, 0x6000 };
+
+  static unsigned int frame_n = 0;
+
+  const xcb_rectangle_t screen_rectangle = {
+    0, 0,
+    globalconf.screen->width_in_pixels, globalconf.screen->height_in_pixels
+  };
+
+  if(_render_conf.overlay_region != XCB_NONE)
+    {
+      xcb_xfixes_set_picture_clip_region(globalconf.connection,
+                                         _render_conf.picture,
+                                         _render_conf.overlay_region, 0, 0);
+
+      xcb_render_composite(globalconf.connection, XCB_RENDER_PICT_OP_SRC,
+                           _render_conf.buffer_picture, XCB_NONE,
+                           _render_conf.picture, 0, 0, 0, 0, 0, 0,
+                           globalconf.screen->width_in_pixels,
+                           globalconf.screen->height_in_pixels);
+    }
+  else
+    {
+      _render_conf.overlay_region = xid_generate(XID_TYPE_REGION);
+      xcb_xfixes_create_region(globalconf.connection,
+                               _render_conf.overlay_region, 0, NULL);
+    }
+
+  xcb_xfixes_set_picture_clip_region(globalconf.connection,
+                                     _render_conf.picture,
+                                     globalconf.damaged, 0, 0);
+
+  xcb_render_fill_rectangles(globalconf.connection, XCB_RENDER_PICT_OP_OVER,
+                             _render_conf.picture,
+                             damaged_colors[frame_n++ %
+                                            (sizeof(damaged_colors) /
+                                             sizeof(damaged_colors[0]))],
+                             1, &screen_rectangle);
+
+  xcb_xfixes_set_picture_clip_region(globalconf.connection,
+                                     _render_conf.picture,
+                                     XCB_NONE, 0, 0);
+
+  if(full_rectangles_len)
+    xcb_render_fill_rectangles(globalconf.connection, XCB_RENDER_PICT_OP_OVER,
+                               _render_conf.picture, full_color,
+                               full_rectangles_len, full_rectangles);
+
+  if(skipped_rectangles_len)
+    xcb_render_fill_rectangles(globalconf.connection, XCB_RENDER_PICT_OP_OVER,
+                               _render_conf.picture, skipped_color,
+                               skipped_rectangles_len, skipped_rectangles);
+
+  /* Area tinted by this frame, thus painted again on the next one */
+  xcb_xfixes_set_region(globalconf.connection, _render_conf.overlay_region,
+                        full_rectangles_len, full_rectangles);
+
+  xcb_xfixes_region_t skipped_region = xid_generate(XID_TYPE_REGION);
+  xcb_xfixes_create_region(globalconf.connection, skipped_region,
+                           skipped_rectangles_len, skipped_rectangles);
+
+  xcb_xfixes_union_region(globalconf.connection, _render_conf.overlay_region,
+                          skipped_region, _render_conf.overlay_region);
+
+  xcb_xfixes_union_region(globalconf.connection, _render_conf.overlay_region,
+                          globalconf.damaged, _render_conf.overlay_region);
+
+  xid_free(XID_TYPE_REGION, skipped_region);
+  xcb_xfixes_destroy_region(globalconf.connection, skipped_region);
 }
 
 /** Routine to  paint everything on  the root Picture, it  just paints
@@ -726,6 +1168,7 @@ render_free_window_pixmap(window_t *window)
 
   if(render_window && render_window->picture != XCB_NONE)
     {
+      xid_free(XID_TYPE_PICTURE, render_window->picture);
       xcb_render_free_picture(globalconf.connection, render_window->picture);
       render_window->picture = XCB_NONE;
     }
@@ -752,10 +1195,36 @@ render_free_window(window_t *window)
 static void  __attribute__((destructor))
 render_free(void)
 {
+  for(uint32_t alpha_level = 0; alpha_level < _render_conf.alpha_levels;
+      alpha_level++)
+    if(_render_conf.alpha_pictures[alpha_level].picture != XCB_NONE)
+      {
+        xid_free(XID_TYPE_PICTURE,
+                 _render_conf.alpha_pictures[alpha_level].picture);
+        xcb_render_free_picture(globalconf.connection,
+                                _render_conf.alpha_pictures[alpha_level].picture);
+      }
+
+  free(_render_conf.alpha_pictures);
   free(_render_conf.pict_formats);
+  xid_free(XID_TYPE_PICTURE, _render_conf.background_picture);
   xcb_render_free_picture(globalconf.connection, _render_conf.background_picture);
+  xid_free(XID_TYPE_PICTURE, _render_conf.picture);
   xcb_render_free_picture(globalconf.connection, _render_conf.picture);
+  xid_free(XID_TYPE_PICTURE, _render_conf.buffer_picture);
   xcb_render_free_picture(globalconf.connection, _render_conf.buffer_picture);
+
+  if(_render_conf.underlay_picture != XCB_NONE)
+    {
+      xid_free(XID_TYPE_PICTURE, _render_conf.underlay_picture);
+      xcb_render_free_picture(globalconf.connection, _render_conf.underlay_picture);
+    }
+
+  if(_render_conf.overlay_region != XCB_NONE)
+    {
+      xid_free(XID_TYPE_REGION, _render_conf.overlay_region);
+      xcb_xfixes_destroy_region(globalconf.connection, _render_conf.overlay_region);
+    }
 }
 
 /** Structure holding all the functions addresses */
@@ -770,5 +1239,10 @@ rendering_t rendering_functions = {
   render_error_get_request_label,
   render_error_get_error_label,
   render_free_window_pixmap,
-  render_free_window
+  render_free_window,
+  render_paint_underlay_begin,
+  render_paint_underlay_end,
+  render_is_window_argb,
+  render_set_window_scale,
+  render_paint_damage_overlay
 };
@@ -35,6 +35,7 @@
 
 /** Atoms used but not defined in either ICCCM and EWMH */
 xcb_atom_t _NET_WM_WINDOW_OPACITY;
+xcb_atom_t _NET_WM_OPAQUE_REGION;
 xcb_atom_t _XROOTPMAP_ID;
 xcb_atom_t _XSETROOT_ID;
 
@@ -55,6 +56,7 @@ typedef struct {
     xcb-util/ewmh library) */
 static atom_t atoms_list[] = {
   { &_NET_WM_WINDOW_OPACITY, { 0 }, sizeof("_NET_WM_WINDOW_OPACITY") - 1, "_NET_WM_WINDOW_OPACITY" },
+  { &_NET_WM_OPAQUE_REGION, { 0 }, sizeof("_NET_WM_OPAQUE_REGION") - 1, "_NET_WM_OPAQUE_REGION" },
   { &_XROOTPMAP_ID, { 0 }, sizeof("_XROOTPMAP_ID") - 1, "_XROOTPMAP_ID" },
   { &_XSETROOT_ID, { 0 }, sizeof("_XSETROOT_ID") - 1, "_XSETROOT_ID" }
 };
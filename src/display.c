@@ -29,6 +29,7 @@
 #include <xcb/xfixes.h>
 #include <xcb/damage.h>
 #include <xcb/randr.h>
+#include <xcb/res.h>
 #include <xcb/xcb_ewmh.h>
 #include <xcb/xcb_aux.h>
 
@@ -49,6 +50,8 @@ typedef struct {
   xcb_composite_query_version_cookie_t composite;
   /** RandR QueryVersion request cookie */
   xcb_randr_query_version_cookie_t randr;
+  /** X-Resource QueryVersion request cookie */
+  xcb_res_query_version_cookie_t res;
 }  init_extensions_cookies_t;
 
 /** NOTICE:  All above  variables are  not thread-safe,  but  well, we
@@ -57,7 +60,7 @@ typedef struct {
 /** Initialise the  QueryVersion extensions cookies with  a 0 sequence
     number, this  is not thread-safe but  we don't care here  as it is
     only used during initialisation */
-static init_extensions_cookies_t _init_extensions_cookies = {{0}, {0}, {0}, {0}};
+static init_extensions_cookies_t _init_extensions_cookies = {{0}, {0}, {0}, {0}, {0}};
 
 /** Cookie request used when acquiring ownership on _NET_WM_CM_Sn */
 static xcb_get_selection_owner_cookie_t _get_wm_cm_owner_cookie = { 0 };
@@ -88,6 +91,9 @@ display_init_extensions(void)
   globalconf.extensions.randr = xcb_get_extension_data(globalconf.connection,
                                                        &xcb_randr_id);
 
+  globalconf.extensions.res = xcb_get_extension_data(globalconf.connection,
+                                                     &xcb_res_id);
+
   if(!globalconf.extensions.composite ||
      !globalconf.extensions.composite->present)
     fatal("No Composite extension");
@@ -131,6 +137,14 @@ display_init_extensions(void)
                               XCB_RANDR_MINOR_VERSION);
   else
     globalconf.extensions.randr = NULL;
+
+  if(globalconf.extensions.res && globalconf.extensions.res->present)
+    _init_extensions_cookies.res =
+      xcb_res_query_version(globalconf.connection,
+                            XCB_RES_MAJOR_VERSION,
+                            XCB_RES_MINOR_VERSION);
+  else
+    globalconf.extensions.res = NULL;
 }
 
 /** Get the  replies of the QueryVersion requests  previously sent and
@@ -201,6 +215,24 @@ display_init_extensions_finalise(void)
 
       free(randr_version_reply);
     }
+
+  /* Need QueryClientIds introduced in version >= 1.2 */
+  if(globalconf.extensions.res)
+    {
+      assert(_init_extensions_cookies.res.sequence);
+
+      xcb_res_query_version_reply_t *res_version_reply =
+        xcb_res_query_version_reply(globalconf.connection,
+                                    _init_extensions_cookies.res,
+                                    NULL);
+
+      if(!res_version_reply || res_version_reply->server_major < 1 ||
+         (res_version_reply->server_major == 1 &&
+          res_version_reply->server_minor < 2))
+        globalconf.extensions.res = NULL;
+
+      free(res_version_reply);
+    }
 }
 
 /** Handler for  PropertyNotify event meaningful to  set the timestamp
@@ -352,6 +384,10 @@ display_add_damaged_region(xcb_xfixes_region_t *region,
   if(!*region)
     return;
 
+  globalconf.damage_overlay_clear = false;
+
+  const double trace_union_begin = trace_begin();
+
   if(globalconf.damaged)
     {
       xcb_xfixes_union_region(globalconf.connection, globalconf.damaged,
@@ -360,7 +396,10 @@ display_add_damaged_region(xcb_xfixes_region_t *region,
       debug("Added %x to damaged region %x", *region, globalconf.damaged);
 
       if(do_destroy_region)
-        xcb_xfixes_destroy_region(globalconf.connection, *region);
+        {
+          xid_free(XID_TYPE_REGION, *region);
+          xcb_xfixes_destroy_region(globalconf.connection, *region);
+        }
     }
   else
     {
@@ -370,7 +409,7 @@ display_add_damaged_region(xcb_xfixes_region_t *region,
          painting iteration */
       if(!do_destroy_region)
         {
-          globalconf.damaged = xcb_generate_id(globalconf.connection);
+          globalconf.damaged = xid_generate(XID_TYPE_REGION);
 
           xcb_xfixes_create_region(globalconf.connection,
                                    globalconf.damaged,
@@ -388,6 +427,21 @@ display_add_damaged_region(xcb_xfixes_region_t *region,
 
   if(do_destroy_region)
     *region = XCB_NONE;
+
+  trace_end("phase", "damage_union", 0, trace_union_begin);
+}
+
+/** Damage the whole screen, meaningful to repaint everything */
+void
+display_damage_screen(void)
+{
+  const xcb_rectangle_t rectangle = { 0, 0,
+                                      globalconf.screen->width_in_pixels,
+                                      globalconf.screen->height_in_pixels };
+
+  xcb_xfixes_region_t region = xid_generate(XID_TYPE_REGION);
+  xcb_xfixes_create_region(globalconf.connection, region, 1, &rectangle);
+  display_add_damaged_region(&region, true);
 }
 
 /** Destroy the global  damaged Region and set it  to None, meaningful
@@ -397,10 +451,79 @@ display_add_damaged_region(xcb_xfixes_region_t *region,
 void
 display_reset_damaged(void)
 {
+  xid_free(XID_TYPE_REGION, globalconf.damaged);
   xcb_xfixes_destroy_region(globalconf.connection, globalconf.damaged);
   globalconf.damaged = XCB_NONE;
 }
 
+/** After a frame tinted by the damage overlay, set the damaged Region
+ *  to an empty Region, thus one more frame is painted to remove these
+ *  tints even if nothing is damaged in the meantime
+ */
+void
+display_clear_damage_overlay(void)
+{
+  /* The frame  just painted was only  removing the tints, unless the
+     damaged Region has been added to since */
+  if(!globalconf.damage_overlay || globalconf.damage_overlay_clear)
+    {
+      globalconf.damage_overlay_clear = false;
+      return;
+    }
+
+  globalconf.damaged = xid_generate(XID_TYPE_REGION);
+  xcb_xfixes_create_region(globalconf.connection, globalconf.damaged, 0, NULL);
+  globalconf.damage_overlay_clear = true;
+}
+
+/** Add the given Region  to the damaged Region of  the underlay, which
+ *  is always copied as it is  generally also added to the global one
+ *
+ * \param region Damaged Region to be added to the underlay one
+ */
+void
+display_add_underlay_damaged_region(const xcb_xfixes_region_t region)
+{
+  if(!region || globalconf.underlay_reset)
+    return;
+
+  if(!globalconf.underlay_damaged)
+    {
+      globalconf.underlay_damaged = xid_generate(XID_TYPE_REGION);
+
+      xcb_xfixes_create_region(globalconf.connection,
+                               globalconf.underlay_damaged,
+                               0, NULL);
+
+      xcb_xfixes_copy_region(globalconf.connection, region,
+                             globalconf.underlay_damaged);
+    }
+  else
+    xcb_xfixes_union_region(globalconf.connection, globalconf.underlay_damaged,
+                            region, globalconf.underlay_damaged);
+
+  debug("Added %x to underlay damaged region %x", region,
+        globalconf.underlay_damaged);
+}
+
+/** Destroy the damaged Region of  the underlay once it has been
+ *  repainted
+ */
+void
+display_reset_underlay_damaged(void)
+{
+  if(globalconf.underlay_damaged)
+    {
+      xid_free(XID_TYPE_REGION, globalconf.underlay_damaged);
+      xcb_xfixes_destroy_region(globalconf.connection,
+                                globalconf.underlay_damaged);
+
+      globalconf.underlay_damaged = XCB_NONE;
+    }
+
+  globalconf.underlay_reset = false;
+}
+
 /** Set the screen refresh rate, necessary to calculate the interval
  *  between painting
  */
@@ -31,6 +31,9 @@
 #include "structs.h"
 #include "util.h"
 #include "window.h"
+#include "ghost.h"
+#include "record.h"
+#include "trace.h"
 #include "atoms.h"
 #include "key.h"
 
@@ -246,6 +249,8 @@ event_handle_damage_notify(xcb_damage_notify_event_t *event)
 	(uintmax_t) event->geometry.width, (uintmax_t) event->geometry.height,
 	(uintmax_t) event->geometry.x, (uintmax_t) event->geometry.y);
 
+  globalconf.metrics.damage_notify_counter++;
+
 #ifdef __DEBUG__
   static unsigned int damage_notify_event_counter = 0;
   debug("DamageNotify: COUNT: %u", ++damage_notify_event_counter);
@@ -259,9 +264,42 @@ event_handle_damage_notify(xcb_damage_notify_event_t *event)
      so do nothing */
   if(!window || !window_is_visible(window))
     return;
+
+  window->cost.damage_notify++;
+  window->cost.damaged_area += (uint32_t) event->area.width * event->area.height;
+
+  /* Ignore damages of windows on another desktop or minimized, whose
+     hidden state is  updated on MapNotify and PropertyNotify, but get
+     the next ones as they are repainted entirely once shown again */
+  if(window->is_hidden)
+    {
+      xcb_damage_subtract(globalconf.connection, window->damage,
+                          XCB_NONE, XCB_NONE);
+      return;
+    }
+
+  /* The window has drawn its  new contents since mapped again, thus
+     stop painting its last ones and repaint it entirely */
+  if(window->is_pixmap_ghost)
+    {
+      window_free_pixmap(window);
+      window->pixmap = window_get_pixmap(window);
+      window->damaged = false;
+    }
+
+  /* Keep track of how often the window is damaged to determine whether
+     it should be painted in the underlay */
+  const ev_tstamp now = ev_now(globalconf.event_loop);
+  window->damage_interval = now - window->damage_timestamp;
+  window->damage_timestamp = now;
+
+  /* Damage-to-screen latency is measured from the oldest damage */
+  if(!window->damage_arrival)
+    window->damage_arrival = now;
+
   /* If the Window has never been  damaged, then it means it has never
      be painted on the screen yet, thus paint its entire content */
-  else if(!window->damaged)
+  if(!window->damaged)
     {
       damaged_region = window->region;
       window->damaged = true;
@@ -294,16 +332,25 @@ event_handle_damage_notify(xcb_damage_notify_event_t *event)
      Window or part of it */
   else
     {
-      damaged_region = xcb_generate_id(globalconf.connection);
-
-      event->area.x += event->geometry.x;
-      event->area.y += event->geometry.y;
+      /* The damaged area is relative to the window, the event is left
+         untouched as it is then given to the plugins */
+      const xcb_rectangle_t damaged_area = {
+        (int16_t) (event->area.x + event->geometry.x),
+        (int16_t) (event->area.y + event->geometry.y),
+        event->area.width,
+        event->area.height
+      };
+
+      damaged_region = xid_generate(XID_TYPE_REGION);
       xcb_xfixes_create_region(globalconf.connection, damaged_region,
-                               1, &event->area);
+                               1, &damaged_area);
 
       is_temporary_region = true;
     }
 
+  if(window->in_underlay)
+    display_add_underlay_damaged_region(damaged_region);
+
   display_add_damaged_region(&damaged_region, is_temporary_region);
 
   PLUGINS_EVENT_HANDLE(event, damage, window);
@@ -379,6 +426,10 @@ event_handle_circulate_notify(xcb_circulate_notify_event_t *event)
 	(uintmax_t) event->event, (uintmax_t) event->window);
 
   window_t *window = window_list_get(event->window);
+  if(!window)
+    return;
+
+  window_underlay_remove(window);
 
   /* Above window  of None means that  the window is  placed below all
      its siblings */
@@ -435,6 +486,9 @@ event_handle_configure_notify(xcb_configure_notify_event_t *event)
       return;
     }
 
+  /* The window has been moved, resized or restacked */
+  window_underlay_remove(window);
+
   /* Add the Window  Region to the damaged region  to clear old window
      position or size and re-create the Window Region as well
 
@@ -550,8 +604,12 @@ event_handle_destroy_notify(xcb_destroy_notify_event_t *event)
 
   /* If a DestroyNotify has been received, then the damage object have
      been freed automatically in the meantime */
+  xid_free(XID_TYPE_DAMAGE, window->damage);
   window->damage = XCB_NONE;
 
+  /* Keep its last contents, unless already done on UnmapNotify */
+  ghost_add(window);
+
   PLUGINS_EVENT_HANDLE(event, destroy, window);
 
   window_list_remove_window(window);
@@ -576,17 +634,32 @@ event_handle_map_notify(xcb_map_notify_event_t *event)
     }
 
   window->attributes->map_state = XCB_MAP_STATE_VIEWABLE;
+  window_underlay_remove(window);
 
   if(window_is_visible(window))
     {
       window->region = window_get_region(window, true, true);
 
-      /* Everytime a window is mapped, a new pixmap is created */
+      /* Everytime a window  is mapped, a new pixmap  is created, only
+         named on its first DamageNotify if the last contents of the
+         window, kept by its ghost, are painted in the meantime */
       window_free_pixmap(window);
-      window->pixmap = window_get_pixmap(window);
+      if(!ghost_restore(window))
+        window->pixmap = window_get_pixmap(window);
     }
+  /* The last contents are outdated now */
+  else
+    ghost_remove(window->id);
 
-  window->damaged = false;
+  /* Get PropertyNotify for _NET_WM_OPAQUE_REGION, which may have been
+     set before the window is mapped */
+  window_register_notify(window);
+  window_get_opaque_region_property(window);
+  window_get_hidden_properties(window);
+
+  window->damaged = window->is_pixmap_ghost;
+  if(window->damaged)
+    display_add_damaged_region(&window->region, false);
 
   PLUGINS_EVENT_HANDLE(event, map, window);
 }
@@ -638,12 +711,18 @@ event_handle_unmap_notify(xcb_unmap_notify_event_t *event)
       return;
     }
 
+  window_underlay_remove(window);
+
   if(window_is_visible(window))
     {
       display_add_damaged_region(&window->region, true);
       window->damaged_ratio = 1.0;
     }
 
+  /* Keep its last contents for plugins, also painted if the window
+     is mapped again with the same size until it draws new ones */
+  ghost_add(window);
+
   /* Update window state */
   window->attributes->map_state = XCB_MAP_STATE_UNMAPPED;
 
@@ -677,10 +756,34 @@ event_handle_property_notify(xcb_property_notify_event_t *event)
   if(event->atom == globalconf.ewmh._NET_SUPPORTED)
     atoms_update_supported(event);
 
+  /* The current desktop has changed, thus windows may be hidden */
+  if(event->atom == globalconf.ewmh._NET_CURRENT_DESKTOP &&
+     event->window == globalconf.screen->root)
+    {
+      window_get_current_desktop_property();
+      window_update_current_desktop();
+    }
+
   /* As plugins  requirements are  only atoms, if  the plugin  did not
      meet the requirements on startup, it can try again... */
   window_t *window = window_list_get(event->window);
 
+  /* The opaque  Region of the window  has changed, so repaint  it as a
+     whole */
+  if(window && event->atom == _NET_WM_OPAQUE_REGION)
+    {
+      window_get_opaque_region_property(window);
+      window_underlay_remove(window);
+
+      if(window_is_visible(window) && window->region != XCB_NONE)
+        display_add_damaged_region(&window->region, false);
+    }
+  /* The window has been moved to another desktop or (un)minimized,
+     updated once the events queue is drained */
+  else if(window && (event->atom == globalconf.ewmh._NET_WM_DESKTOP ||
+                     event->atom == globalconf.ewmh._NET_WM_STATE))
+    window_get_hidden_properties(window);
+
   for(plugin_t *plugin = globalconf.plugins; plugin; plugin = plugin->next)
     if(plugin->vtable->events.property)
       {
@@ -718,12 +821,12 @@ event_handle_mapping_notify(xcb_mapping_notify_event_t *event)
   key_lock_mask_get_reply(key_mapping_cookie);
 }
 
-/** Initialise errors and events handlers
+/** Call the handler of the given X event
  *
- * \see display_init_redirect
+ * \param event The X event
  */
-void
-event_handle(xcb_generic_event_t *event)
+static void
+event_handle_dispatch(xcb_generic_event_t *event)
 {
   const uint8_t response_type = XCB_EVENT_RESPONSE_TYPE(event);
 
@@ -765,6 +868,47 @@ event_handle(xcb_generic_event_t *event)
     }
 }
 
+/** Get the name of an event for tracing
+ *
+ * \param response_type The event response type
+ * \return The event name (never NULL)
+ */
+static const char *
+event_get_trace_label(const uint8_t response_type)
+{
+  if(response_type == 0)
+    return "Error";
+  else if(response_type == (globalconf.extensions.damage->first_event +
+                            XCB_DAMAGE_NOTIFY))
+    return "DamageNotify";
+  else if(globalconf.extensions.randr &&
+          response_type == (globalconf.extensions.randr->first_event +
+                            XCB_RANDR_SCREEN_CHANGE_NOTIFY))
+    return "RandrScreenChangeNotify";
+
+  const char *label = xcb_event_get_label(response_type);
+  return label ? label : "Unknown";
+}
+
+/** Initialise errors and events handlers, recording and tracing the
+ *  events if requested
+ *
+ * \see display_init_redirect
+ */
+void
+event_handle(xcb_generic_event_t *event)
+{
+  record_event(event);
+
+  const double trace_event_begin = trace_begin();
+  event_handle_dispatch(event);
+
+  if(trace_event_begin)
+    trace_end("event",
+              event_get_trace_label(XCB_EVENT_RESPONSE_TYPE(event)),
+              0, trace_event_begin);
+}
+
 /** Handle all events in the queue
  *
  * \param event_handler The event handler function to call for each event
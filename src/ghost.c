@@ -0,0 +1,339 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Last contents of unmapped or destroyed windows
+ *
+ *  When a window is unmapped or destroyed, its last named Pixmap (which
+ *  remains valid  as long as  it is not  freed) and its  rendering
+ *  backend data (e.g. Render Picture) are moved to a ghost rather than
+ *  being dropped, so  plugins can animate from the last  contents of the
+ *  window without any round-trip.
+ *
+ *  The cache is bounded both in time and in memory, and ghosts are
+ *  reference-counted: a  ghost removed from the cache  (expired, evicted
+ *  or because  the window has been mapped  again) is only freed once
+ *  the plugins using it have released it.  The  expiry timer is only
+ *  armed while there are ghosts, for the oldest one.
+ *
+ *  When a window is mapped  again with the same size, its ghost gives
+ *  back its Pixmap  and rendering backend data,  painted until the
+ *  window draws its new contents.
+ *
+ *  No plugin shipped with unagi uses the ghosts yet: 'ghost_get' and
+ *  'ghost_unref' are the API provided to plugins, which would typically
+ *  get the ghost of a window from their unmap or destroy event handler
+ *  and paint its detached window object until their effect is over.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ghost.h"
+#include "structs.h"
+
+/** Copy the given memory area
+ *
+ * \param src The memory to copy
+ * \param size The size of the memory area
+ * \return The newly allocated copy
+ */
+static void *
+_ghost_memdup(const void *src, size_t size)
+{
+  void *dst = malloc(size);
+  memcpy(dst, src, size);
+  return dst;
+}
+
+/** Free a ghost and its associated resources
+ *
+ * \param ghost The ghost to free
+ */
+static void
+_ghost_free(ghost_t *ghost)
+{
+  debug("Freeing ghost of window %jx", (uintmax_t) ghost->id);
+
+  /* The Pixmap is  only accounted in the  ghosts cache size, already
+     updated when the ghost has been removed from the cache */
+  ghost->window->pixmap_size = 0;
+  window_free_pixmap(ghost->window);
+  (*globalconf.rendering->free_window)(ghost->window);
+
+  free(ghost->window->geometry);
+  free(ghost->window->attributes);
+  free(ghost->window);
+  free(ghost);
+}
+
+/** Arm the expiry timer for the oldest ghost, which is the last one as
+ *  the cache  is sorted from the newest  ghost, or stop it if the cache
+ *  is empty
+ */
+static void
+_ghost_update_timer(void)
+{
+  ev_timer *timer = &globalconf.event_ghost_timer_watcher;
+  ev_timer_stop(globalconf.event_loop, timer);
+
+  ghost_t *ghost_oldest = globalconf.ghosts;
+  if(!ghost_oldest)
+    return;
+
+  while(ghost_oldest->next)
+    ghost_oldest = ghost_oldest->next;
+
+  const ev_tstamp remaining = ghost_oldest->expiry -
+    ev_now(globalconf.event_loop);
+
+  ev_timer_set(timer, remaining > 0 ? remaining : 0, 0);
+  ev_timer_start(globalconf.event_loop, timer);
+}
+
+/** Remove a ghost from the cache, which is  freed if not used by any
+ *  plugin
+ *
+ * \param ghost The ghost to remove
+ */
+static void
+_ghost_detach(ghost_t *ghost)
+{
+  if(globalconf.ghosts == ghost)
+    globalconf.ghosts = ghost->next;
+  else
+    for(ghost_t *ghost_prev = globalconf.ghosts; ghost_prev;
+        ghost_prev = ghost_prev->next)
+      if(ghost_prev->next == ghost)
+        {
+          ghost_prev->next = ghost->next;
+          break;
+        }
+
+  ghost->next = NULL;
+  globalconf.ghosts_size -= ghost->window->pixmap_size;
+
+  /* Release the reference held by the cache */
+  ghost_unref(ghost);
+}
+
+/** Move the last Pixmap  and rendering backend data  of an unmapped or
+ *  destroyed window  to a new ghost,  the window does  not own them
+ *  anymore. The  oldest ghosts are removed  from the cache if  it does
+ *  not fit in the budget anymore
+ *
+ * \param window The window object being unmapped or destroyed
+ */
+void
+ghost_add(window_t *window)
+{
+  /* Only keep windows which have actually been painted */
+  if(globalconf.ghost_ttl <= 0 || window->pixmap == XCB_NONE ||
+     !window->damaged || window->is_hidden || !window_is_visible(window) ||
+     (globalconf.ghosts_budget &&
+      window->pixmap_size > globalconf.ghosts_budget))
+    return;
+
+  ghost_remove(window->id);
+
+  ghost_t *ghost = calloc(1, sizeof(ghost_t));
+  ghost->id = window->id;
+  ghost->expiry = ev_now(globalconf.event_loop) + globalconf.ghost_ttl;
+  ghost->reference_counter = 1;
+
+  ghost->window = calloc(1, sizeof(window_t));
+  ghost->window->id = window->id;
+  ghost->window->geometry = _ghost_memdup(window->geometry,
+                                          sizeof(xcb_get_geometry_reply_t));
+  ghost->window->attributes =
+    _ghost_memdup(window->attributes, sizeof(xcb_get_window_attributes_reply_t));
+
+  ghost->window->pixmap = window->pixmap;
+  ghost->window->pixmap_size = window->pixmap_size;
+  ghost->window->rendering = window->rendering;
+  ghost->window->damaged = true;
+
+  /* The Shape of the window cannot be  fetched anymore once it has been
+     destroyed */
+  ghost->window->is_rectangular = true;
+
+  /* The Pixmap is now accounted in the ghosts cache size, it cannot be
+     evicted to fit in the windows Pixmaps budget anymore */
+  globalconf.pixmaps_size -= window->pixmap_size;
+
+  window->pixmap = XCB_NONE;
+  window->pixmap_size = 0;
+  window->rendering = NULL;
+  window->is_pixmap_ghost = false;
+
+  debug("Adding ghost of window %jx (%ju bytes)", (uintmax_t) ghost->id,
+        (uintmax_t) ghost->window->pixmap_size);
+
+  /* The cache is sorted from the newest ghost */
+  ghost->next = globalconf.ghosts;
+  globalconf.ghosts = ghost;
+  globalconf.ghosts_size += ghost->window->pixmap_size;
+
+  while(globalconf.ghosts_budget &&
+        globalconf.ghosts_size > globalconf.ghosts_budget)
+    {
+      ghost_t *ghost_oldest = globalconf.ghosts;
+      while(ghost_oldest->next)
+        ghost_oldest = ghost_oldest->next;
+
+      _ghost_detach(ghost_oldest);
+    }
+
+  /* Otherwise, the timer is already armed for an older ghost */
+  if(!ev_is_active(&globalconf.event_ghost_timer_watcher))
+    _ghost_update_timer();
+}
+
+/** Get  the ghost  of  the given window  if any,  which  must then  be
+ *  released with ghost_unref().  Meaningful for plugins,  as the core
+ *  itself never paints the ghosts
+ *
+ * \param window_id The Window XID
+ * \return The ghost or NULL
+ */
+ghost_t *
+ghost_get(const xcb_window_t window_id)
+{
+  for(ghost_t *ghost = globalconf.ghosts; ghost; ghost = ghost->next)
+    if(ghost->id == window_id)
+      {
+        ghost->reference_counter++;
+        return ghost;
+      }
+
+  return NULL;
+}
+
+/** Release a reference to the ghost, freeing it if it is not used
+ *  anymore
+ *
+ * \param ghost The ghost to release
+ */
+void
+ghost_unref(ghost_t *ghost)
+{
+  if(--ghost->reference_counter == 0)
+    _ghost_free(ghost);
+}
+
+/** Remove the ghost of the  given window from the cache, for instance
+ *  because the window has been mapped again
+ *
+ * \param window_id The Window XID
+ */
+void
+ghost_remove(const xcb_window_t window_id)
+{
+  for(ghost_t *ghost = globalconf.ghosts; ghost; ghost = ghost->next)
+    if(ghost->id == window_id)
+      {
+        _ghost_detach(ghost);
+        return;
+      }
+}
+
+/** Give back the last Pixmap and rendering backend data of a window
+ *  mapped again,  kept by its ghost, if its size has not changed and
+ *  no plugin uses the ghost, which is removed from the cache anyway.
+ *  As the X server allocates a new Pixmap to the window when mapped,
+ *  this one is only painted until the window draws its new contents
+ *
+ * \param window The window object being mapped, without any Pixmap
+ * \return true if the Pixmap of the ghost has been given back
+ */
+bool
+ghost_restore(window_t *window)
+{
+  ghost_t *ghost;
+  for(ghost = globalconf.ghosts; ghost; ghost = ghost->next)
+    if(ghost->id == window->id)
+      break;
+
+  if(!ghost)
+    return false;
+
+  const xcb_get_geometry_reply_t *geometry = ghost->window->geometry;
+  if(ghost->reference_counter > 1 || window->pixmap != XCB_NONE ||
+     window->rendering || geometry->width != window->geometry->width ||
+     geometry->height != window->geometry->height ||
+     geometry->border_width != window->geometry->border_width ||
+     geometry->depth != window->geometry->depth)
+    {
+      _ghost_detach(ghost);
+      return false;
+    }
+
+  debug("Restoring ghost of window %jx", (uintmax_t) ghost->id);
+
+  window->pixmap = ghost->window->pixmap;
+  window->pixmap_size = ghost->window->pixmap_size;
+  window->rendering = ghost->window->rendering;
+  window->is_pixmap_evicted = false;
+  window->is_pixmap_ghost = true;
+
+  /* The  Pixmap is accounted again in the windows Pixmaps, its size
+     being removed from the ghosts cache size when detached */
+  globalconf.pixmaps_size += window->pixmap_size;
+
+  ghost->window->pixmap = XCB_NONE;
+  ghost->window->rendering = NULL;
+  _ghost_detach(ghost);
+
+  return true;
+}
+
+/** Remove the ghosts whose time-to-live has expired from the cache,
+ *  then arm the timer again for the oldest remaining one */
+void
+ghost_expire(void)
+{
+  const ev_tstamp now = ev_now(globalconf.event_loop);
+
+  for(ghost_t *ghost = globalconf.ghosts, *ghost_next; ghost;
+      ghost = ghost_next)
+    {
+      ghost_next = ghost->next;
+
+      if(ghost->expiry <= now)
+        _ghost_detach(ghost);
+    }
+
+  _ghost_update_timer();
+}
+
+/** Free all the ghosts  of the cache on exit,  whatever their references
+ *  are
+ */
+void
+ghost_cleanup(void)
+{
+  while(globalconf.ghosts)
+    {
+      ghost_t *ghost = globalconf.ghosts;
+      globalconf.ghosts = ghost->next;
+      _ghost_free(ghost);
+    }
+
+  globalconf.ghosts_size = 0;
+}
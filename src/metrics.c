@@ -0,0 +1,667 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Live metrics served over a Unix socket
+ *
+ *  The counters are  always updated as they only  cost increments on
+ *  the hot path (see 'metrics_t'), everything else  (e.g. windows count)
+ *  being computed when a snapshot is requested.
+ *
+ *  If 'metrics_socket' is set in the configuration file, a Unix stream
+ *  socket  is listening on  that  path,  watched by the libev loop.  A
+ *  client sends a command ("stats", "windows", "overlay" or "xids"),
+ *  then the snapshot is written as JSON and the connection is closed
+ *  (see  'unagi-stats'  and 'unagi-top').  The "overlay" command
+ *  toggles the tinting of the damaged Region and windows on the
+ *  screen, drawn in the frame itself, and "xids" reports the server
+ *  resources alive  (see 'xid.c').  The "stats" snapshot includes the
+ *  metrics of each plugin defining the 'write_metrics' hook, such as
+ *  the expose activation latency.  The number of X requests is
+ *  computed from  the sequence number of the request syncing each
+ *  frame and the number of bytes written is read from /proc/self/io
+ *  every second, thus no request is sent for the metrics.  The latter
+ *  counts all  the writes of the process, mostly to the X connection:
+ *  the snapshots sent on the  metrics socket are subtracted, but not
+ *  the events written by 'unagi --record'.
+ *
+ *  The  painting cost of each  window ('window_cost_t') is sorted by
+ *  estimated server time and the PID of its client is got with the
+ *  X-Resource  extension, if available, which  requires a round trip
+ *  only done when the windows are requested.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include <xcb/res.h>
+
+#include "metrics.h"
+#include "structs.h"
+#include "window.h"
+#include "display.h"
+
+/** Maximum time a client may take to send its command and to read the
+    snapshot, the connection being closed beyond (in seconds) */
+#define METRICS_CLIENT_TIMEOUT 5.0
+
+/** Client connected to the  metrics socket, whose  snapshot is written
+    as the socket becomes writable so a slow reader never blocks the
+    painting */
+typedef struct
+{
+  /** libev watcher of the client socket, reading the command then
+      writing the snapshot */
+  ev_io io_watcher;
+  /** libev timer watcher closing the connection if too slow */
+  ev_timer timeout_watcher;
+  /** Snapshot written to the client */
+  char *buffer;
+  /** Size of the snapshot */
+  size_t size;
+  /** Number of bytes of the snapshot already sent */
+  size_t sent;
+} _metrics_client_t;
+
+/** Get the number of bytes written by the process so far, mostly to
+ *  the X connection, excluding the snapshots sent on the metrics socket
+ *
+ * \return The number of bytes, 0 if not available
+ */
+static uint64_t
+_metrics_get_bytes_written(void)
+{
+  FILE *fp = fopen("/proc/self/io", "r");
+  if(!fp)
+    return 0;
+
+  char line[128];
+  unsigned long long bytes_written = 0;
+
+  while(fgets(line, sizeof(line), fp))
+    if(sscanf(line, "wchar: %llu", &bytes_written) == 1)
+      break;
+
+  fclose(fp);
+
+  if(bytes_written < globalconf.metrics.bytes_sent)
+    return 0;
+
+  return bytes_written - globalconf.metrics.bytes_sent;
+}
+
+/** Compute the number of DamageNotify events per second and the number
+ *  of bytes written per frame during the last second
+ *
+ * \param w The timer watcher
+ * \param revents Unused
+ */
+static void
+_metrics_rate_callback(EV_P_ ev_timer *w __attribute__((unused)),
+                       int revents __attribute__((unused)))
+{
+  metrics_t *metrics = &globalconf.metrics;
+
+  metrics->damage_notify_per_second = (uint32_t)
+    (metrics->damage_notify_counter - metrics->damage_notify_counter_previous);
+
+  metrics->damage_notify_counter_previous = metrics->damage_notify_counter;
+
+  const uint64_t bytes_written = _metrics_get_bytes_written();
+  const unsigned int frames = globalconf.paint_counter - metrics->frames_previous;
+
+  metrics->bytes_written_per_frame =
+    frames && bytes_written >= metrics->bytes_written_previous ?
+    (float) (bytes_written - metrics->bytes_written_previous) / (float) frames : 0;
+
+  metrics->bytes_written_previous = bytes_written;
+  metrics->frames_previous = globalconf.paint_counter;
+}
+
+/** Write the current metrics as a JSON object
+ *
+ * \param fp The stream to write to
+ */
+static void
+_metrics_write_stats(FILE *fp)
+{
+  const metrics_t *metrics = &globalconf.metrics;
+
+  unsigned int windows_len = 0, visible_windows_len = 0, ghosts_len = 0;
+  for(window_t *window = globalconf.windows; window; window = window->next)
+    {
+      windows_len++;
+      if(window_is_visible(window))
+        visible_windows_len++;
+    }
+
+  for(ghost_t *ghost = globalconf.ghosts; ghost; ghost = ghost->next)
+    ghosts_len++;
+
+  const unsigned int frames = globalconf.paint_counter;
+
+  fprintf(fp, "{\"frames\": %u, \"missed_deadlines\": %u, "
+          "\"refresh_interval\": %.6f, \"repaint_interval\": %.6f, "
+          "\"paint_time_histogram_us\": [",
+          frames, metrics->missed_deadlines, globalconf.refresh_rate_interval,
+          globalconf.repaint_interval);
+
+  for(unsigned int bucket = 0; bucket < METRICS_PAINT_TIME_BUCKETS; bucket++)
+    fprintf(fp, "%s%u", bucket ? ", " : "", metrics->paint_time_histogram[bucket]);
+
+  fprintf(fp, "], \"damage_notify_per_second\": %u, "
+          "\"damage_notify_total\": %ju, "
+          "\"requests_per_frame\": %.3f, \"last_frame_requests\": %u, "
+          "\"bytes_written_per_frame\": %.1f, "
+          "\"managed_windows\": %u, \"visible_windows\": %u, "
+          "\"pixmaps_size\": %ju, \"pixmaps_evictions\": %u, "
+          "\"ghosts\": %u, \"ghosts_size\": %ju, "
+          "\"events_last_drain\": %u, \"events_max_drain\": %u, "
+          "\"damage_latency_us\": {\"count\": %u, \"p50\": %.0f, "
+          "\"p99\": %.0f, \"p999\": %.0f}, \"late_frames\": %u, "
+          "\"plugins\": {",
+          metrics->damage_notify_per_second,
+          (uintmax_t) metrics->damage_notify_counter,
+          frames ? (double) metrics->requests / frames : 0,
+          metrics->last_frame_requests,
+          metrics->bytes_written_per_frame,
+          windows_len, visible_windows_len,
+          (uintmax_t) globalconf.pixmaps_size,
+          globalconf.pixmaps_evictions, ghosts_len,
+          (uintmax_t) globalconf.ghosts_size,
+          metrics->events_last_drain, metrics->events_max_drain,
+          metrics->damage_latency.count,
+          metrics_latency_get_percentile(&metrics->damage_latency, 50) * 1e6,
+          metrics_latency_get_percentile(&metrics->damage_latency, 99) * 1e6,
+          metrics_latency_get_percentile(&metrics->damage_latency, 99.9) * 1e6,
+          metrics->late_frames);
+
+  /* Each plugin adds its own metrics as an object named after it */
+  bool is_first = true;
+  for(plugin_t *plugin = globalconf.plugins; plugin; plugin = plugin->next)
+    if(plugin->vtable->write_metrics)
+      {
+        fprintf(fp, "%s\"%s\": ", is_first ? "" : ", ", plugin->vtable->name);
+        (*plugin->vtable->write_metrics)(fp);
+        is_first = false;
+      }
+
+  fprintf(fp, "}}\n");
+}
+
+/** Compare windows by decreasing estimated server time, for qsort()
+ *
+ * \param a The first window
+ * \param b The second window
+ * \return The comparison result as expected by qsort()
+ */
+static int
+_metrics_cmp_window_cost(const void *a, const void *b)
+{
+  const window_t *window_a = *(window_t * const *) a;
+  const window_t *window_b = *(window_t * const *) b;
+
+  if(window_a->cost.server_time != window_b->cost.server_time)
+    return window_a->cost.server_time > window_b->cost.server_time ? -1 : 1;
+
+  return window_a->cost.painted_pixels > window_b->cost.painted_pixels ? -1 :
+    window_a->cost.painted_pixels < window_b->cost.painted_pixels;
+}
+
+/** Get the PID of the client owning the window with X-Resource
+ *
+ * \param cookie The QueryClientIds cookie
+ * \return The PID, 0 if not known (e.g. remote client)
+ */
+static uint32_t
+_metrics_get_window_pid(xcb_res_query_client_ids_cookie_t cookie)
+{
+  xcb_res_query_client_ids_reply_t *reply =
+    xcb_res_query_client_ids_reply(globalconf.connection, cookie, NULL);
+
+  if(!reply)
+    return 0;
+
+  uint32_t pid = 0;
+  for(xcb_res_client_id_value_iterator_t ids_iter =
+        xcb_res_query_client_ids_ids_iterator(reply);
+      ids_iter.rem;
+      xcb_res_client_id_value_next(&ids_iter))
+    if((ids_iter.data->spec.mask & XCB_RES_CLIENT_ID_MASK_LOCAL_CLIENT_PID) &&
+       xcb_res_client_id_value_value_length(ids_iter.data) == 1)
+      {
+        pid = *xcb_res_client_id_value_value(ids_iter.data);
+        break;
+      }
+
+  free(reply);
+  return pid;
+}
+
+/** Write the painting cost of the managed windows, from the most to
+ *  the least expensive, one JSON object per line
+ *
+ * \param fp The stream to write to
+ */
+static void
+_metrics_write_windows(FILE *fp)
+{
+  unsigned int windows_len = 0;
+  for(window_t *window = globalconf.windows; window; window = window->next)
+    windows_len++;
+
+  window_t **windows = calloc(windows_len + 1, sizeof(window_t *));
+  xcb_res_query_client_ids_cookie_t *cookies =
+    calloc(windows_len + 1, sizeof(xcb_res_query_client_ids_cookie_t));
+
+  unsigned int window_n = 0;
+  for(window_t *window = globalconf.windows; window; window = window->next)
+    windows[window_n++] = window;
+
+  qsort(windows, windows_len, sizeof(window_t *), _metrics_cmp_window_cost);
+
+  /* Send all the requests before getting the replies, this is the only
+     round trip and it is only done when the windows are requested */
+  if(globalconf.extensions.res)
+    for(window_n = 0; window_n < windows_len; window_n++)
+      {
+        const xcb_res_client_id_spec_t spec = {
+          windows[window_n]->id, XCB_RES_CLIENT_ID_MASK_LOCAL_CLIENT_PID
+        };
+
+        cookies[window_n] = xcb_res_query_client_ids(globalconf.connection,
+                                                     1, &spec);
+      }
+
+  fputs("{\"windows\": [\n", fp);
+
+  for(window_n = 0; window_n < windows_len; window_n++)
+    {
+      const window_t *window = windows[window_n];
+
+      fprintf(fp, "{\"id\": \"0x%jx\", \"pid\": %u, \"damage_notify\": %u, "
+              "\"damaged_area\": %ju, \"paint_calls\": %u, "
+              "\"composite_calls\": %u, \"painted_pixels\": %ju, "
+              "\"server_time\": %.6f, \"latency_p50_us\": %.0f, "
+              "\"latency_p99_us\": %.0f, \"latency_p999_us\": %.0f}%s\n",
+              (uintmax_t) window->id,
+              cookies[window_n].sequence ?
+              _metrics_get_window_pid(cookies[window_n]) : 0,
+              window->cost.damage_notify, (uintmax_t) window->cost.damaged_area,
+              window->cost.paint_calls, window->cost.composite_calls,
+              (uintmax_t) window->cost.painted_pixels, window->cost.server_time,
+              metrics_latency_get_percentile(window->damage_latency, 50) * 1e6,
+              metrics_latency_get_percentile(window->damage_latency, 99) * 1e6,
+              metrics_latency_get_percentile(window->damage_latency, 99.9) * 1e6,
+              window_n + 1 < windows_len ? "," : "");
+    }
+
+  fputs("]}\n", fp);
+
+  free(cookies);
+  free(windows);
+}
+
+/** Close the connection of a client and free it
+ *
+ * \param client The client
+ */
+static void
+_metrics_client_free(EV_P_ _metrics_client_t *client)
+{
+  ev_io_stop(EV_A_ &client->io_watcher);
+  ev_timer_stop(EV_A_ &client->timeout_watcher);
+  close(client->io_watcher.fd);
+  free(client->buffer);
+  free(client);
+}
+
+/** Write as much of the snapshot  as the client socket accepts without
+ *  blocking, closing the connection once everything has been sent
+ *
+ * \param w The I/O watcher of the client
+ * \param revents Unused
+ */
+static void
+_metrics_client_write_callback(EV_P_ ev_io *w, int revents __attribute__((unused)))
+{
+  _metrics_client_t *client = w->data;
+
+  const ssize_t sent_len = send(w->fd, client->buffer + client->sent,
+                                client->size - client->sent, MSG_NOSIGNAL);
+  if(sent_len < 0)
+    {
+      if(errno == EAGAIN || errno == EINTR)
+        return;
+
+      debug("Can't send metrics: %s", strerror(errno));
+      _metrics_client_free(EV_A_ client);
+      return;
+    }
+
+  client->sent += (size_t) sent_len;
+  globalconf.metrics.bytes_sent += (uint64_t) sent_len;
+
+  if(client->sent == client->size)
+    _metrics_client_free(EV_A_ client);
+}
+
+/** Close the connection of a client too slow to send its command or to
+ *  read the snapshot
+ *
+ * \param w The timer watcher of the client
+ * \param revents Unused
+ */
+static void
+_metrics_client_timeout_callback(EV_P_ ev_timer *w,
+                                 int revents __attribute__((unused)))
+{
+  debug("Metrics client timed out");
+  _metrics_client_free(EV_A_ w->data);
+}
+
+/** Read the command sent by a client and build the snapshot requested,
+ *  either the windows painting cost ("windows"), the state of the damage
+ *  overlay after toggling it ("overlay"), the server resources alive
+ *  ("xids [AGE]", see 'xid.c') or the metrics, which is then written as
+ *  the socket becomes writable
+ *
+ * \param w The I/O watcher of the client
+ * \param revents Unused
+ */
+static void
+_metrics_client_read_callback(EV_P_ ev_io *w, int revents __attribute__((unused)))
+{
+  _metrics_client_t *client = w->data;
+
+  char command[32];
+  const ssize_t len = recv(w->fd, command, sizeof(command) - 1, 0);
+  if(len < 0 && (errno == EAGAIN || errno == EINTR))
+    return;
+
+  command[len > 0 ? len : 0] = '\0';
+
+  FILE *fp = open_memstream(&client->buffer, &client->size);
+
+  if(!strncmp(command, "windows", 7))
+    _metrics_write_windows(fp);
+  else if(!strncmp(command, "overlay", 7))
+    {
+      /* Repaint everything to show or remove the overlay at once */
+      globalconf.damage_overlay = !globalconf.damage_overlay;
+      display_damage_screen();
+
+      fprintf(fp, "{\"damage_overlay\": %s}\n",
+              globalconf.damage_overlay ? "true" : "false");
+    }
+  /* Followed by the minimum age in seconds of the resources listed */
+  else if(!strncmp(command, "xids", 4))
+    xid_write_report(fp, command[4] == ' ' ? atof(command + 5) : -1);
+  else
+    _metrics_write_stats(fp);
+
+  fclose(fp);
+
+  /* The windows snapshot may not fit in the socket buffer */
+  ev_io_stop(EV_A_ w);
+  ev_io_set(w, w->fd, EV_WRITE);
+  ev_set_cb(w, _metrics_client_write_callback);
+  ev_io_start(EV_A_ w);
+}
+
+/** Wait for the command of each client connecting to the socket
+ *
+ * \param w The I/O watcher
+ * \param revents Unused
+ */
+static void
+_metrics_io_callback(EV_P_ ev_io *w, int revents __attribute__((unused)))
+{
+  int client_fd;
+  while((client_fd = accept(w->fd, NULL, NULL)) >= 0)
+    {
+      /* The accepted socket does not inherit O_NONBLOCK */
+      fcntl(client_fd, F_SETFL, fcntl(client_fd, F_GETFL) | O_NONBLOCK);
+
+      _metrics_client_t *client = calloc(1, sizeof(_metrics_client_t));
+
+      ev_io_init(&client->io_watcher, _metrics_client_read_callback, client_fd,
+                 EV_READ);
+      client->io_watcher.data = client;
+      ev_io_start(EV_A_ &client->io_watcher);
+
+      ev_timer_init(&client->timeout_watcher, _metrics_client_timeout_callback,
+                    METRICS_CLIENT_TIMEOUT, 0);
+      client->timeout_watcher.data = client;
+      ev_timer_start(EV_A_ &client->timeout_watcher);
+    }
+}
+
+/** Start  listening on the  socket given in the configuration file, if
+ *  any
+ */
+void
+metrics_init(void)
+{
+  const char *path = cfg_getstr(globalconf.cfg, "metrics_socket");
+  if(!path || !strlen(path))
+    return;
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+
+  if(strlen(path) >= sizeof(address.sun_path))
+    {
+      warn("Metrics socket path too long: %s", path);
+      return;
+    }
+
+  strcpy(address.sun_path, path);
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if(fd < 0)
+    {
+      warn("Can't create metrics socket: %s", strerror(errno));
+      return;
+    }
+
+  /* Remove the socket left by a previous instance */
+  unlink(path);
+
+  if(bind(fd, (struct sockaddr *) &address, sizeof(address)) < 0 ||
+     listen(fd, 4) < 0)
+    {
+      warn("Can't listen on metrics socket %s: %s", path, strerror(errno));
+      close(fd);
+      return;
+    }
+
+  globalconf.metrics.fd = fd;
+
+  ev_io_init(&globalconf.metrics.io_watcher, _metrics_io_callback, fd, EV_READ);
+  ev_io_start(globalconf.event_loop, &globalconf.metrics.io_watcher);
+
+  globalconf.metrics.bytes_written_previous = _metrics_get_bytes_written();
+
+  ev_timer_init(&globalconf.metrics.rate_timer_watcher, _metrics_rate_callback,
+                1.0, 1.0);
+  ev_timer_start(globalconf.event_loop, &globalconf.metrics.rate_timer_watcher);
+}
+
+/** Add the painting time of a frame to the histogram
+ *
+ * \param paint_time The painting time in seconds
+ */
+void
+metrics_add_paint_time(const float paint_time)
+{
+  const uint32_t paint_time_us = (uint32_t) (paint_time * 1e6f);
+
+  /* Bucket given by the number of bits of the time in microseconds */
+  unsigned int bucket = paint_time_us ?
+    (unsigned int) (32 - __builtin_clz(paint_time_us)) : 0;
+
+  if(bucket >= METRICS_PAINT_TIME_BUCKETS)
+    bucket = METRICS_PAINT_TIME_BUCKETS - 1;
+
+  globalconf.metrics.paint_time_histogram[bucket]++;
+
+  if(paint_time > globalconf.refresh_rate_interval)
+    globalconf.metrics.missed_deadlines++;
+}
+
+/** Count the requests sent since the previous frame
+ *
+ * \param sync_sequence The sequence number of the request syncing the
+ *                      frame
+ */
+void
+metrics_add_frame_requests(const unsigned int sync_sequence)
+{
+  metrics_t *metrics = &globalconf.metrics;
+
+  /* The sequence number being unsigned, wrapping does not matter */
+  if(metrics->sync_sequence)
+    {
+      metrics->last_frame_requests = sync_sequence - metrics->sync_sequence;
+      metrics->requests += metrics->last_frame_requests;
+    }
+
+  metrics->sync_sequence = sync_sequence;
+}
+
+/** Get the latency histogram bucket of a latency
+ *
+ * \param latency The latency in seconds
+ * \return The bucket index
+ */
+static unsigned int
+_metrics_latency_get_bucket(const double latency)
+{
+  const uint32_t latency_us = latency < 0 ? 0 :
+    (latency >= 4294.0 ? UINT32_MAX : (uint32_t) (latency * 1e6));
+
+  if(latency_us < METRICS_LATENCY_SUB_BUCKETS)
+    return latency_us;
+
+  /* The highest bit gives the power of two, and the following 3 bits
+     the sub-bucket */
+  const unsigned int exponent = (unsigned int) (31 - __builtin_clz(latency_us));
+  const unsigned int bucket = METRICS_LATENCY_SUB_BUCKETS * (exponent - 2) +
+    ((latency_us >> (exponent - 3)) & (METRICS_LATENCY_SUB_BUCKETS - 1));
+
+  return bucket < METRICS_LATENCY_BUCKETS ? bucket : METRICS_LATENCY_BUCKETS - 1;
+}
+
+/** Add a latency to a histogram, also used by the plugins for their
+ *  own latencies
+ *
+ * \param histogram The histogram
+ * \param latency The latency in seconds
+ */
+void
+metrics_latency_add(metrics_latency_histogram_t *histogram,
+                    const double latency)
+{
+  histogram->buckets[_metrics_latency_get_bucket(latency)]++;
+  histogram->count++;
+}
+
+/** Add the time from a DamageNotify to the frame painting it on the
+ *  screen, to the global and window histograms
+ *
+ * \param window_histogram The window histogram, allocated if needed
+ * \param latency The latency in seconds
+ */
+void
+metrics_add_damage_latency(metrics_latency_histogram_t **window_histogram,
+                           const double latency)
+{
+  metrics_latency_add(&globalconf.metrics.damage_latency, latency);
+
+  if(!*window_histogram)
+    *window_histogram = calloc(1, sizeof(metrics_latency_histogram_t));
+
+  metrics_latency_add(*window_histogram, latency);
+}
+
+/** Count the frame  as late if the oldest damage painted  missed at
+ *  least one refresh
+ *
+ * \param latency The latency of the oldest damage painted in seconds
+ */
+void
+metrics_add_frame_latency(const double latency)
+{
+  if(latency > 2 * globalconf.refresh_rate_interval)
+    globalconf.metrics.late_frames++;
+}
+
+/** Get a percentile of a latency histogram
+ *
+ * \param histogram The histogram (may be NULL)
+ * \param percentile The percentile, from 0 to 100
+ * \return The upper bound of the bucket in seconds, 0 if empty
+ */
+double
+metrics_latency_get_percentile(const metrics_latency_histogram_t *histogram,
+                               const double percentile)
+{
+  if(!histogram || !histogram->count)
+    return 0;
+
+  const double rank = histogram->count * percentile / 100;
+  uint32_t count = 0;
+  unsigned int bucket;
+
+  for(bucket = 0; bucket < METRICS_LATENCY_BUCKETS - 1; bucket++)
+    if((count += histogram->buckets[bucket]) >= rank)
+      break;
+
+  if(bucket < METRICS_LATENCY_SUB_BUCKETS)
+    return (bucket + 1) / 1e6;
+
+  const unsigned int exponent = bucket / METRICS_LATENCY_SUB_BUCKETS + 2;
+  const unsigned int sub_bucket = bucket % METRICS_LATENCY_SUB_BUCKETS;
+
+  return (double) ((uint64_t) (METRICS_LATENCY_SUB_BUCKETS + sub_bucket + 1) <<
+                   (exponent - 3)) / 1e6;
+}
+
+/** Stop listening and remove the socket */
+void
+metrics_cleanup(void)
+{
+  if(!ev_is_active(&globalconf.metrics.io_watcher))
+    return;
+
+  ev_io_stop(globalconf.event_loop, &globalconf.metrics.io_watcher);
+  ev_timer_stop(globalconf.event_loop, &globalconf.metrics.rate_timer_watcher);
+  close(globalconf.metrics.fd);
+
+  unlink(cfg_getstr(globalconf.cfg, "metrics_socket"));
+}
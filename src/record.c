@@ -0,0 +1,159 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Record of the X events stream
+ *
+ *  When a record file is given on the command line, the tree of windows
+ *  managed on startup  and then every event passed  to 'event_handle'
+ *  are written to it,  along with the time elapsed since the previous
+ *  event, so  performance  issues depending  on  the  events  mix of  a
+ *  given session can be reproduced later on (see 'bench/replay_client.c').
+ *
+ *  Each event takes 36 bytes and the file is written through the stdio
+ *  buffer, thus recording does not add any system call per event.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "record.h"
+#include "structs.h"
+
+/** Open the record file, the events being only recorded once the
+ *  existing windows are managed ('record_start')
+ *
+ * \param path The record file path
+ */
+void
+record_init(const char *path)
+{
+  FILE *fp = fopen(path, "wb");
+  if(!fp)
+    fatal("Can't open record file %s", path);
+
+  globalconf.record = calloc(1, sizeof(record_t));
+  globalconf.record->fp = fp;
+}
+
+/** Stop recording on write error
+ *
+ * \param record The record
+ */
+static void
+_record_write_error(record_t *record)
+{
+  warn("Can't write to the record file, stop recording");
+  record->is_started = false;
+}
+
+/** Write the header and the windows currently managed, from the bottom
+ *  to the top of the stack, then start recording the events
+ */
+void
+record_start(void)
+{
+  record_t *record = globalconf.record;
+  if(!record)
+    return;
+
+  record_header_t header;
+  memset(&header, 0, sizeof(record_header_t));
+  memcpy(header.magic, RECORD_MAGIC, sizeof(header.magic));
+  header.version = RECORD_VERSION;
+  header.root = globalconf.screen->root;
+  header.screen_width = globalconf.screen->width_in_pixels;
+  header.screen_height = globalconf.screen->height_in_pixels;
+  header.damage_first_event = globalconf.extensions.damage->first_event;
+
+  for(window_t *window = globalconf.windows; window; window = window->next)
+    header.windows_len++;
+
+  record->is_started = true;
+
+  if(fwrite(&header, sizeof(record_header_t), 1, record->fp) != 1)
+    {
+      _record_write_error(record);
+      return;
+    }
+
+  for(window_t *window = globalconf.windows; window; window = window->next)
+    {
+      record_window_t record_window;
+      memset(&record_window, 0, sizeof(record_window_t));
+
+      record_window.id = window->id;
+      record_window.x = window->geometry->x;
+      record_window.y = window->geometry->y;
+      record_window.width = window->geometry->width;
+      record_window.height = window->geometry->height;
+      record_window.border_width = window->geometry->border_width;
+      record_window.depth = window->geometry->depth;
+      record_window.map_state = window->attributes->map_state;
+      record_window.override_redirect = window->attributes->override_redirect;
+
+      if(fwrite(&record_window, sizeof(record_window_t), 1, record->fp) != 1)
+        {
+          _record_write_error(record);
+          return;
+        }
+    }
+
+  record->previous_time = ev_time();
+}
+
+/** Record an event received from the X server
+ *
+ * \param event The X event
+ */
+void
+record_event(const xcb_generic_event_t *event)
+{
+  record_t *record = globalconf.record;
+  if(!record || !record->is_started)
+    return;
+
+  const ev_tstamp now = ev_time();
+  const double delay = (now - record->previous_time) * 1e6;
+  record->previous_time = now;
+
+  record_event_t record_event;
+  record_event.delay = delay < UINT32_MAX ? (uint32_t) delay : UINT32_MAX;
+  memcpy(record_event.event, event, sizeof(record_event.event));
+
+  if(fwrite(&record_event, sizeof(record_event_t), 1, record->fp) != 1)
+    _record_write_error(record);
+  else
+    record->events_len++;
+}
+
+/** Close the record file */
+void
+record_cleanup(void)
+{
+  record_t *record = globalconf.record;
+  if(!record)
+    return;
+
+  debug("Recorded %ju events", (uintmax_t) record->events_len);
+
+  fclose(record->fp);
+  free(record);
+  globalconf.record = NULL;
+}
@@ -0,0 +1,204 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Painting statistics
+ *
+ *  When a statistics file is given on the command line, the painting
+ *  time and the process CPU time are recorded for each frame.  The
+ *  number of X requests per frame is the one counted by the metrics
+ *  from the sequence number of the request syncing each frame (see
+ *  'metrics.c'), thus no request is sent for the statistics.
+ *
+ *  They are  written on exit, as a single JSON object, to compare the
+ *  painting performances, e.g.  between releases (see 'bench/').
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+#include "structs.h"
+
+/** Number of frames allocated at once */
+#define STATS_PAINT_TIMES_STEP 4096
+
+/** Get the CPU time used by the process so far
+ *
+ * \return The CPU time in seconds
+ */
+static double
+_stats_get_cpu_time(void)
+{
+  struct timespec cpu_time;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_time);
+  return (double) cpu_time.tv_sec + (double) cpu_time.tv_nsec / 1e9;
+}
+
+/** Start recording the statistics of the frames painted
+ *
+ * \param path The file the statistics are written to on exit
+ */
+void
+stats_init(const char *path)
+{
+  globalconf.stats = calloc(1, sizeof(stats_t));
+  globalconf.stats->path = strdup(path);
+}
+
+/** Record the beginning of a frame painting */
+void
+stats_paint_begin(void)
+{
+  stats_t *stats = globalconf.stats;
+  if(!stats)
+    return;
+
+  if(!stats->paint_times_len)
+    {
+      stats->first_paint_time = ev_time();
+      stats->first_cpu_time = _stats_get_cpu_time();
+    }
+}
+
+/** Record the end of a frame painting
+ *
+ * \param paint_time The painting time of the frame
+ */
+void
+stats_paint_end(const float paint_time)
+{
+  stats_t *stats = globalconf.stats;
+  if(!stats)
+    return;
+
+  if(stats->paint_times_len == stats->paint_times_size)
+    {
+      stats->paint_times_size += STATS_PAINT_TIMES_STEP;
+      stats->paint_times = realloc(stats->paint_times,
+                                   stats->paint_times_size * sizeof(float));
+    }
+
+  stats->paint_times[stats->paint_times_len++] = paint_time;
+  stats->last_paint_time = ev_time();
+  stats->last_cpu_time = _stats_get_cpu_time();
+}
+
+/** Compare painting times
+ *
+ * \param a The first painting time
+ * \param b The second painting time
+ * \return The comparison result as expected by qsort()
+ */
+static int
+_stats_cmp_paint_time(const void *a, const void *b)
+{
+  const float paint_time_a = *((const float *) a);
+  const float paint_time_b = *((const float *) b);
+
+  if(paint_time_a == paint_time_b)
+    return 0;
+
+  return paint_time_a < paint_time_b ? -1 : 1;
+}
+
+/** Get a percentile of the sorted painting times
+ *
+ * \param stats The statistics
+ * \param percentile The percentile, from 0 to 100
+ * \return The painting time in seconds
+ */
+static float
+_stats_get_percentile(const stats_t *stats, const unsigned int percentile)
+{
+  unsigned int index = (stats->paint_times_len * percentile + 99) / 100;
+  if(index)
+    index--;
+
+  return stats->paint_times[index];
+}
+
+/** Write the statistics to the file given on initialisation
+ *
+ * \param stats The statistics
+ */
+static void
+_stats_write(stats_t *stats)
+{
+  FILE *fp = fopen(stats->path, "w");
+  if(!fp)
+    {
+      warn("Can't write statistics to %s", stats->path);
+      return;
+    }
+
+  const unsigned int frames = stats->paint_times_len;
+  const double duration = stats->last_paint_time - stats->first_paint_time;
+
+  fprintf(fp, "{\"frames\": %u, \"duration\": %.6f", frames, duration);
+
+  if(frames)
+    {
+      qsort(stats->paint_times, frames, sizeof(float), _stats_cmp_paint_time);
+
+      fprintf(fp, ", \"fps\": %.3f, \"paint_time_p50\": %.6f, "
+              "\"paint_time_p90\": %.6f, \"paint_time_p99\": %.6f, "
+              "\"paint_time_max\": %.6f, \"requests_per_frame\": %.3f, "
+              "\"cpu_per_frame\": %.6f",
+              duration > 0 ? frames / duration : 0,
+              _stats_get_percentile(stats, 50),
+              _stats_get_percentile(stats, 90),
+              _stats_get_percentile(stats, 99),
+              stats->paint_times[frames - 1],
+              (double) globalconf.metrics.requests / frames,
+              (stats->last_cpu_time - stats->first_cpu_time) / frames);
+
+      const metrics_latency_histogram_t *damage_latency =
+        &globalconf.metrics.damage_latency;
+
+      fprintf(fp, ", \"damage_latency_p50\": %.6f, "
+              "\"damage_latency_p99\": %.6f, \"damage_latency_p999\": %.6f, "
+              "\"late_frames\": %u",
+              metrics_latency_get_percentile(damage_latency, 50),
+              metrics_latency_get_percentile(damage_latency, 99),
+              metrics_latency_get_percentile(damage_latency, 99.9),
+              globalconf.metrics.late_frames);
+    }
+
+  fprintf(fp, "}\n");
+  fclose(fp);
+}
+
+/** Write the statistics and free them */
+void
+stats_cleanup(void)
+{
+  stats_t *stats = globalconf.stats;
+  if(!stats)
+    return;
+
+  _stats_write(stats);
+
+  free(stats->paint_times);
+  free(stats->path);
+  free(stats);
+  globalconf.stats = NULL;
+}
@@ -0,0 +1,155 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Trace events of the frames painting
+ *
+ *  If requested  on the  command line (--trace),  the time spent  in
+ *  each phase of the painting  (events drain, background, each window,
+ *  copy to the root window and  sync), in each event and plugin hook
+ *  and  waiting for replies  is stored  in a ring  buffer in memory
+ *  ('trace_begin' and 'trace_end').
+ *
+ *  On  SIGUSR1, the ring buffer  is written to the given file in the
+ *  Trace Event Format, which can be loaded in Perfetto  or
+ *  chrome://tracing, without  being cleared.  Thus, tracing can  be
+ *  enabled for hours as nothing is written until requested.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "structs.h"
+
+/** Allocate the ring buffer
+ *
+ * \param path The path of the file the trace events are written to
+ */
+void
+trace_init(const char *path)
+{
+  globalconf.trace = calloc(1, sizeof(trace_t));
+  globalconf.trace->path = strdup(path);
+  globalconf.trace->events = calloc(TRACE_EVENTS_SIZE, sizeof(trace_event_t));
+}
+
+/** Get the begin time of a trace event
+ *
+ * \return The monotonic time in seconds, 0 if tracing is disabled
+ */
+double
+trace_begin(void)
+{
+  if(!globalconf.trace)
+    return 0;
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+/** Add a trace event ending now, overwriting the oldest one if the
+ *  ring buffer is full
+ *
+ * \param category The category, must be a string literal
+ * \param name The name, must be a string literal
+ * \param id The window identifier, 0 if none
+ * \param begin The begin time returned by 'trace_begin'
+ */
+void
+trace_end(const char *category, const char *name, const uint32_t id,
+          const double begin)
+{
+  trace_t *trace = globalconf.trace;
+  if(!trace)
+    return;
+
+  trace_event_t *event = &trace->events[trace->events_n++ % TRACE_EVENTS_SIZE];
+
+  event->category = category;
+  event->name = name;
+  event->begin = begin;
+  event->duration = (float) (trace_begin() - begin);
+  event->id = id;
+}
+
+/** Write the trace events in the ring buffer, from the oldest one, to
+ *  the file given on the command line
+ */
+void
+trace_dump(void)
+{
+  trace_t *trace = globalconf.trace;
+  if(!trace)
+    return;
+
+  FILE *fp = fopen(trace->path, "w");
+  if(!fp)
+    {
+      warn("Can't write trace to %s: %s", trace->path, strerror(errno));
+      return;
+    }
+
+  const int pid = (int) getpid();
+
+  const uint64_t first_n = trace->events_n > TRACE_EVENTS_SIZE ?
+    trace->events_n - TRACE_EVENTS_SIZE : 0;
+
+  fputs("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n", fp);
+
+  for(uint64_t event_n = first_n; event_n < trace->events_n; event_n++)
+    {
+      const trace_event_t *event = &trace->events[event_n % TRACE_EVENTS_SIZE];
+
+      fprintf(fp, "%s{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", "
+              "\"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d",
+              event_n == first_n ? "" : ",\n", event->name, event->category,
+              event->begin * 1e6, event->duration * 1e6, pid, pid);
+
+      if(event->id)
+        fprintf(fp, ", \"args\": {\"window\": \"0x%jx\"}", (uintmax_t) event->id);
+
+      fputc('}', fp);
+    }
+
+  fputs("\n]}\n", fp);
+  fclose(fp);
+
+  debug("Wrote %ju trace events to %s",
+        (uintmax_t) (trace->events_n - first_n), trace->path);
+}
+
+/** Free the ring buffer */
+void
+trace_cleanup(void)
+{
+  trace_t *trace = globalconf.trace;
+  if(!trace)
+    return;
+
+  free(trace->events);
+  free(trace->path);
+  free(trace);
+  globalconf.trace = NULL;
+}
@@ -0,0 +1,151 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Print the live metrics of a running unagi
+ *
+ *  Connect to the Unix socket given  by 'metrics_socket' in the unagi
+ *  configuration file and print the JSON snapshot written by unagi,
+ *  either once or every given number of seconds.  Another command than
+ *  "stats" may be sent, such as "overlay" to toggle the damage overlay
+ *  or "xids 3600" to report the server resources alive, listing those
+ *  alive for more than an hour.
+ */
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/** Print the command line usage
+ *
+ * \param program The program name
+ */
+static void
+_unagi_stats_usage(const char *program)
+{
+  fprintf(stderr, "Usage: %s [-i SECONDS] [-c COMMAND] SOCKET\n\
+  -i, --interval SECONDS    print the metrics every SECONDS\n\
+  -c, --command COMMAND     send COMMAND instead of \"stats\"\n", program);
+}
+
+/** Print a snapshot of the metrics
+ *
+ * \param address The address of the metrics socket
+ * \param command The command sent
+ * \return true on success
+ */
+static bool
+_unagi_stats_print(const struct sockaddr_un *address, const char *command)
+{
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0)
+    {
+      perror("socket");
+      return false;
+    }
+
+  if(connect(fd, (const struct sockaddr *) address, sizeof(*address)) < 0)
+    {
+      fprintf(stderr, "Can't connect to %s: ", address->sun_path);
+      perror(NULL);
+      close(fd);
+      return false;
+    }
+
+  const size_t command_len = strlen(command);
+  if(write(fd, command, command_len) != (ssize_t) command_len ||
+     write(fd, "\n", 1) != 1)
+    {
+      perror("write");
+      close(fd);
+      return false;
+    }
+
+  char buffer[4096];
+  ssize_t len;
+  while((len = read(fd, buffer, sizeof(buffer))) > 0)
+    fwrite(buffer, 1, (size_t) len, stdout);
+
+  fflush(stdout);
+  close(fd);
+  return len == 0;
+}
+
+int
+main(int argc, char **argv)
+{
+  const struct option long_options[] = {
+    { "interval", 1, NULL, 'i' },
+    { "command", 1, NULL, 'c' },
+    { "help", 0, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  double interval = 0;
+  const char *command = "stats";
+  int opt;
+
+  while((opt = getopt_long(argc, argv, "i:c:h", long_options, NULL)) != -1)
+    switch(opt)
+      {
+      case 'i':
+        interval = atof(optarg);
+        break;
+      case 'c':
+        command = optarg;
+        break;
+      case 'h':
+        _unagi_stats_usage(argv[0]);
+        return EXIT_SUCCESS;
+      default:
+        _unagi_stats_usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+
+  if(optind != argc - 1)
+    {
+      _unagi_stats_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+
+  if(strlen(argv[optind]) >= sizeof(address.sun_path))
+    {
+      fprintf(stderr, "Socket path too long: %s\n", argv[optind]);
+      return EXIT_FAILURE;
+    }
+
+  strcpy(address.sun_path, argv[optind]);
+
+  if(interval <= 0)
+    return _unagi_stats_print(&address, command) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+  while(_unagi_stats_print(&address, command))
+    usleep((useconds_t) (interval * 1e6));
+
+  return EXIT_FAILURE;
+}
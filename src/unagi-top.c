@@ -0,0 +1,337 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Display the windows which cost the most to paint
+ *
+ *  Every given number of seconds, request the painting cost of the
+ *  windows  from the metrics socket of a running unagi ("windows"
+ *  command, see  'metrics_socket' in the configuration file) and
+ *  display  the windows  sorted by the  share of  server time spent
+ *  painting them during that interval, with the  command name of
+ *  their client when running locally.  The damage-to-screen latency
+ *  is the 99th percentile since the window has been managed.
+ */
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/** Painting cost of a window, as written by unagi */
+typedef struct
+{
+  unsigned long id;
+  unsigned int pid;
+  unsigned int damage_notify;
+  unsigned long long damaged_area;
+  unsigned int paint_calls;
+  unsigned int composite_calls;
+  unsigned long long painted_pixels;
+  double server_time;
+  /** Damage-to-screen latency since the window is managed (in us) */
+  double latency_p99;
+} _unagi_top_window_t;
+
+/** Windows painting cost got from unagi */
+typedef struct
+{
+  _unagi_top_window_t *windows;
+  unsigned int windows_len;
+} _unagi_top_sample_t;
+
+/** Print the command line usage
+ *
+ * \param program The program name
+ */
+static void
+_unagi_top_usage(const char *program)
+{
+  fprintf(stderr, "Usage: %s [-i SECONDS] [-n COUNT] SOCKET\n\
+  -i, --interval SECONDS    refresh every SECONDS (default: 1)\n\
+  -n, --count COUNT         display at most COUNT windows (default: 20)\n",
+          program);
+}
+
+/** Get the painting cost of the windows from unagi
+ *
+ * \param address The address of the metrics socket
+ * \param sample The sample to fill
+ * \return true on success
+ */
+static bool
+_unagi_top_get_sample(const struct sockaddr_un *address,
+                      _unagi_top_sample_t *sample)
+{
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0)
+    {
+      perror("socket");
+      return false;
+    }
+
+  if(connect(fd, (const struct sockaddr *) address, sizeof(*address)) < 0 ||
+     write(fd, "windows\n", 8) != 8)
+    {
+      fprintf(stderr, "Can't request windows from %s: ", address->sun_path);
+      perror(NULL);
+      close(fd);
+      return false;
+    }
+
+  FILE *fp = fdopen(fd, "r");
+  char line[512];
+
+  sample->windows_len = 0;
+
+  unsigned int windows_size = 0;
+  while(fgets(line, sizeof(line), fp))
+    {
+      _unagi_top_window_t window;
+
+      if(sscanf(line, "{\"id\": \"0x%lx\", \"pid\": %u, \"damage_notify\": %u, "
+                "\"damaged_area\": %llu, \"paint_calls\": %u, "
+                "\"composite_calls\": %u, \"painted_pixels\": %llu, "
+                "\"server_time\": %lf, \"latency_p50_us\": %*f, "
+                "\"latency_p99_us\": %lf",
+                &window.id, &window.pid, &window.damage_notify,
+                &window.damaged_area, &window.paint_calls,
+                &window.composite_calls, &window.painted_pixels,
+                &window.server_time, &window.latency_p99) != 9)
+        continue;
+
+      if(sample->windows_len == windows_size)
+        {
+          windows_size = windows_size ? windows_size * 2 : 64;
+          sample->windows = realloc(sample->windows,
+                                    windows_size * sizeof(_unagi_top_window_t));
+        }
+
+      sample->windows[sample->windows_len++] = window;
+    }
+
+  fclose(fp);
+  return true;
+}
+
+/** Find a window in a previous sample
+ *
+ * \param sample The previous sample
+ * \param id The window identifier
+ * \return The window or NULL if it was not managed then
+ */
+static const _unagi_top_window_t *
+_unagi_top_find_window(const _unagi_top_sample_t *sample, const unsigned long id)
+{
+  for(unsigned int window_n = 0; window_n < sample->windows_len; window_n++)
+    if(sample->windows[window_n].id == id)
+      return &sample->windows[window_n];
+
+  return NULL;
+}
+
+/** Compare windows by decreasing server time, for qsort()
+ *
+ * \param a The first window
+ * \param b The second window
+ * \return The comparison result as expected by qsort()
+ */
+static int
+_unagi_top_cmp_window(const void *a, const void *b)
+{
+  const _unagi_top_window_t *window_a = a, *window_b = b;
+
+  if(window_a->server_time != window_b->server_time)
+    return window_a->server_time > window_b->server_time ? -1 : 1;
+
+  return window_a->painted_pixels > window_b->painted_pixels ? -1 :
+    window_a->painted_pixels < window_b->painted_pixels;
+}
+
+/** Get the command name of a local process
+ *
+ * \param pid The process identifier, 0 if unknown
+ * \param name The buffer to fill
+ * \param size The buffer size
+ */
+static void
+_unagi_top_get_command(const unsigned int pid, char *name, const size_t size)
+{
+  snprintf(name, size, "-");
+  if(!pid)
+    return;
+
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/%u/comm", pid);
+
+  FILE *fp = fopen(path, "r");
+  if(!fp)
+    return;
+
+  if(fgets(name, (int) size, fp))
+    name[strcspn(name, "\n")] = '\0';
+
+  fclose(fp);
+}
+
+/** Display the windows painting cost during the interval between two
+ *  samples
+ *
+ * \param previous The previous sample
+ * \param current The current sample
+ * \param interval The interval in seconds
+ * \param count The maximum number of windows displayed
+ */
+static void
+_unagi_top_display(const _unagi_top_sample_t *previous,
+                   _unagi_top_sample_t *current,
+                   const double interval,
+                   const unsigned int count)
+{
+  _unagi_top_window_t *deltas =
+    calloc(current->windows_len + 1, sizeof(_unagi_top_window_t));
+
+  for(unsigned int window_n = 0; window_n < current->windows_len; window_n++)
+    {
+      const _unagi_top_window_t *window = &current->windows[window_n];
+      _unagi_top_window_t *delta = &deltas[window_n];
+
+      *delta = *window;
+
+      const _unagi_top_window_t *old = _unagi_top_find_window(previous, window->id);
+      if(!old)
+        continue;
+
+      delta->damage_notify -= old->damage_notify;
+      delta->damaged_area -= old->damaged_area;
+      delta->paint_calls -= old->paint_calls;
+      delta->composite_calls -= old->composite_calls;
+      delta->painted_pixels -= old->painted_pixels;
+      delta->server_time -= old->server_time;
+    }
+
+  qsort(deltas, current->windows_len, sizeof(_unagi_top_window_t),
+        _unagi_top_cmp_window);
+
+  /* Clear the terminal */
+  printf("\033[H\033[2J%u windows managed\n\n", current->windows_len);
+  printf("%-10s %7s %-16s %9s %10s %8s %10s %10s %7s %8s\n", "WINDOW", "PID",
+         "COMMAND", "DAMAGE/s", "KPIX DMG/s", "PAINT/s", "COMPOSE/s",
+         "MPIX/s", "SERVER%", "P99 (ms)");
+
+  for(unsigned int window_n = 0;
+      window_n < current->windows_len && window_n < count;
+      window_n++)
+    {
+      const _unagi_top_window_t *delta = &deltas[window_n];
+
+      char command[17];
+      _unagi_top_get_command(delta->pid, command, sizeof(command));
+
+      printf("0x%-8lx %7u %-16s %9.1f %10.1f %8.1f %10.1f %10.2f %7.2f %8.1f\n",
+             delta->id, delta->pid, command,
+             delta->damage_notify / interval,
+             (double) delta->damaged_area / 1e3 / interval,
+             delta->paint_calls / interval,
+             delta->composite_calls / interval,
+             (double) delta->painted_pixels / 1e6 / interval,
+             delta->server_time * 100 / interval, delta->latency_p99 / 1e3);
+    }
+
+  fflush(stdout);
+  free(deltas);
+}
+
+int
+main(int argc, char **argv)
+{
+  const struct option long_options[] = {
+    { "interval", 1, NULL, 'i' },
+    { "count", 1, NULL, 'n' },
+    { "help", 0, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  double interval = 1;
+  unsigned int count = 20;
+  int opt;
+
+  while((opt = getopt_long(argc, argv, "i:n:h", long_options, NULL)) != -1)
+    switch(opt)
+      {
+      case 'i':
+        interval = atof(optarg);
+        break;
+      case 'n':
+        count = (unsigned int) atoi(optarg);
+        break;
+      case 'h':
+        _unagi_top_usage(argv[0]);
+        return EXIT_SUCCESS;
+      default:
+        _unagi_top_usage(argv[0]);
+        return EXIT_FAILURE;
+      }
+
+  if(optind != argc - 1 || interval <= 0)
+    {
+      _unagi_top_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+
+  if(strlen(argv[optind]) >= sizeof(address.sun_path))
+    {
+      fprintf(stderr, "Socket path too long: %s\n", argv[optind]);
+      return EXIT_FAILURE;
+    }
+
+  strcpy(address.sun_path, argv[optind]);
+
+  _unagi_top_sample_t samples[2] = { { NULL, 0 }, { NULL, 0 } };
+  unsigned int current = 0;
+
+  if(!_unagi_top_get_sample(&address, &samples[current]))
+    return EXIT_FAILURE;
+
+  for(;;)
+    {
+      usleep((useconds_t) (interval * 1e6));
+
+      current ^= 1;
+      if(!_unagi_top_get_sample(&address, &samples[current]))
+        break;
+
+      _unagi_top_display(&samples[current ^ 1], &samples[current], interval,
+                         count);
+    }
+
+  free(samples[0].windows);
+  free(samples[1].windows);
+
+  return EXIT_FAILURE;
+}
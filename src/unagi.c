@@ -33,6 +33,7 @@
 #include <xcb/xfixes.h>
 #include <xcb/damage.h>
 #include <xcb/randr.h>
+#include <xcb/res.h>
 #include <xcb/xcb_ewmh.h>
 #include <xcb/xcb_aux.h>
 #include <xcb/xcb_keysyms.h>
@@ -43,6 +44,11 @@
 
 #include "structs.h"
 #include "display.h"
+#include "ghost.h"
+#include "stats.h"
+#include "record.h"
+#include "metrics.h"
+#include "trace.h"
 #include "event.h"
 #include "atoms.h"
 #include "util.h"
@@ -72,6 +78,15 @@ _unagi_parse_configuration_file(FILE *config_fp)
   cfg_opt_t opts[] = {
     CFG_STR("rendering", "render", CFGF_NONE),
     CFG_STR_LIST("plugins", "{}", CFGF_NONE),
+    CFG_INT("alpha_levels", 256, CFGF_NONE),
+    CFG_FLOAT("underlay_idle_time", 2.0, CFGF_NONE),
+    CFG_FLOAT("hidden_release_time", 10.0, CFGF_NONE),
+    CFG_INT("pixmaps_budget", 0, CFGF_NONE),
+    CFG_FLOAT("ghost_ttl", 1.0, CFGF_NONE),
+    CFG_INT("ghosts_budget", 64, CFGF_NONE),
+    CFG_FLOAT("expose_animation_time", 0.25, CFGF_NONE),
+    CFG_BOOL("expose_server_scaling", cfg_true, CFGF_NONE),
+    CFG_STR("metrics_socket", "", CFGF_NONE),
     CFG_END()
   };
 
@@ -91,7 +106,10 @@ _unagi_display_help(void)
   -v, --version             show version\n\
   -c, --config FILE         configuration file path\n\
   -r, --rendering-path PATH rendering backend path\n\
-  -p, --plugins-path PATH   plugins path\n");
+  -p, --plugins-path PATH   plugins path\n\
+  -s, --stats FILE          write painting statistics to FILE on exit\n\
+  -R, --record FILE         record the windows tree and events to FILE\n\
+  -t, --trace FILE          write the last trace events to FILE on SIGUSR1\n");
 }
 
 /** Parse command line parameters
@@ -108,13 +126,16 @@ _unagi_parse_command_line_parameters(int argc, char **argv)
     { "config", 1, NULL, 'c' },
     { "rendering-path", 1, NULL, 'r' },
     { "plugins-path", 1, NULL, 'p' },
+    { "stats", 1, NULL, 's' },
+    { "record", 1, NULL, 'R' },
+    { "trace", 1, NULL, 't' },
     { NULL, 0, NULL, 0 }
   };
 
   int opt;
   FILE *config_fp = NULL;
 
-  while((opt = getopt_long(argc, argv, "vhc:r:p:",
+  while((opt = getopt_long(argc, argv, "vhc:r:p:s:R:t:",
 			   long_options, NULL)) != -1)
     {
       switch(opt)
@@ -146,6 +167,24 @@ _unagi_parse_command_line_parameters(int argc, char **argv)
 	  else
 	    fatal("-p option requires a directory");
 	  break;
+	case 's':
+	  if(optarg && strlen(optarg))
+	    stats_init(optarg);
+	  else
+	    fatal("-s option requires a file");
+	  break;
+	case 'R':
+	  if(optarg && strlen(optarg))
+	    record_init(optarg);
+	  else
+	    fatal("-R option requires a file");
+	  break;
+	case 't':
+	  if(optarg && strlen(optarg))
+	    trace_init(optarg);
+	  else
+	    fatal("-t option requires a file");
+	  break;
 	}
     }
 
@@ -175,6 +214,27 @@ _unagi_parse_command_line_parameters(int argc, char **argv)
 
   fclose(config_fp);
 
+  globalconf.underlay_idle_time = (float) cfg_getfloat(globalconf.cfg,
+                                                       "underlay_idle_time");
+
+  globalconf.hidden_release_time = (float) cfg_getfloat(globalconf.cfg,
+                                                        "hidden_release_time");
+
+  /* Given in MiB in the configuration file */
+  const long pixmaps_budget = cfg_getint(globalconf.cfg, "pixmaps_budget");
+  if(pixmaps_budget < 0)
+    warn("Invalid pixmaps_budget value %ld, ignored", pixmaps_budget);
+  else
+    globalconf.pixmaps_budget = (uint64_t) pixmaps_budget * 1024 * 1024;
+
+  globalconf.ghost_ttl = (float) cfg_getfloat(globalconf.cfg, "ghost_ttl");
+
+  const long ghosts_budget = cfg_getint(globalconf.cfg, "ghosts_budget");
+  if(ghosts_budget < 0)
+    warn("Invalid ghosts_budget value %ld, ignored", ghosts_budget);
+  else
+    globalconf.ghosts_budget = (uint64_t) ghosts_budget * 1024 * 1024;
+
   /* Get the rendering backend path if not given in the command line
      parameters */
   if(!globalconf.rendering_dir)
@@ -199,12 +259,21 @@ _unagi_exit_cleanup(void)
      unloading the plugins as the  plugins may use the windows list to
      free memory */
   window_list_cleanup();
+  ghost_cleanup();
+  stats_cleanup();
+  record_cleanup();
+  metrics_cleanup();
+  trace_cleanup();
 
   /* Free resources related  to the rendering backend which  has to be
      done  after the  windows  list  cleanup as  the  latter free  the
      rendering information associated with each window */
   rendering_unload();
 
+  /* Report the server resources  still alive, which has to be done once
+     everything has been freed */
+  xid_cleanup();
+
   /* Free resources related to the keymaps */
   xcb_key_symbols_free(globalconf.keysyms);
 
@@ -237,6 +306,13 @@ _unagi_exit_on_signal(struct ev_loop *loop, ev_signal *w, int revents)
   ev_break(loop, EVBREAK_ALL);
 }
 
+/** Write the trace events when SIGUSR1 is received */
+static void
+_unagi_trace_on_signal(struct ev_loop *loop, ev_signal *w, int revents)
+{
+  trace_dump();
+}
+
 static void
 _unagi_paint_callback(EV_P_ ev_timer *w, int revents)
 {
@@ -256,11 +332,21 @@ _unagi_paint_callback(EV_P_ ev_timer *w, int revents)
 #ifdef __DEBUG__
       debug("COUNT: %u: Begin re-painting", globalconf.paint_counter);
 #endif
+      stats_paint_begin();
+      const double trace_paint_begin = trace_begin();
+
       window_t *windows = NULL;
       for(plugin_t *plugin = globalconf.plugins; plugin; plugin = plugin->next)
-        if(plugin->enable && plugin->vtable->render_windows &&
-           (windows = (*plugin->vtable->render_windows)()))
-          break;
+        if(plugin->enable && plugin->vtable->render_windows)
+          {
+            const double trace_plugin_begin = trace_begin();
+            windows = (*plugin->vtable->render_windows)();
+            trace_end(plugin->vtable->name, "render_windows", 0,
+                      trace_plugin_begin);
+
+            if(windows)
+              break;
+          }
 
       if(!windows)
         windows = globalconf.windows;
@@ -287,9 +373,13 @@ _unagi_paint_callback(EV_P_ ev_timer *w, int revents)
 #endif
       window_paint_all(windows);
       display_reset_damaged();
+      display_clear_damage_overlay();
+      trace_end("phase", "paint", 0, trace_paint_begin);
 
       const float paint_time = (float) (ev_time() - ev_now(globalconf.event_loop));
       globalconf.paint_time_sum += paint_time;
+      stats_paint_end(paint_time);
+      metrics_add_paint_time(paint_time);
 
       const float current_average = globalconf.paint_time_sum /
         (float) ++globalconf.paint_counter;
@@ -335,6 +425,18 @@ _unagi_paint_callback(EV_P_ ev_timer *w, int revents)
     }
 }
 
+static void
+_unagi_hidden_callback(EV_P_ ev_timer *w, int revents)
+{
+  window_free_hidden_pixmaps();
+}
+
+static void
+_unagi_ghost_callback(EV_P_ ev_timer *w, int revents)
+{
+  ghost_expire();
+}
+
 static void
 _unagi_io_callback(EV_P_ ev_io *w, int revents)
 {
@@ -352,11 +454,14 @@ _unagi_io_callback(EV_P_ ev_io *w, int revents)
 
   /* Process all events in the queue because before painting, all the
      DamageNotify have to be received */
+  const double trace_drain_begin = trace_begin();
   xcb_generic_event_t *event;
+  uint32_t events_n = 0;
   while((event = xcb_poll_for_event(globalconf.connection)) != NULL)
     {
       event_handle(event);
       free(event);
+      events_n++;
 
       /* Stop processing events (but not  on startup as all the events
          must be processed) if the  repaint interval has been reached,
@@ -370,10 +475,21 @@ _unagi_io_callback(EV_P_ ev_io *w, int revents)
             {
               event_handle(event);
               free(event);
+              events_n++;
             }
           break;
         }
     }
+
+  /* The replies of the hidden properties requested while draining are
+     likely already received */
+  window_update_pending_hidden();
+
+  trace_end("phase", "drain", 0, trace_drain_begin);
+
+  globalconf.metrics.events_last_drain = events_n;
+  if(events_n > globalconf.metrics.events_max_drain)
+    globalconf.metrics.events_max_drain = events_n;
 }
 
 int
@@ -402,6 +518,11 @@ main(int argc, char **argv)
   ev_signal_start(globalconf.event_loop, &sigterm);
   ev_unref(globalconf.event_loop);
 
+  ev_signal sigusr1;
+  ev_signal_init(&sigusr1, _unagi_trace_on_signal, SIGUSR1);
+  ev_signal_start(globalconf.event_loop, &sigusr1);
+  ev_unref(globalconf.event_loop);
+
   /* Cleanup resources upon normal exit */
   atexit(_unagi_exit_cleanup);
 
@@ -425,6 +546,7 @@ main(int argc, char **argv)
   xcb_prefetch_extension_data(globalconf.connection, &xcb_damage_id);
   xcb_prefetch_extension_data(globalconf.connection, &xcb_xfixes_id);
   xcb_prefetch_extension_data(globalconf.connection, &xcb_randr_id);
+  xcb_prefetch_extension_data(globalconf.connection, &xcb_res_id);
 
   /* Pre-initialisation of the rendering backend */
   if(!rendering_load())
@@ -511,6 +633,8 @@ main(int argc, char **argv)
   xcb_get_modifier_mapping_cookie_t key_mapping_cookie =
     xcb_get_modifier_mapping_unchecked(globalconf.connection);
 
+  window_get_current_desktop_property();
+
   /* Finish CM X registration */
   if(!display_register_cm_finalise())
     fatal("Could not acquire _NET_WM_CM_Sn ownership");
@@ -534,6 +658,9 @@ main(int argc, char **argv)
   /* Manage existing windows */
   display_init_redirect_finalise();
 
+  /* Record the events from the windows tree managed now */
+  record_start();
+
   xcb_ungrab_server(globalconf.connection);
 
   /* Check the  plugin requirements  which will disable  plugins which
@@ -563,9 +690,32 @@ main(int argc, char **argv)
   globalconf.event_paint_timer_watcher.repeat = globalconf.repaint_interval;
   ev_timer_again(globalconf.event_loop, &globalconf.event_paint_timer_watcher);
  
+  /* Release periodically the  Pixmaps of windows hidden on  another
+     desktop or minimized */
+  if(globalconf.hidden_release_time > 0)
+    {
+      ev_timer_init(&globalconf.event_hidden_timer_watcher,
+                    _unagi_hidden_callback, globalconf.hidden_release_time,
+                    globalconf.hidden_release_time);
+
+      ev_timer_start(globalconf.event_loop,
+                     &globalconf.event_hidden_timer_watcher);
+    }
+
+  /* Remove the expired ghosts of unmapped or destroyed windows, only
+     armed for the oldest ghost (see 'ghost.c') */
+  ev_timer_init(&globalconf.event_ghost_timer_watcher,
+                _unagi_ghost_callback, globalconf.ghost_ttl, 0);
+
+  /* Serve the metrics on a Unix socket if enabled */
+  metrics_init();
+
   /* Get the lock masks reply of the request previously sent */ 
   key_lock_mask_get_reply(key_mapping_cookie);
 
+  /* Get the current desktop to determine the hidden windows */
+  window_update_current_desktop();
+
   /* Flush existing  requests before  the loop as  DamageNotify events
      may have been received in the meantime */
   xcb_flush(globalconf.connection);
@@ -578,6 +728,8 @@ main(int argc, char **argv)
 
   ev_io_stop(globalconf.event_loop, &globalconf.event_io_watcher);
   ev_timer_stop(globalconf.event_loop, &globalconf.event_paint_timer_watcher);
+  ev_timer_stop(globalconf.event_loop, &globalconf.event_hidden_timer_watcher);
+  ev_timer_stop(globalconf.event_loop, &globalconf.event_ghost_timer_watcher);
 
   return EXIT_SUCCESS;
 }
@@ -31,13 +31,25 @@
 #include <xcb/xproto.h>
 #include <xcb/composite.h>
 
-#include <xcb/xcb_aux.h>
 
 #include "window.h"
 #include "structs.h"
 #include "atoms.h"
 #include "display.h"
 
+/** Buffers of 'window_update_occluded', kept between frames and only
+    grown when there are more windows */
+static struct
+{
+  /** Windows from the bottommost one, then reused for the candidates
+      of 'window_evict_pixmaps' called afterwards in the same frame */
+  window_t **windows;
+  /** Opaque rectangles of the windows already processed */
+  xcb_rectangle_t *occluders;
+  /** Number of elements allocated in each buffer */
+  unsigned int size;
+} _window_occlusion_buffers;
+
 /** Append a window to the end  of the windows list which is organized
  *  from the bottommost to the topmost window
  *
@@ -50,6 +62,7 @@ window_list_append(const xcb_window_t new_window_id)
   window_t *new_window = calloc(1, sizeof(window_t));
 
   new_window->id = new_window_id;
+  new_window->desktop = WINDOW_ALL_DESKTOPS;
 
   /* If the windows list is empty */
   if(globalconf.windows == NULL)
@@ -71,6 +84,24 @@ window_list_append(const xcb_window_t new_window_id)
   return new_window;
 }
 
+/** Free the opaque rectangles and Region of the given window
+ *
+ * \param window The window object
+ */
+static void
+window_free_opaque_region(window_t *window)
+{
+  if(window->opaque_region != XCB_NONE)
+    {
+      xid_free(XID_TYPE_REGION, window->opaque_region);
+      xcb_xfixes_destroy_region(globalconf.connection, window->opaque_region);
+      window->opaque_region = XCB_NONE;
+    }
+
+  util_free(&window->opaque_rectangles);
+  window->opaque_rectangles_len = 0;
+}
+
 /** Free a given window and its associated resources
  *
  * \param window The window object to be freed
@@ -86,20 +117,35 @@ window_list_free_window(window_t *window, bool do_itree_remove)
   /* Destroy the damage object if any */
   if(window->damage != XCB_NONE)
     {
+      xid_free(XID_TYPE_DAMAGE, window->damage);
       xcb_damage_destroy(globalconf.connection, window->damage);
       window->damage = XCB_NONE;
     }
 
   if(window->region != XCB_NONE)
     {
+      xid_free(XID_TYPE_REGION, window->region);
       xcb_xfixes_destroy_region(globalconf.connection, window->region);
       window->region = XCB_NONE;
     }
 
+  if(window->opaque_region_cookie.sequence)
+    free(xcb_get_property_reply(globalconf.connection,
+                                window->opaque_region_cookie, NULL));
+
+  window_free_opaque_region(window);
+
+  if(window->desktop_cookie.sequence)
+    xcb_discard_reply(globalconf.connection, window->desktop_cookie.sequence);
+
+  if(window->state_cookie.sequence)
+    xcb_discard_reply(globalconf.connection, window->state_cookie.sequence);
+
   /* TODO: free plugins memory? */
   window_free_pixmap(window);
   (*globalconf.rendering->free_window)(window);
 
+  free(window->damage_latency);
   free(window->attributes);
   free(window->geometry);
   free(window);
@@ -115,6 +161,8 @@ window_list_remove_window(window_t *window_delete)
   if(!globalconf.windows)
     return;
 
+  window_underlay_remove(window_delete);
+
   if(globalconf.windows == window_delete)
     {
       window_t *old_window = globalconf.windows;
@@ -152,6 +200,10 @@ window_list_cleanup(void)
       window_list_free_window(window, false);
       window = window_next;
     }
+
+  util_free(&_window_occlusion_buffers.windows);
+  util_free(&_window_occlusion_buffers.occluders);
+  _window_occlusion_buffers.size = 0;
 }
 
 /** Free  a  Window Pixmap  which  has  been  previously allocated  by
@@ -164,9 +216,14 @@ window_free_pixmap(window_t *window)
 {
   if(window->pixmap)
     {
+      xid_free(XID_TYPE_PIXMAP, window->pixmap);
       xcb_free_pixmap(globalconf.connection, window->pixmap);
       window->pixmap = XCB_NONE;
 
+      globalconf.pixmaps_size -= window->pixmap_size;
+      window->pixmap_size = 0;
+      window->is_pixmap_ghost = false;
+
       /* If the Pixmap  is freed, then free its  associated Picture as
 	 it does not make sense to keep it */
       (*globalconf.rendering->free_window_pixmap)(window);
@@ -258,7 +315,7 @@ window_get_root_background_pixmap_finalise(void)
 xcb_pixmap_t
 window_new_root_background_pixmap(void)
 {
-  xcb_pixmap_t root_pixmap = xcb_generate_id(globalconf.connection);
+  xcb_pixmap_t root_pixmap = xid_generate(XID_TYPE_PIXMAP);
 
   xcb_create_pixmap(globalconf.connection, globalconf.screen->root_depth,
 		    root_pixmap, globalconf.screen->root, 1, 1);
@@ -269,24 +326,52 @@ window_new_root_background_pixmap(void)
 /** Get  the Pixmap  associated with  the  given Window  by sending  a
  *  NameWindowPixmap Composite  request. Must be careful  when to free
  *  this Pixmap, because  a new one is generated  each time the window
- *  is mapped or resized
+ *  is mapped or resized. Its estimated  size in the X server is also
+ *  accounted for the Pixmaps budget
  *
  * \param window The window object
  * \return The Pixmap associated with the Window
  */
 xcb_pixmap_t
-window_get_pixmap(const window_t *window)
+window_get_pixmap(window_t *window)
 {
   /* Update the pixmap thanks to CompositeNameWindowPixmap */
-  xcb_pixmap_t pixmap = xcb_generate_id(globalconf.connection);
+  xcb_pixmap_t pixmap = xid_generate(XID_TYPE_PIXMAP);
 
   xcb_composite_name_window_pixmap(globalconf.connection,
 				   window->id,
 				   pixmap);
 
+  /* Pixmaps are stored with 1, 2 or 4 bytes per pixel */
+  const uint8_t depth = window->geometry->depth;
+  const uint32_t bytes_per_pixel = depth > 16 ? 4 : (depth > 8 ? 2 : 1);
+
+  window->pixmap_size = (uint32_t) window_width_with_border(window->geometry) *
+    window_height_with_border(window->geometry) * bytes_per_pixel;
+
+  globalconf.pixmaps_size += window->pixmap_size;
+  window->is_pixmap_evicted = false;
+  window->is_pixmap_ghost = false;
+
   return pixmap;
 }
 
+/** Name again the Pixmap  of a window if it has  been released to fit
+ *  in the Pixmaps budget and the window is about to be painted
+ *
+ * \param window The window object
+ */
+void
+window_restore_pixmap(window_t *window)
+{
+  if(!window->is_pixmap_evicted || window->pixmap != XCB_NONE ||
+     window->attributes->map_state != XCB_MAP_STATE_VIEWABLE)
+    return;
+
+  debug("Restoring evicted Pixmap of window %jx", (uintmax_t) window->id);
+  window->pixmap = window_get_pixmap(window);
+}
+
 /** Check whether the given window is rectangular to optimize painting
  *  as most windows are rectangular
  *
@@ -299,10 +384,13 @@ window_is_rectangular(window_t *window)
   if(!window->shape_cookie.sequence)
     return window->is_rectangular;
 
+  const double trace_wait_begin = trace_begin();
   xcb_xfixes_fetch_region_reply_t *r =
     xcb_xfixes_fetch_region_reply(globalconf.connection,
                                   window->shape_cookie,
                                   NULL);
+
+  trace_end("wait", "FetchRegion", window->id, trace_wait_begin);
   if(r)
     {
       window->is_rectangular = xcb_xfixes_fetch_region_rectangles_length(r) <= 1;
@@ -329,7 +417,7 @@ window_is_rectangular(window_t *window)
 xcb_xfixes_region_t
 window_get_region(window_t *window, bool screen_relative, bool check_shape)
 {
-  xcb_xfixes_region_t new_region = xcb_generate_id(globalconf.connection);
+  xcb_xfixes_region_t new_region = xid_generate(XID_TYPE_REGION);
 
   xcb_xfixes_create_region_from_window(globalconf.connection,
                                        new_region,
@@ -358,6 +446,86 @@ window_get_region(window_t *window, bool screen_relative, bool check_shape)
   return new_region;
 }
 
+/** Maximum number  of rectangles fetched  from _NET_WM_OPAQUE_REGION,
+    which is usually a single one anyway */
+#define WINDOW_OPAQUE_REGION_MAX_RECTANGLES 64
+
+/** Send the GetProperty request  for _NET_WM_OPAQUE_REGION whose reply
+ *  is only got when actually needed
+ *
+ * \param window The window object
+ */
+void
+window_get_opaque_region_property(window_t *window)
+{
+  if(window->opaque_region_cookie.sequence)
+    free(xcb_get_property_reply(globalconf.connection,
+                                window->opaque_region_cookie, NULL));
+
+  window->opaque_region_cookie =
+    xcb_get_property_unchecked(globalconf.connection, false, window->id,
+                               _NET_WM_OPAQUE_REGION, XCB_ATOM_CARDINAL, 0,
+                               WINDOW_OPAQUE_REGION_MAX_RECTANGLES * 4);
+}
+
+/** Get the opaque  Region of an ARGB window  (e.g.  excluding client
+ *  side shadows),  as given by _NET_WM_OPAQUE_REGION,  and get the
+ *  reply of the GetProperty request previously sent if any
+ *
+ * \param window The window object
+ * \return The Region relative to the window or None if not set
+ */
+xcb_xfixes_region_t
+window_get_opaque_region(window_t *window)
+{
+  if(!window->opaque_region_cookie.sequence)
+    return window->opaque_region;
+
+  const double trace_wait_begin = trace_begin();
+  xcb_get_property_reply_t *reply =
+    xcb_get_property_reply(globalconf.connection, window->opaque_region_cookie,
+                           NULL);
+
+  trace_end("wait", "GetProperty", window->id, trace_wait_begin);
+
+  window->opaque_region_cookie.sequence = 0;
+  window_free_opaque_region(window);
+
+  /* Each rectangle is given as x, y, width and height CARDINALs */
+  if(reply && reply->type == XCB_ATOM_CARDINAL && reply->format == 32 &&
+     xcb_get_property_value_length(reply) >= 16)
+    {
+      const uint32_t *values = xcb_get_property_value(reply);
+
+      window->opaque_rectangles_len =
+        (uint32_t) xcb_get_property_value_length(reply) / 16;
+
+      window->opaque_rectangles = malloc(window->opaque_rectangles_len *
+                                         sizeof(xcb_rectangle_t));
+
+      for(uint32_t rectangle_n = 0; rectangle_n < window->opaque_rectangles_len;
+          rectangle_n++, values += 4)
+        {
+          window->opaque_rectangles[rectangle_n].x = (int16_t) values[0];
+          window->opaque_rectangles[rectangle_n].y = (int16_t) values[1];
+          window->opaque_rectangles[rectangle_n].width = (uint16_t) values[2];
+          window->opaque_rectangles[rectangle_n].height = (uint16_t) values[3];
+        }
+
+      window->opaque_region = xid_generate(XID_TYPE_REGION);
+
+      xcb_xfixes_create_region(globalconf.connection, window->opaque_region,
+                               window->opaque_rectangles_len,
+                               window->opaque_rectangles);
+
+      debug("Window %jx has %ju opaque rectangles", (uintmax_t) window->id,
+            (uintmax_t) window->opaque_rectangles_len);
+    }
+
+  free(reply);
+  return window->opaque_region;
+}
+
 /** Check whether the window is visible within the screen geometry
  *
  * \param window The window object
@@ -373,6 +541,233 @@ window_is_visible(const window_t *window)
 	  window->geometry->y < globalconf.screen->height_in_pixels);
 }
 
+/** Get the area of the window, including its border, within the screen
+ *
+ * \param window The window object
+ * \return The area in pixels
+ */
+uint32_t
+window_get_screen_area(const window_t *window)
+{
+  if(!window->geometry)
+    return 0;
+
+  int32_t x1 = window->geometry->x, y1 = window->geometry->y;
+  int32_t x2 = x1 + window_width_with_border(window->geometry);
+  int32_t y2 = y1 + window_height_with_border(window->geometry);
+
+  if(x1 < 0)
+    x1 = 0;
+  if(y1 < 0)
+    y1 = 0;
+  if(x2 > globalconf.screen->width_in_pixels)
+    x2 = globalconf.screen->width_in_pixels;
+  if(y2 > globalconf.screen->height_in_pixels)
+    y2 = globalconf.screen->height_in_pixels;
+
+  return (x2 > x1 && y2 > y1) ? (uint32_t) ((x2 - x1) * (y2 - y1)) : 0;
+}
+
+/** Send  the   GetProperty  request  for  _NET_CURRENT_DESKTOP  whose
+ *  reply is got in window_update_current_desktop()
+ */
+void
+window_get_current_desktop_property(void)
+{
+  if(globalconf.current_desktop.cookie.sequence)
+    xcb_discard_reply(globalconf.connection,
+                      globalconf.current_desktop.cookie.sequence);
+
+  globalconf.current_desktop.cookie =
+    xcb_ewmh_get_current_desktop_unchecked(&globalconf.ewmh,
+                                           globalconf.screen_nbr);
+}
+
+/** Send  the   GetProperty  requests   for  _NET_WM_DESKTOP   and
+ *  _NET_WM_STATE  whose replies  are got  when the  hidden state  is
+ *  updated, at the latest once the events queue has been drained
+ *
+ * \param window The window object
+ */
+void
+window_get_hidden_properties(window_t *window)
+{
+  if(window->desktop_cookie.sequence)
+    xcb_discard_reply(globalconf.connection, window->desktop_cookie.sequence);
+
+  if(window->state_cookie.sequence)
+    xcb_discard_reply(globalconf.connection, window->state_cookie.sequence);
+
+  window->desktop_cookie = xcb_ewmh_get_wm_desktop_unchecked(&globalconf.ewmh,
+                                                             window->id);
+
+  window->state_cookie = xcb_ewmh_get_wm_state_unchecked(&globalconf.ewmh,
+                                                         window->id);
+
+  globalconf.hidden_update_pending = true;
+}
+
+/** Get the replies of  the GetProperty requests previously sent for
+ *  the hidden state of the window, if any
+ *
+ * \param window The window object
+ */
+static void
+window_get_hidden_properties_reply(window_t *window)
+{
+  if(window->desktop_cookie.sequence)
+    {
+      if(!xcb_ewmh_get_wm_desktop_reply(&globalconf.ewmh,
+                                        window->desktop_cookie,
+                                        &window->desktop, NULL))
+        window->desktop = WINDOW_ALL_DESKTOPS;
+
+      window->desktop_cookie.sequence = 0;
+    }
+
+  if(window->state_cookie.sequence)
+    {
+      xcb_ewmh_get_atoms_reply_t state;
+      window->is_minimized = false;
+
+      if(xcb_ewmh_get_wm_state_reply(&globalconf.ewmh, window->state_cookie,
+                                     &state, NULL))
+        {
+          for(uint32_t atom_n = 0; atom_n < state.atoms_len; atom_n++)
+            if(state.atoms[atom_n] == globalconf.ewmh._NET_WM_STATE_HIDDEN)
+              {
+                window->is_minimized = true;
+                break;
+              }
+
+          xcb_ewmh_get_atoms_reply_wipe(&state);
+        }
+
+      window->state_cookie.sequence = 0;
+    }
+}
+
+/** Update  the hidden  state of  the  window, namely  whether it  is
+ *  minimized  or on  another  desktop than  the current  one.   Most
+ *  window managers unmap such windows anyway, but they may be mapped
+ *  for other reasons,  and their Pixmap would be kept  alive and their
+ *  damages handled for nothing otherwise
+ *
+ * \param window The window object
+ */
+void
+window_update_hidden(window_t *window)
+{
+  window_get_hidden_properties_reply(window);
+
+  const bool is_hidden = !window->is_forced_mapped &&
+    (window->is_minimized ||
+     (globalconf.current_desktop.initialised &&
+      window->desktop != WINDOW_ALL_DESKTOPS &&
+      window->desktop != globalconf.current_desktop.value));
+
+  if(is_hidden == window->is_hidden)
+    return;
+
+  debug("Window %jx is now %s", (uintmax_t) window->id,
+        is_hidden ? "hidden" : "shown");
+
+  window->is_hidden = is_hidden;
+  window_underlay_remove(window);
+
+  if(is_hidden)
+    {
+      window->hidden_timestamp = ev_now(globalconf.event_loop);
+
+      /* Clear the window from the screen if it was painted */
+      if(window->damaged && window_is_visible(window))
+        display_add_damaged_region(&window->region, false);
+
+      /* Its content will be repainted entirely once shown again */
+      window->damaged = false;
+    }
+  else if(window->attributes &&
+          window->attributes->map_state == XCB_MAP_STATE_VIEWABLE &&
+          window_is_visible(window))
+    {
+      /* The Pixmap may have been released while the window was hidden */
+      if(window->pixmap == XCB_NONE)
+        window->pixmap = window_get_pixmap(window);
+
+      /* There may not be any DamageNotify as the content of the window
+         may not have changed, so paint it right now */
+      window->damaged = true;
+      window->damaged_ratio = 1.0;
+      display_add_damaged_region(&window->region, false);
+    }
+}
+
+/** Update  the hidden state of  the windows whose hidden  properties
+ *  have been requested  while draining the events queue (MapNotify and
+ *  PropertyNotify), thus waiting at most once for all their replies
+ *  rather than when handling each DamageNotify
+ */
+void
+window_update_pending_hidden(void)
+{
+  if(!globalconf.hidden_update_pending)
+    return;
+
+  globalconf.hidden_update_pending = false;
+
+  for(window_t *window = globalconf.windows; window; window = window->next)
+    if(window->desktop_cookie.sequence || window->state_cookie.sequence)
+      window_update_hidden(window);
+}
+
+/** Get the  reply of the _NET_CURRENT_DESKTOP  GetProperty request and
+ *  update the hidden state of all windows if it has changed
+ */
+void
+window_update_current_desktop(void)
+{
+  if(!globalconf.current_desktop.cookie.sequence)
+    return;
+
+  uint32_t current_desktop;
+  const bool initialised =
+    xcb_ewmh_get_current_desktop_reply(&globalconf.ewmh,
+                                       globalconf.current_desktop.cookie,
+                                       &current_desktop, NULL);
+
+  globalconf.current_desktop.cookie.sequence = 0;
+
+  if(initialised == globalconf.current_desktop.initialised &&
+     (!initialised || current_desktop == globalconf.current_desktop.value))
+    return;
+
+  debug("Current desktop: %ju", (uintmax_t) current_desktop);
+
+  globalconf.current_desktop.initialised = initialised;
+  globalconf.current_desktop.value = current_desktop;
+
+  for(window_t *window = globalconf.windows; window; window = window->next)
+    window_update_hidden(window);
+}
+
+/** Release the Pixmap (and thus the  rendering backend Picture) of the
+ *  windows hidden for longer than the configured grace period. It is
+ *  got again when the window is shown
+ */
+void
+window_free_hidden_pixmaps(void)
+{
+  const ev_tstamp now = ev_now(globalconf.event_loop);
+
+  for(window_t *window = globalconf.windows; window; window = window->next)
+    if(window->is_hidden && window->pixmap != XCB_NONE &&
+       now - window->hidden_timestamp >= globalconf.hidden_release_time)
+      {
+        debug("Releasing Pixmap of hidden window %jx", (uintmax_t) window->id);
+        window_free_pixmap(window);
+      }
+}
+
 /** Send ChangeWindowAttributes  request to set  the override-redirect
  *  flag  on the  given window  to define  whether the  window manager
  *  should take care of the window or not
@@ -410,6 +805,9 @@ window_get_invisible_window_pixmap(window_t *window)
   if(!window->attributes->override_redirect)
     window_set_override_redirect(window, true);
 
+  window->is_forced_mapped = true;
+  window_update_hidden(window);
+
   xcb_map_window(globalconf.connection, window->id);
 }
 
@@ -424,6 +822,9 @@ window_get_invisible_window_pixmap_finalise(window_t *window)
 {
   xcb_unmap_window(globalconf.connection, window->id);
   window_set_override_redirect(window, false);
+
+  window->is_forced_mapped = false;
+  window_update_hidden(window);
 }
 
 typedef struct
@@ -469,10 +870,13 @@ static bool
 window_add_requests_finalise(window_t * const window,
 			     const window_add_requests_cookies_t window_add_cookies)
 {
+  double trace_wait_begin = trace_begin();
   window->attributes = xcb_get_window_attributes_reply(globalconf.connection,
 						       window_add_cookies.attributes,
 						       NULL);
 
+  trace_end("wait", "GetWindowAttributes", window->id, trace_wait_begin);
+
   if(!window->attributes)
     {
       debug("GetWindowAttributes failed for window %jx", (uintmax_t) window->id);
@@ -485,7 +889,7 @@ window_add_requests_finalise(window_t * const window,
     window->damage = XCB_NONE;
   else
     {
-      window->damage = xcb_generate_id(globalconf.connection);
+      window->damage = xid_generate(XID_TYPE_DAMAGE);
 
       /* With DamageReportRawRectangles level, no attempt to compress
          out overlapping rectangles is made, therefore many events are
@@ -498,10 +902,13 @@ window_add_requests_finalise(window_t * const window,
 
   if(window_add_cookies.geometry.sequence)
     {
+      trace_wait_begin = trace_begin();
       window->geometry = xcb_get_geometry_reply(globalconf.connection,
                                                 window_add_cookies.geometry,
                                                 NULL);
 
+      trace_end("wait", "GetGeometry", window->id, trace_wait_begin);
+
       if(!window->geometry)
         {
           debug("GetGeometry failed for window %jx", (uintmax_t) window->id);
@@ -558,6 +965,8 @@ window_manage_existing(const int nwindows,
          window_is_visible(new_windows[nwindow]))
 	{
 	  window_register_notify(new_windows[nwindow]);
+	  window_get_opaque_region_property(new_windows[nwindow]);
+	  window_get_hidden_properties(new_windows[nwindow]);
 	  new_windows[nwindow]->pixmap = window_get_pixmap(new_windows[nwindow]);
 
           /* Get the Window Region as  well, this is also performed in
@@ -649,6 +1058,337 @@ window_restack(window_t *window, xcb_window_t window_new_above_id)
     }
 }
 
+/** Consider the given window as not static anymore because its
+ *  geometry, stacking order, opacity or map state has changed, and
+ *  remove it from the underlay if it was painted there
+ *
+ * \param window The window object
+ */
+void
+window_underlay_remove(window_t *window)
+{
+  window->damage_timestamp = ev_now(globalconf.event_loop);
+  window->damage_interval = 0;
+
+  if(window->in_underlay)
+    {
+      display_add_underlay_damaged_region(window->region);
+      window->in_underlay = false;
+    }
+}
+
+/** Check whether the given window is static, namely it has not been
+ *  damaged  for a  while.  Once in  the  underlay, a  window is  kept
+ *  there as long as it is not damaged too often, to avoid windows such
+ *  as clocks being removed and added back all the time
+ *
+ * \param window The window object
+ * \param now The current time
+ * \return true if the window can be painted in the underlay
+ */
+static inline bool
+window_is_static(const window_t *window, const ev_tstamp now)
+{
+  return (now - window->damage_timestamp >= globalconf.underlay_idle_time ||
+          (window->in_underlay &&
+           window->damage_interval >= globalconf.underlay_idle_time));
+}
+
+/** Update the  windows painted in the  underlay, which are  the static
+ *  windows at the bottom of the stack, ignoring windows which are not
+ *  painted  anyway (such as  unmapped windows).   The Region  of each
+ *  window added or removed from the underlay is repainted there
+ *
+ * \param windows The list of windows currently managed
+ */
+static void
+window_update_underlay(window_t *windows)
+{
+  const ev_tstamp now = ev_now(globalconf.event_loop);
+  bool is_bottom_static = true;
+
+  for(window_t *window = windows; window; window = window->next)
+    {
+      bool is_static = false;
+
+      if(is_bottom_static && !window->is_hidden &&
+         window->damaged && window->pixmap != XCB_NONE && window_is_visible(window))
+        {
+          is_static = window_is_static(window, now);
+          is_bottom_static = is_static;
+        }
+
+      if(is_static != window->in_underlay)
+        {
+          debug("Window %jx %s underlay", (uintmax_t) window->id,
+                is_static ? "added to" : "removed from");
+
+          display_add_underlay_damaged_region(window->region);
+          window->in_underlay = is_static;
+        }
+    }
+}
+
+/** Get the window  opacity from the  plugins, the window  is opaque if
+ *  no plugin provides the opacity
+ *
+ * \param window The window object
+ * \return The window opacity
+ */
+static uint16_t
+window_get_opacity(const window_t *window)
+{
+  for(plugin_t *plugin = globalconf.plugins; plugin; plugin = plugin->next)
+    if(plugin->enable && plugin->vtable->window_get_opacity)
+      return (*plugin->vtable->window_get_opacity)(window);
+
+  return UINT16_MAX;
+}
+
+/** Get the window rectangle on the screen (including its border)
+ *  clipped to the screen geometry
+ *
+ * \param window The window object
+ * \param rectangle The rectangle to fill
+ */
+static void
+window_get_screen_rectangle(const window_t *window, xcb_rectangle_t *rectangle)
+{
+  const int x1 = window->geometry->x < 0 ? 0 : window->geometry->x;
+  const int y1 = window->geometry->y < 0 ? 0 : window->geometry->y;
+
+  int x2 = window->geometry->x + window_width_with_border(window->geometry);
+  if(x2 > globalconf.screen->width_in_pixels)
+    x2 = globalconf.screen->width_in_pixels;
+
+  int y2 = window->geometry->y + window_height_with_border(window->geometry);
+  if(y2 > globalconf.screen->height_in_pixels)
+    y2 = globalconf.screen->height_in_pixels;
+
+  rectangle->x = (int16_t) x1;
+  rectangle->y = (int16_t) y1;
+  rectangle->width = (uint16_t) (x2 > x1 ? x2 - x1 : 0);
+  rectangle->height = (uint16_t) (y2 > y1 ? y2 - y1 : 0);
+}
+
+/** Get the largest rectangle of the screen where the window is painted
+ *  fully opaque, namely the whole window if it has no alpha channel,
+ *  otherwise the largest rectangle of its _NET_WM_OPAQUE_REGION
+ *
+ * \param window The window object
+ * \param rectangle The opaque rectangle in screen coordinates
+ * \return false if no part of the window is known to be opaque
+ */
+static bool
+window_get_opaque_rectangle(window_t *window, xcb_rectangle_t *rectangle)
+{
+  if(!globalconf.rendering->is_window_argb || !window_is_rectangular(window) ||
+     window_get_opacity(window) != UINT16_MAX)
+    return false;
+
+  if(!(*globalconf.rendering->is_window_argb)(window))
+    {
+      window_get_screen_rectangle(window, rectangle);
+      return true;
+    }
+
+  if(window_get_opaque_region(window) == XCB_NONE)
+    return false;
+
+  const xcb_rectangle_t *largest = window->opaque_rectangles;
+  for(uint32_t rectangle_n = 1; rectangle_n < window->opaque_rectangles_len;
+      rectangle_n++)
+    if(window->opaque_rectangles[rectangle_n].width *
+       window->opaque_rectangles[rectangle_n].height >
+       largest->width * largest->height)
+      largest = &window->opaque_rectangles[rectangle_n];
+
+  /* Clip the rectangle to the window itself */
+  const int x1 = largest->x < 0 ? 0 : largest->x;
+  const int y1 = largest->y < 0 ? 0 : largest->y;
+  const int x2 = (largest->x + largest->width > window->geometry->width ?
+                  window->geometry->width : largest->x + largest->width);
+  const int y2 = (largest->y + largest->height > window->geometry->height ?
+                  window->geometry->height : largest->y + largest->height);
+
+  if(x2 <= x1 || y2 <= y1)
+    return false;
+
+  const int16_t offset_x = (int16_t) (window->geometry->x +
+                                      window->geometry->border_width);
+  const int16_t offset_y = (int16_t) (window->geometry->y +
+                                      window->geometry->border_width);
+
+  rectangle->x = (int16_t) (offset_x + x1);
+  rectangle->y = (int16_t) (offset_y + y1);
+  rectangle->width = (uint16_t) (x2 - x1);
+  rectangle->height = (uint16_t) (y2 - y1);
+  return true;
+}
+
+/** Check whether the inner rectangle is contained within the outer one
+ *
+ * \param outer The outer rectangle
+ * \param inner The inner rectangle
+ * \return true if the inner rectangle is fully contained
+ */
+static inline bool
+window_rectangle_contains(const xcb_rectangle_t *outer,
+                          const xcb_rectangle_t *inner)
+{
+  return (inner->x >= outer->x && inner->y >= outer->y &&
+          inner->x + inner->width <= outer->x + outer->width &&
+          inner->y + inner->height <= outer->y + outer->height);
+}
+
+/** Mark the windows which are entirely hidden by the opaque part of a
+ *  single window above them,  thus  they  don't need  to  be painted.
+ *  This  is  only an approximation  (a  window  hidden  by  several
+ *  windows is still painted) but it does not require any round-trip
+ *
+ * \param windows The list of windows currently managed
+ */
+static void
+window_update_occluded(window_t *windows)
+{
+  unsigned int nwindows = 0;
+  for(window_t *window = windows; window; window = window->next)
+    nwindows++;
+
+  if(!nwindows)
+    return;
+
+  if(nwindows > _window_occlusion_buffers.size)
+    {
+      _window_occlusion_buffers.size = nwindows;
+
+      _window_occlusion_buffers.windows =
+        realloc(_window_occlusion_buffers.windows, nwindows * sizeof(window_t *));
+
+      _window_occlusion_buffers.occluders =
+        realloc(_window_occlusion_buffers.occluders,
+                nwindows * sizeof(xcb_rectangle_t));
+    }
+
+  /* The windows list is sorted from the bottommost window */
+  window_t **windows_stack = _window_occlusion_buffers.windows;
+  unsigned int window_n = 0;
+  for(window_t *window = windows; window; window = window->next)
+    windows_stack[window_n++] = window;
+
+  xcb_rectangle_t *occluders = _window_occlusion_buffers.occluders;
+  unsigned int noccluders = 0;
+
+  while(window_n--)
+    {
+      window_t *window = windows_stack[window_n];
+      window->is_occluded = false;
+
+      if(!window->damaged || window->is_hidden || !window_is_visible(window) ||
+         (window->pixmap == XCB_NONE && !window->is_pixmap_evicted))
+        continue;
+
+      xcb_rectangle_t window_rectangle;
+      window_get_screen_rectangle(window, &window_rectangle);
+
+      for(unsigned int occluder_n = 0; occluder_n < noccluders; occluder_n++)
+        if(window_rectangle_contains(&occluders[occluder_n], &window_rectangle))
+          {
+            debug("Window %jx is occluded", (uintmax_t) window->id);
+            window->is_occluded = true;
+            break;
+          }
+
+      if(!window->is_occluded &&
+         window_get_opaque_rectangle(window, &occluders[noccluders]))
+        noccluders++;
+    }
+}
+
+/** Check whether the  window is currently not painted on  the screen,
+ *  thus its Pixmap can be released without being named again soon
+ *
+ * \param window The window object
+ * \return true if the window is not painted
+ */
+static inline bool
+window_is_unpainted(const window_t *window)
+{
+  return (window->attributes->map_state != XCB_MAP_STATE_VIEWABLE ||
+          window->is_hidden || window->is_occluded ||
+          !window_is_visible(window));
+}
+
+/** Compare windows by increasing last painting time, for qsort()
+ *
+ * \param a The first window
+ * \param b The second window
+ * \return The comparison result as expected by qsort()
+ */
+static int
+window_cmp_paint_timestamp(const void *a, const void *b)
+{
+  const window_t *window_a = *(window_t * const *) a;
+  const window_t *window_b = *(window_t * const *) b;
+
+  if(window_a->paint_timestamp == window_b->paint_timestamp)
+    return 0;
+
+  return window_a->paint_timestamp < window_b->paint_timestamp ? -1 : 1;
+}
+
+/** Release the Pixmaps of  the least recently painted windows which are
+ *  not  painted on  the screen  anymore  (unmapped,  hidden,  occluded or
+ *  off-screen) until the estimated size of all Pixmaps fits within the
+ *  configured budget. They are named again when painted.  Must be called
+ *  after window_update_occluded() on the same windows list, whose buffer
+ *  holds the candidates
+ *
+ * \param windows The list of windows currently managed
+ */
+static void
+window_evict_pixmaps(window_t *windows)
+{
+  if(globalconf.pixmaps_size <= globalconf.pixmaps_budget)
+    return;
+
+  /* Windows painted in  the underlay or mapped by  plugins are still
+     needed even if they are not painted in this iteration */
+  window_t **candidates = _window_occlusion_buffers.windows;
+  unsigned int candidates_len = 0;
+  for(window_t *window = windows;
+      window && candidates_len < _window_occlusion_buffers.size;
+      window = window->next)
+    if(window->pixmap != XCB_NONE && !window->in_underlay &&
+       !window->is_forced_mapped && window_is_unpainted(window))
+      candidates[candidates_len++] = window;
+
+  qsort(candidates, candidates_len, sizeof(window_t *),
+        window_cmp_paint_timestamp);
+
+  for(unsigned int candidate_n = 0;
+      candidate_n < candidates_len &&
+        globalconf.pixmaps_size > globalconf.pixmaps_budget;
+      candidate_n++)
+    {
+      window_t *lru_window = candidates[candidate_n];
+
+      debug("Evicting Pixmap of window %jx (%ju bytes)",
+            (uintmax_t) lru_window->id, (uintmax_t) lru_window->pixmap_size);
+
+      window_free_pixmap(lru_window);
+      lru_window->is_pixmap_evicted = true;
+      globalconf.pixmaps_evictions++;
+    }
+
+  if(globalconf.pixmaps_size > globalconf.pixmaps_budget)
+    debug("Pixmaps budget exceeded by painted windows: %ju bytes",
+          (uintmax_t) globalconf.pixmaps_size);
+
+  debug("Pixmaps size: %ju bytes, evictions: %u",
+        (uintmax_t) globalconf.pixmaps_size, globalconf.pixmaps_evictions);
+}
+
 /** Paint all windows  on the screen by calling  the rendering backend
  *  hooks (not all windows may be painted though)
  *
@@ -660,24 +1400,112 @@ window_paint_all(window_t *windows)
   /* If the background  is reset, then repaint the  whole screen, it's
      bad from a performance point of view, but it's done rarely */
   if(globalconf.background_reset)
-    display_reset_damaged();
+    {
+      display_reset_damaged();
+      globalconf.underlay_reset = true;
+    }
+
+  /* Static windows at the bottom  of the stack are painted with the
+     background in the underlay, only  repainted where they have been
+     damaged, and the  underlay is then painted as  a whole, but this
+     only applies to windows managed  by the core (not the ones given
+     by plugins) */
+  const bool do_underlay = (windows == globalconf.windows &&
+                            globalconf.underlay_idle_time > 0 &&
+                            globalconf.rendering->paint_underlay_begin);
 
-  (*globalconf.rendering->paint_background)();
+  double trace_phase_begin = trace_begin();
+
+  if(do_underlay)
+    {
+      window_update_underlay(windows);
+
+      if((*globalconf.rendering->paint_underlay_begin)())
+        for(window_t *window = windows; window; window = window->next)
+          if(window->in_underlay)
+            (*globalconf.rendering->paint_window)(window);
+
+      (*globalconf.rendering->paint_underlay_end)();
+      display_reset_underlay_damaged();
+    }
+  else
+    (*globalconf.rendering->paint_background)();
+
+  trace_end("phase", do_underlay ? "paint_underlay" : "paint_background", 0,
+            trace_phase_begin);
+
+  /* Windows hidden by an opaque window above are not painted, except in
+     the underlay  as the  latter is not  repainted when  the window
+     above is moved */
+  const bool do_occlusion = (windows == globalconf.windows);
+  if(do_occlusion)
+    window_update_occluded(windows);
+
+  uint64_t frame_pixels = 0;
+
+  /* Windows  repainted  in full  (first half) or  damaged but  not
+     painted (second half), only shown by the damage overlay */
+  const bool do_overlay = (globalconf.damage_overlay &&
+                           globalconf.rendering->paint_damage_overlay);
+
+  xcb_rectangle_t *overlay_rectangles = NULL;
+  uint32_t windows_len = 0, full_len = 0, skipped_len = 0;
+  if(do_overlay)
+    {
+      for(window_t *window = windows; window; window = window->next)
+        windows_len++;
+
+      overlay_rectangles = calloc(2 * windows_len + 1, sizeof(xcb_rectangle_t));
+    }
 
   for(window_t *window = windows; window; window = window->next)
     {
-      if(window->damaged)
+      /* The underlay has already been painted */
+      bool is_painted = do_underlay && window->in_underlay;
+
+      if(window->damaged && !is_painted &&
+         !(do_occlusion && (window->is_occluded || window->is_hidden)))
         {
           debug("Painting window %jx", (uintmax_t) window->id);
+          trace_phase_begin = trace_begin();
+          window_restore_pixmap(window);
           (*globalconf.rendering->paint_window)(window);
+          window->paint_timestamp = ev_now(globalconf.event_loop);
+          trace_end("phase", "paint_window", window->id, trace_phase_begin);
+
+          window->cost.paint_calls++;
+          window->cost.frame_pixels = window_get_screen_area(window);
+          frame_pixels += window->cost.frame_pixels;
+          is_painted = true;
         }
       /* When the  window has been damaged  or was damaged but  is not
          visible anymore */
       if(window->damaged_ratio)
         {
+          if(do_overlay && window->geometry)
+            {
+              const xcb_rectangle_t rectangle = {
+                window->geometry->x, window->geometry->y,
+                window_width_with_border(window->geometry),
+                window_height_with_border(window->geometry)
+              };
+
+              if(!is_painted)
+                overlay_rectangles[windows_len + skipped_len++] = rectangle;
+              else if(window->damaged_ratio >= WINDOW_FULLY_DAMAGED_RATIO)
+                overlay_rectangles[full_len++] = rectangle;
+            }
+
           /* Reset damaged ratio for the next repaint */
           window->damaged_ratio = 0.0;
 
+          /* The damage will be on the screen once the frame has been
+             synced, otherwise it is discarded */
+          if(is_painted)
+            window->frame_damage_arrival = window->damage_arrival;
+
+          window->damage_arrival = 0;
+
           /* And the DamageNotify events counter */
           window->damage_notify_counter = 0;
 
@@ -691,7 +1519,78 @@ window_paint_all(window_t *windows)
         }
     }
 
+  trace_phase_begin = trace_begin();
   (*globalconf.rendering->paint_all)();
   globalconf.background_reset = false;
-  xcb_aux_sync(globalconf.connection);
+  trace_end("phase", "paint_all", 0, trace_phase_begin);
+
+  /* Drawn in the same frame, over the windows already on the screen so
+     the tints never end up in the buffer, without any round trip */
+  if(do_overlay)
+    {
+      (*globalconf.rendering->paint_damage_overlay)(overlay_rectangles,
+                                                    full_len,
+                                                    overlay_rectangles + windows_len,
+                                                    skipped_len);
+      free(overlay_rectangles);
+    }
+
+  /* Only the windows managed by the core can be evicted, as plugins may
+     still use the Pixmaps of the windows given by their own list */
+  if(do_occlusion && globalconf.pixmaps_budget)
+    window_evict_pixmaps(windows);
+
+  /* Sync  explicitly rather than  with xcb_aux_sync() to  count the
+     requests sent for this frame from the sequence number */
+  trace_phase_begin = trace_begin();
+  const ev_tstamp sync_begin = ev_time();
+  xcb_get_input_focus_cookie_t sync_cookie =
+    xcb_get_input_focus(globalconf.connection);
+
+  metrics_add_frame_requests(sync_cookie.sequence);
+  free(xcb_get_input_focus_reply(globalconf.connection, sync_cookie, NULL));
+  trace_end("wait", "sync", 0, trace_phase_begin);
+
+  /* The  frame is  on the screen  once synced:  the time waiting for
+     the sync reply is mostly spent by the server painting the frame,
+     shared among the windows painted according to their painted area */
+  const ev_tstamp present_time = ev_time();
+  const double sync_time = present_time - sync_begin;
+  double frame_latency = 0;
+
+  for(window_t *window = windows; window; window = window->next)
+    {
+      if(window->cost.frame_pixels)
+        {
+          window->cost.painted_pixels += window->cost.frame_pixels;
+          window->cost.server_time +=
+            sync_time * window->cost.frame_pixels / (double) frame_pixels;
+
+          window->cost.frame_pixels = 0;
+        }
+
+      if(window->frame_damage_arrival)
+        {
+          const double latency = present_time - window->frame_damage_arrival;
+          metrics_add_damage_latency(&window->damage_latency, latency);
+
+          if(latency > frame_latency)
+            frame_latency = latency;
+
+          window->frame_damage_arrival = 0;
+        }
+    }
+
+  if(frame_latency > 0)
+    metrics_add_frame_latency(frame_latency);
+
+  for(plugin_t *plugin = globalconf.plugins; plugin; plugin = plugin->next)
+    if(plugin->enable && plugin->vtable->frame_presented)
+      (*plugin->vtable->frame_presented)(present_time);
+
+  /* The damages of the windows managed by the core are not painted
+     when a plugin gives its own windows */
+  if(!do_occlusion)
+    for(window_t *window = globalconf.windows; window; window = window->next)
+      window->damage_arrival = 0;
 }
@@ -0,0 +1,327 @@
+/* -*-mode:c;coding:utf-8; c-basic-offset:2;fill-column:70;c-file-style:"gnu"-*-
+ *
+ * Copyright (C) 2009 Arnaud "arnau" Fontaine <arnau@mini-dweeb.org>
+ *
+ * This  program is  free  software: you  can  redistribute it  and/or
+ * modify  it under the  terms of  the GNU  General Public  License as
+ * published by the Free Software  Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT  ANY  WARRANTY;  without   even  the  implied  warranty  of
+ * MERCHANTABILITY or  FITNESS FOR A PARTICULAR PURPOSE.   See the GNU
+ * General Public License for more details.
+ *
+ * You should have  received a copy of the  GNU General Public License
+ *  along      with      this      program.      If      not,      see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+ *  \brief Accounting of the server resources created
+ *
+ *  Regions, Pictures,  Pixmaps, Damages and  GCs are created  with an
+ *  XID allocated by 'xid_generate'  rather than xcb_generate_id(), and
+ *  'xid_free'  is called  whenever they are  freed,  either explicitly
+ *  or by the server (e.g. the Damage of a destroyed window).  Thus,
+ *  live resources are counted by type and by call site creating them,
+ *  a resource freed twice or  never created being reported as an
+ *  orphaned free.
+ *
+ *  A leak slowly  grows the number of live  resources of its call
+ *  site, which is reported, along with  the age of the oldest one, on
+ *  the metrics  socket ("xids", see  'metrics.c').  The resources still
+ *  alive when exiting, once everything has been freed, are reported as
+ *  well.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "xid.h"
+#include "structs.h"
+
+/** Names of the resource types, indexed by 'xid_type_t' */
+static const char *_xid_type_names[XID_TYPE_NB] = {
+  "region", "picture", "pixmap", "damage", "gc"
+};
+
+/** Get the current monotonic time
+ *
+ * \return The time in seconds
+ */
+static double
+_xid_now(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+/** Get the call site with the given file and line, creating it if not
+ *  found, which  happens when a plugin  is loaded again  as the site
+ *  cached by the caller has been reset
+ *
+ * \param type The type of the resources created
+ * \param file The source file
+ * \param line The source line
+ * \return The call site
+ */
+static xid_site_t *
+_xid_get_site(const xid_type_t type, const char *file, const int line)
+{
+  const char *basename = strrchr(file, '/');
+  char label[sizeof(((xid_site_t *) NULL)->label)];
+  snprintf(label, sizeof(label), "%s:%d", basename ? basename + 1 : file, line);
+
+  for(xid_site_t *site = globalconf.xids.sites; site; site = site->next)
+    if(site->type == type && !strcmp(site->label, label))
+      return site;
+
+  xid_site_t *site = calloc(1, sizeof(xid_site_t));
+  /* The label  is copied as the file  name of a plugin is unmapped once
+     it is unloaded */
+  memcpy(site->label, label, sizeof(label));
+  site->type = type;
+  site->index = globalconf.xids.sites_len++;
+  site->next = globalconf.xids.sites;
+  globalconf.xids.sites = site;
+
+  return site;
+}
+
+/** Allocate an XID and account the resource to its call site, meaningful
+ *  to be called through 'xid_generate'
+ *
+ * \param type The type of the resource
+ * \param site The call site, looked up if not set yet
+ * \param file The source file of the call site
+ * \param line The source line of the call site
+ * \return The XID
+ */
+uint32_t
+_xid_generate(const xid_type_t type, xid_site_t **site, const char *file,
+              const int line)
+{
+  const uint32_t xid = xcb_generate_id(globalconf.connection);
+
+  if(!*site)
+    *site = _xid_get_site(type, file, line);
+
+  xid_object_t *object = malloc(sizeof(xid_object_t));
+  object->site = *site;
+  object->created = _xid_now();
+
+  globalconf.xids.objects = util_itree_insert(globalconf.xids.objects, xid,
+                                              object);
+
+  (*site)->live++;
+  (*site)->created++;
+  globalconf.xids.live[type]++;
+
+  return xid;
+}
+
+/** Account a freed resource, called before or after freeing it
+ *
+ * \param type The type of the resource
+ * \param xid The XID of the resource
+ */
+void
+xid_free(const xid_type_t type, const uint32_t xid)
+{
+  if(xid == XCB_NONE)
+    return;
+
+  xid_object_t *object = util_itree_get(globalconf.xids.objects, xid);
+  if(!object || object->site->type != type)
+    {
+      warn("Freeing %s %jx which is not alive", _xid_type_names[type],
+           (uintmax_t) xid);
+
+      globalconf.xids.orphaned_frees[type]++;
+      return;
+    }
+
+  globalconf.xids.objects = util_itree_remove(globalconf.xids.objects, xid);
+
+  object->site->live--;
+  globalconf.xids.live[type]--;
+  free(object);
+}
+
+/** Get the creation time of the oldest resource alive of each call site
+ *
+ * \param node The node of the live resources tree
+ * \param oldest The creation time of the oldest resource, by site index
+ */
+static void
+_xid_get_oldest(const util_itree_t *node, double *oldest)
+{
+  if(!node)
+    return;
+
+  const xid_object_t *object = node->value;
+  if(!oldest[object->site->index] ||
+     object->created < oldest[object->site->index])
+    oldest[object->site->index] = object->created;
+
+  _xid_get_oldest(node->left, oldest);
+  _xid_get_oldest(node->right, oldest);
+}
+
+/** Write the resources alive for more than the given age
+ *
+ * \param fp The stream written to
+ * \param node The node of the live resources tree
+ * \param now The current time
+ * \param age The minimum age in seconds
+ * \param is_first Whether no resource has been written yet
+ */
+static void
+_xid_write_long_lived(FILE *fp, const util_itree_t *node, const double now,
+                      const double age, bool *is_first)
+{
+  if(!node)
+    return;
+
+  _xid_write_long_lived(fp, node->left, now, age, is_first);
+
+  const xid_object_t *object = node->value;
+  if(now - object->created > age)
+    {
+      fprintf(fp, "%s\n    {\"xid\": %u, \"type\": \"%s\", \"site\": \"%s\", "
+              "\"age\": %.1f}", *is_first ? "" : ",", node->key,
+              _xid_type_names[object->site->type], object->site->label,
+              now - object->created);
+
+      *is_first = false;
+    }
+
+  _xid_write_long_lived(fp, node->right, now, age, is_first);
+}
+
+/** Compare call sites by number of live resources, then by label
+ *
+ * \param a The first call site
+ * \param b The second call site
+ * \return The comparison result as expected by qsort()
+ */
+static int
+_xid_cmp_sites(const void *a, const void *b)
+{
+  const xid_site_t *site_a = *(xid_site_t * const *) a;
+  const xid_site_t *site_b = *(xid_site_t * const *) b;
+
+  if(site_a->live != site_b->live)
+    return site_a->live > site_b->live ? -1 : 1;
+
+  return strcmp(site_a->label, site_b->label);
+}
+
+/** Write the live resources as JSON: their number by type and by call
+ *  site, sorted by number of live resources, with the age of the oldest
+ *  one, and the resources alive for more than the given age
+ *
+ * \param fp The stream written to
+ * \param age The minimum age in seconds of the resources listed, none
+ *            are listed if negative
+ */
+void
+xid_write_report(FILE *fp, const double age)
+{
+  const double now = _xid_now();
+
+  fputs("{\n  \"live\": {", fp);
+  for(int type = 0; type < XID_TYPE_NB; type++)
+    fprintf(fp, "%s\"%s\": %u", type ? ", " : "", _xid_type_names[type],
+            globalconf.xids.live[type]);
+
+  fputs("},\n  \"orphaned_frees\": {", fp);
+  for(int type = 0; type < XID_TYPE_NB; type++)
+    fprintf(fp, "%s\"%s\": %u", type ? ", " : "", _xid_type_names[type],
+            globalconf.xids.orphaned_frees[type]);
+
+  fputs("},\n  \"sites\": [", fp);
+
+  const uint32_t sites_len = globalconf.xids.sites_len;
+  xid_site_t **sites = calloc(sites_len + 1, sizeof(xid_site_t *));
+  double *oldest = calloc(sites_len + 1, sizeof(double));
+
+  uint32_t site_n = 0;
+  for(xid_site_t *site = globalconf.xids.sites; site; site = site->next)
+    sites[site_n++] = site;
+
+  qsort(sites, sites_len, sizeof(xid_site_t *), _xid_cmp_sites);
+  _xid_get_oldest(globalconf.xids.objects, oldest);
+
+  for(site_n = 0; site_n < sites_len; site_n++)
+    fprintf(fp, "%s\n    {\"site\": \"%s\", \"type\": \"%s\", \"live\": %u, "
+            "\"created\": %ju, \"oldest_age\": %.1f}", site_n ? "," : "",
+            sites[site_n]->label, _xid_type_names[sites[site_n]->type],
+            sites[site_n]->live, (uintmax_t) sites[site_n]->created,
+            sites[site_n]->live ? now - oldest[sites[site_n]->index] : 0);
+
+  free(oldest);
+  free(sites);
+
+  fputs("\n  ]", fp);
+
+  if(age >= 0)
+    {
+      bool is_first = true;
+
+      fputs(",\n  \"long_lived\": [", fp);
+      _xid_write_long_lived(fp, globalconf.xids.objects, now, age, &is_first);
+      fputs("\n  ]", fp);
+    }
+
+  fputs("\n}\n", fp);
+}
+
+/** Free the live resources tree, freeing the object of each node
+ *
+ * \param node The node of the live resources tree
+ */
+static void
+_xid_free_objects(util_itree_t *node)
+{
+  if(!node)
+    return;
+
+  _xid_free_objects(node->left);
+  _xid_free_objects(node->right);
+  free(node->value);
+  free(node);
+}
+
+/** Report the resources  still alive, which have not  been freed before
+ *  exiting  and are thus likely leaked, then free everything, must be
+ *  called once all the resources have been freed
+ */
+void
+xid_cleanup(void)
+{
+  for(xid_site_t *site = globalconf.xids.sites; site; site = site->next)
+    if(site->live)
+      warn("%u %s(s) created at %s still alive on exit", site->live,
+           _xid_type_names[site->type], site->label);
+
+  for(int type = 0; type < XID_TYPE_NB; type++)
+    if(globalconf.xids.orphaned_frees[type])
+      warn("%u %s(s) freed while not alive", globalconf.xids.orphaned_frees[type],
+           _xid_type_names[type]);
+
+  _xid_free_objects(globalconf.xids.objects);
+  globalconf.xids.objects = NULL;
+
+  while(globalconf.xids.sites)
+    {
+      xid_site_t *site = globalconf.xids.sites;
+      globalconf.xids.sites = site->next;
+      free(site);
+    }
+
+  globalconf.xids.sites_len = 0;
+}